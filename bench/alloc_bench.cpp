@@ -0,0 +1,144 @@
+// Heap allocations made by publishing and receiving once warmed up, counted by replacing the global operator new.
+// Malloc jitter shows up in control loop timings, the steady state publish and receive paths should not allocate.
+// Usage: UDPDataLink_alloc_bench [updates], exits with 1 if any steady state update allocated
+#include "bench_types.h"
+#include <Publisher.h>
+#include <Receiver.h>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <thread>
+
+namespace
+{
+
+std::atomic<size_t> allocations{0};
+std::atomic<bool> counting{false};
+
+void * allocate(size_t size)
+{
+  if(counting.load(std::memory_order_relaxed)) allocations.fetch_add(1, std::memory_order_relaxed);
+  if(void * pointer = std::malloc(size == 0 ? 1 : size)) return pointer;
+  throw std::bad_alloc();
+}
+
+} // namespace
+
+void * operator new(size_t size)
+{
+  return allocate(size);
+}
+
+void * operator new[](size_t size)
+{
+  return allocate(size);
+}
+
+void operator delete(void * pointer) noexcept
+{
+  std::free(pointer);
+}
+
+void operator delete[](void * pointer) noexcept
+{
+  std::free(pointer);
+}
+
+void operator delete(void * pointer, size_t) noexcept
+{
+  std::free(pointer);
+}
+
+void operator delete[](void * pointer, size_t) noexcept
+{
+  std::free(pointer);
+}
+
+using namespace UDPDataLink;
+using namespace bench;
+using clock_type = std::chrono::steady_clock;
+
+namespace
+{
+
+template<typename State>
+struct QuietPublisher : public Publisher<State>
+{
+  using Publisher<State>::Publisher;
+
+  void reception_callback(const uint8_t *, size_t) override {}
+};
+
+struct Config
+{
+  const char * name;
+  bool batched;
+  bool delta;
+  bool async;
+};
+
+// Publish updates at 2 kHz, the receiver reads each one, and count the allocations made meanwhile by every thread
+template<typename State>
+size_t run(const char * type_name, const Config & config, uint16_t port, size_t updates)
+{
+  QuietPublisher<State> publisher(port);
+  publisher.set_batched_io(config.batched);
+  publisher.set_delta(config.delta, 100);
+  publisher.reserve_buffers(16, 4096);
+  publisher.set_async(config.async);
+  publisher.start_reception();
+  Receiver<State> receiver("127.0.0.1", port, 0);
+  // Heartbeats, sent by default, also go out while counting
+  receiver.set_heartbeat(std::chrono::milliseconds(20));
+  receiver.set_batched_io(config.batched);
+  receiver.set_delta(config.delta);
+  receiver.start_reception();
+  const auto deadline = clock_type::now() + std::chrono::seconds(2);
+  while(publisher.subscriber_count() == 0 && clock_type::now() < deadline)
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+  State state, received;
+  fill(state);
+  auto publish = [&](size_t count)
+  {
+    for(size_t i = 0; i < count; ++i)
+    {
+      state.time = static_cast<double>(i);
+      publisher.update_data(state);
+      receiver.get(received);
+      std::this_thread::sleep_for(std::chrono::microseconds(500));
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  };
+  publish(200);
+  allocations = 0;
+  counting = true;
+  publish(updates);
+  counting = false;
+  const auto count = allocations.load();
+  std::printf("%-16s %-22s %10zu %12zu %14.3f\n", type_name, config.name, updates, count,
+              static_cast<double>(count) / static_cast<double>(updates));
+  receiver.stop_reception();
+  publisher.stop_reception();
+  return count;
+}
+
+} // namespace
+
+int main(int argc, char ** argv)
+{
+  const size_t updates = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 2000;
+  const Config configs[] = {{"asio", false, false, false},
+                            {"sendmmsg/recvmmsg", true, false, false},
+                            {"asio + delta", false, true, false},
+                            {"asio + async", false, false, true}};
+  std::printf("%-16s %-22s %10s %12s %14s\n", "type", "transport", "updates", "allocations", "per update");
+  uint16_t port = 45500;
+  size_t total = 0;
+  for(const auto & config : configs) total += run<FixedRobotState>("FixedRobotState", config, port++, updates);
+  for(const auto & config : configs) total += run<RobotState>("RobotState", config, port++, updates);
+  return total == 0 ? 0 : 1;
+}
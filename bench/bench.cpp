@@ -0,0 +1,312 @@
+// Loopback benchmark of a Publisher and its Receivers, printing one JSON object per line:
+//   codec    encode and decode cost of representative types
+//   latency  one way latency from update_data() to the object being available through get()
+//   rate     delivered ratio at increasing update rates, and the maximum rate sustained
+//   fanout   cost of an update for 1 to 256 receivers
+//   async    cost of an update and enqueue to send latency with the asynchronous publisher
+// Usage: UDPDataLink_bench [--quick]
+#include "bench_types.h"
+#include <Publisher.h>
+#include <Receiver.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace UDPDataLink;
+using namespace bench;
+using clock_type = std::chrono::steady_clock;
+
+namespace
+{
+
+// A JSON object printed on a single line once destroyed
+class Record
+{
+public:
+  explicit Record(const char * bench)
+  {
+    std::printf("{\"bench\":\"%s\"", bench);
+  }
+
+  ~Record()
+  {
+    std::printf("}\n");
+    std::fflush(stdout);
+  }
+
+  Record & field(const char * name, const char * value)
+  {
+    std::printf(",\"%s\":\"%s\"", name, value);
+    return *this;
+  }
+
+  Record & field(const char * name, double value)
+  {
+    std::printf(",\"%s\":%.6g", name, value);
+    return *this;
+  }
+};
+
+double elapsed_ns(clock_type::time_point start)
+{
+  return std::chrono::duration<double, std::nano>(clock_type::now() - start).count();
+}
+
+template<typename Codec, typename State>
+void bench_codec(const char * type_name, size_t iterations)
+{
+  State in, out;
+  fill(in);
+  std::vector<uint8_t> buffer;
+  auto start = clock_type::now();
+  for(size_t i = 0; i < iterations; ++i)
+  {
+    in.time += 1e-3;
+    Codec::encode(in, buffer);
+  }
+  const double encode_ns = elapsed_ns(start) / iterations;
+  bool ok = true;
+  start = clock_type::now();
+  for(size_t i = 0; i < iterations; ++i) ok &= Codec::decode(buffer.data(), buffer.size(), out);
+  const double decode_ns = elapsed_ns(start) / iterations;
+  Record("codec")
+      .field("type", type_name)
+      .field("codec", Codec::name)
+      .field("bytes", buffer.size())
+      .field("encode_ns", encode_ns)
+      .field("decode_ns", decode_ns)
+      .field("ok", ok ? 1 : 0);
+}
+
+using State = FixedRobotState;
+
+// Keeps the output machine readable
+struct QuietPublisher : public Publisher<State>
+{
+  using Publisher<State>::Publisher;
+
+  void reception_callback(const uint8_t *, size_t) override {}
+};
+
+// How the sockets are read and written
+enum class Io
+{
+  Asio,
+  Sendmmsg,
+  IoUring
+};
+
+const char * io_name(Io io)
+{
+  switch(io)
+  {
+    case Io::Sendmmsg:
+      return "sendmmsg";
+    case Io::IoUring:
+      return "io_uring";
+    default:
+      return "asio";
+  }
+}
+
+// A publisher and receivers connected to it on the loopback interface, over UDP unless shared_memory is true
+struct Link
+{
+  Link(uint16_t port, size_t receivers, Io io = Io::Asio, bool shared_memory = false) : publisher(port)
+  {
+    if(io == Io::Sendmmsg) publisher.set_batched_io(true);
+    if(io == Io::IoUring) publisher.set_io_uring(true);
+    publisher.start_reception();
+    for(size_t i = 0; i < receivers; ++i)
+    {
+      this->receivers.emplace_back(new Receiver<State>("127.0.0.1", port, 0));
+      if(io == Io::IoUring) this->receivers.back()->set_io_uring(true);
+      this->receivers.back()->set_shared_memory(shared_memory);
+      this->receivers.back()->start_reception();
+    }
+    const auto deadline = clock_type::now() + std::chrono::seconds(2);
+    while(publisher.subscriber_count() < receivers && clock_type::now() < deadline)
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+
+  ~Link()
+  {
+    for(auto & receiver : receivers) receiver->stop_reception();
+    publisher.stop_reception();
+  }
+
+  size_t received() const
+  {
+    size_t count = 0;
+    for(const auto & receiver : receivers) count += receiver->link_stats().received;
+    return count;
+  }
+
+  QuietPublisher publisher;
+  std::vector<std::unique_ptr<Receiver<State>>> receivers;
+};
+
+double percentile(const std::vector<double> & sorted, double fraction)
+{
+  return sorted.empty() ? 0 : sorted[static_cast<size_t>(fraction * static_cast<double>(sorted.size() - 1))];
+}
+
+void bench_latency(size_t samples, Io io, bool shared_memory)
+{
+  Link link(45400, 1, io, shared_memory);
+  auto & receiver = *link.receivers.front();
+  State state;
+  fill(state);
+  std::vector<double> latencies;
+  latencies.reserve(samples);
+  size_t lost = 0;
+  for(size_t i = 0; i < samples; ++i)
+  {
+    const auto sequence = receiver.sequence();
+    const auto start = clock_type::now();
+    link.publisher.update_data(state);
+    const auto deadline = start + std::chrono::milliseconds(20);
+    while(receiver.sequence() == sequence && clock_type::now() < deadline) std::this_thread::yield();
+    if(receiver.sequence() == sequence) ++lost;
+    else
+      latencies.push_back(elapsed_ns(start));
+  }
+  std::sort(latencies.begin(), latencies.end());
+  Record("latency")
+      .field("type", "FixedRobotState")
+      .field("transport", shared_memory ? "shared_memory" : io == Io::IoUring ? "io_uring" : "udp")
+      .field("samples", latencies.size())
+      .field("lost", lost)
+      .field("p50_us", percentile(latencies, 0.5) / 1000)
+      .field("p90_us", percentile(latencies, 0.9) / 1000)
+      .field("p99_us", percentile(latencies, 0.99) / 1000)
+      .field("p999_us", percentile(latencies, 0.999) / 1000)
+      .field("max_us", latencies.empty() ? 0 : latencies.back() / 1000);
+}
+
+struct RateResult
+{
+  double achieved_hz = 0;
+  /** ratio of the updates received by each receiver */
+  double delivered = 0;
+  /** mean time spent in update_data() */
+  double publish_us = 0;
+};
+
+// Send updates at a given rate for a while
+RateResult send_at_rate(Link & link, double rate, clock_type::duration duration)
+{
+  State state;
+  fill(state);
+  const auto received = link.received();
+  const auto period = std::chrono::duration_cast<clock_type::duration>(std::chrono::duration<double>(1.0 / rate));
+  const auto start = clock_type::now();
+  auto next = start;
+  size_t updates = 0;
+  clock_type::duration publish_time{};
+  while(clock_type::now() - start < duration)
+  {
+    const auto before = clock_type::now();
+    link.publisher.update_data(state);
+    publish_time += clock_type::now() - before;
+    ++updates;
+    next += period;
+    while(clock_type::now() < next) std::this_thread::yield();
+  }
+  RateResult result;
+  result.achieved_hz = updates / std::chrono::duration<double>(clock_type::now() - start).count();
+  result.publish_us = std::chrono::duration<double, std::micro>(publish_time).count() / updates;
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  result.delivered =
+      static_cast<double>(link.received() - received) / static_cast<double>(updates * link.receivers.size());
+  return result;
+}
+
+void bench_rate(clock_type::duration duration)
+{
+  Link link(45401, 1);
+  double max_rate = 0;
+  for(double rate = 10000; rate <= 2.56e6; rate *= 2)
+  {
+    const auto result = send_at_rate(link, rate, duration);
+    Record("rate")
+        .field("target_hz", rate)
+        .field("achieved_hz", result.achieved_hz)
+        .field("delivered", result.delivered)
+        .field("publish_us", result.publish_us);
+    // Sustained means the publisher keeps the pace and almost everything arrives
+    if(result.achieved_hz < 0.9 * rate || result.delivered < 0.99) break;
+    max_rate = result.achieved_hz;
+  }
+  Record("max_rate").field("type", "FixedRobotState").field("hz", max_rate);
+}
+
+void bench_fanout(size_t receivers, Io io, clock_type::duration duration)
+{
+  Link link(45402, receivers, io);
+  const auto cpu_start = std::clock();
+  const auto start = clock_type::now();
+  const auto result = send_at_rate(link, 1000, duration);
+  const double cpu_seconds = static_cast<double>(std::clock() - cpu_start) / CLOCKS_PER_SEC;
+  Record("fanout")
+      .field("mode", io_name(io))
+      .field("receivers", link.publisher.subscriber_count())
+      .field("achieved_hz", result.achieved_hz)
+      .field("delivered", result.delivered)
+      .field("publish_us", result.publish_us)
+      // Publisher and receivers together, in cores
+      .field("cpu_load", cpu_seconds / std::chrono::duration<double>(clock_type::now() - start).count());
+}
+
+void bench_async(size_t receivers, clock_type::duration duration)
+{
+  Link link(45403, receivers);
+  link.publisher.set_async(true);
+  const auto result = send_at_rate(link, 1000, duration);
+  const auto stats = link.publisher.async_stats();
+  Record("async")
+      .field("receivers", link.publisher.subscriber_count())
+      .field("achieved_hz", result.achieved_hz)
+      .field("delivered", result.delivered)
+      .field("publish_us", result.publish_us)
+      .field("max_depth", stats.max_depth)
+      .field("overflowed", stats.overflowed)
+      .field("send_p50_us", stats.latency.percentile(0.5) / 1000.0)
+      .field("send_p99_us", stats.latency.percentile(0.99) / 1000.0);
+}
+
+} // namespace
+
+int main(int argc, char ** argv)
+{
+  const bool quick = argc > 1 && std::strcmp(argv[1], "--quick") == 0;
+  const size_t iterations = quick ? 10000 : 200000;
+  const auto duration = std::chrono::milliseconds(quick ? 100 : 500);
+  Record("meta").field("hardware_threads", std::thread::hardware_concurrency()).field("quick", quick ? 1 : 0);
+
+  bench_codec<BinaryCodec<RobotState>, RobotState>("RobotState", iterations);
+  bench_codec<BoostTextCodec<RobotState>, RobotState>("RobotState", iterations / 100);
+  bench_codec<BinaryCodec<FixedRobotState>, FixedRobotState>("FixedRobotState", iterations);
+  bench_codec<MemcpyCodec<FixedRobotState>, FixedRobotState>("FixedRobotState", iterations);
+  bench_codec<SchemaCodec<FixedRobotState>, FixedRobotState>("FixedRobotState", iterations);
+
+  const auto samples = quick ? 1000 : 20000;
+  bench_latency(samples, Io::Asio, false);
+  if(io_uring_supported()) bench_latency(samples, Io::IoUring, false);
+  bench_latency(samples, Io::Asio, true);
+  bench_rate(duration);
+  for(size_t receivers : {1, 4, 16, 64, 256})
+  {
+    for(Io io : {Io::Asio, Io::Sendmmsg, Io::IoUring})
+    {
+      if(io != Io::IoUring || io_uring_supported()) bench_fanout(receivers, io, duration);
+    }
+  }
+  for(size_t receivers : {1, 16, 256}) bench_async(receivers, duration);
+  return 0;
+}
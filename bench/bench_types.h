@@ -0,0 +1,84 @@
+#pragma once
+#include <boost/serialization/array.hpp>
+#include <boost/serialization/vector.hpp>
+#include <Schema.h>
+#include <array>
+#include <type_traits>
+#include <vector>
+
+// Representative published types shared by the benchmarks
+namespace bench
+{
+
+// Typical robot state: a few joint vectors and a couple of scalars
+struct RobotState
+{
+  double time = 0;
+  int mode = 0;
+  std::vector<double> q, dq, tau;
+
+  template<class Archive>
+  void serialize(Archive & ar, const unsigned int)
+  {
+    ar & time;
+    ar & mode;
+    ar & q;
+    ar & dq;
+    ar & tau;
+  }
+};
+
+// Same content with fixed size arrays, trivially copyable
+struct FixedRobotState
+{
+  double time = 0;
+  int mode = 0;
+  std::array<double, 32> q{}, dq{}, tau{};
+
+  template<class Archive>
+  void serialize(Archive & ar, const unsigned int)
+  {
+    ar & time;
+    ar & mode;
+    ar & q;
+    ar & dq;
+    ar & tau;
+  }
+};
+
+} // namespace bench
+
+// Wire layout of FixedRobotState for SchemaCodec
+template<>
+struct UDPDataLink::Schema<bench::FixedRobotState>
+{
+  static constexpr auto fields = std::make_tuple(&bench::FixedRobotState::time,
+                                                 &bench::FixedRobotState::mode,
+                                                 &bench::FixedRobotState::q,
+                                                 &bench::FixedRobotState::dq,
+                                                 &bench::FixedRobotState::tau);
+};
+
+namespace bench
+{
+
+template<typename State>
+void fill(State & state)
+{
+  state.time = 12.345678;
+  state.mode = 3;
+  if constexpr(std::is_same<State, RobotState>::value)
+  {
+    state.q.resize(32);
+    state.dq.resize(32);
+    state.tau.resize(32);
+  }
+  for(size_t i = 0; i < state.q.size(); ++i)
+  {
+    state.q[i] = 0.1 * static_cast<double>(i) + 1e-7;
+    state.dq[i] = -0.01 * static_cast<double>(i);
+    state.tau[i] = 3.14159 * static_cast<double>(i);
+  }
+}
+
+} // namespace bench
@@ -0,0 +1,97 @@
+#include "bench_types.h"
+#include <Codec.h>
+#include <Delta.h>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+using namespace UDPDataLink;
+using namespace bench;
+
+namespace
+{
+
+template<typename Codec, typename State>
+void run(const char * type_name, size_t iterations)
+{
+  using clock = std::chrono::steady_clock;
+  State in, out;
+  fill(in);
+  std::vector<uint8_t> buffer;
+  Codec::encode(in, buffer);
+
+  auto start = clock::now();
+  for(size_t i = 0; i < iterations; ++i)
+  {
+    in.time += 1e-3;
+    Codec::encode(in, buffer);
+  }
+  const double encode_ns = std::chrono::duration<double, std::nano>(clock::now() - start).count() / iterations;
+
+  bool ok = true;
+  start = clock::now();
+  for(size_t i = 0; i < iterations; ++i) { ok &= Codec::decode(buffer.data(), buffer.size(), out); }
+  const double decode_ns = std::chrono::duration<double, std::nano>(clock::now() - start).count() / iterations;
+
+  std::printf("%-16s %-12s %10zu %12.1f %12.1f %s\n", type_name, Codec::name, buffer.size(), encode_ns, decode_ns,
+              ok ? "" : "DECODE FAILED");
+}
+
+// Successive states where the time and a few joints change, sent as deltas against keyframes
+template<typename Codec, typename State>
+void run_delta(const char * type_name, size_t iterations)
+{
+  using clock = std::chrono::steady_clock;
+  State in, out;
+  fill(in);
+  std::vector<uint8_t> encoded, buffer;
+  std::vector<std::vector<uint8_t>> messages(iterations);
+  DeltaEncoder encoder;
+  size_t bytes = 0;
+
+  auto start = clock::now();
+  for(size_t i = 0; i < iterations; ++i)
+  {
+    in.time += 1e-3;
+    in.q[i % 4] += 1e-3;
+    Codec::encode(in, encoded);
+    encoder.encode(encoded.data(), encoded.size(), messages[i]);
+    bytes += messages[i].size();
+  }
+  const double encode_ns = std::chrono::duration<double, std::nano>(clock::now() - start).count() / iterations;
+
+  DeltaDecoder decoder;
+  bool ok = true;
+  start = clock::now();
+  for(size_t i = 0; i < iterations; ++i)
+  {
+    const uint8_t * message = nullptr;
+    size_t size = 0;
+    ok &= decoder.decode(messages[i].data(), messages[i].size(), message, size) == DeltaDecoder::Status::Ok;
+    ok &= Codec::decode(message, size, out);
+  }
+  const double decode_ns = std::chrono::duration<double, std::nano>(clock::now() - start).count() / iterations;
+  ok &= out.time == in.time && out.q == in.q;
+
+  const std::string codec_name = std::string(Codec::name) + "+delta";
+  std::printf("%-16s %-12s %10zu %12.1f %12.1f %s\n", type_name, codec_name.c_str(), bytes / iterations, encode_ns,
+              decode_ns, ok ? "" : "DECODE FAILED");
+}
+
+} // namespace
+
+int main(int argc, char ** argv)
+{
+  const size_t iterations = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 100000;
+  std::printf("%-16s %-12s %10s %12s %12s\n", "type", "codec", "bytes/msg", "encode ns", "decode ns");
+  run<BoostTextCodec<RobotState>, RobotState>("RobotState", iterations / 10);
+  run<BinaryCodec<RobotState>, RobotState>("RobotState", iterations);
+  run<BoostTextCodec<FixedRobotState>, FixedRobotState>("FixedRobotState", iterations / 10);
+  run<BinaryCodec<FixedRobotState>, FixedRobotState>("FixedRobotState", iterations);
+  run<MemcpyCodec<FixedRobotState>, FixedRobotState>("FixedRobotState", iterations);
+  run<SchemaCodec<FixedRobotState>, FixedRobotState>("FixedRobotState", iterations);
+  run_delta<BinaryCodec<RobotState>, RobotState>("RobotState", iterations / 10);
+  run_delta<MemcpyCodec<FixedRobotState>, FixedRobotState>("FixedRobotState", iterations / 10);
+  return 0;
+}
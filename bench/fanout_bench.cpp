@@ -0,0 +1,190 @@
+#include <udp_client.h>
+#include <udp_server.h>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <thread>
+#include <vector>
+
+using boost::asio::ip::udp;
+using clock_type = std::chrono::steady_clock;
+
+namespace
+{
+
+// How the sockets are read and written
+enum class Io
+{
+  Asio,
+  Batched,
+  IoUring
+};
+
+struct FanoutServer : public UDPServer
+{
+  using UDPServer::send_data;
+  using UDPServer::UDPServer;
+
+  void reception_callback(const uint8_t *, size_t) override {}
+};
+
+struct CountingClient : public UDPClient
+{
+  using UDPClient::UDPClient;
+
+  void reception_callback(const uint8_t *, size_t) override
+  {
+    ++received;
+  }
+
+  std::atomic<size_t> received{0};
+};
+
+// Read everything waiting on the subscriber sockets, returns the number of datagrams
+size_t drain(std::vector<std::unique_ptr<udp::socket>> & sockets)
+{
+  size_t count = 0;
+  uint8_t buffer[2048];
+  boost::system::error_code error;
+  for(auto & socket : sockets)
+  {
+    while(socket->available(error) > 0)
+    {
+      socket->receive(boost::asio::buffer(buffer), 0, error);
+      ++count;
+    }
+  }
+  return count;
+}
+
+// One server publishing to clients raw sockets, with asio, sendmmsg or an io_uring
+void run_fanout(Io io, size_t clients, size_t updates, size_t payload_size)
+{
+  const uint16_t port = 45200;
+  FanoutServer server(port);
+  const bool enabled = io == Io::IoUring ? server.set_io_uring(true) : server.set_batched_io(io == Io::Batched);
+  server.start_reception();
+
+  boost::asio::io_service io_service;
+  std::vector<std::unique_ptr<udp::socket>> sockets;
+  const udp::endpoint server_endpoint(boost::asio::ip::address_v4::loopback(), port);
+  for(size_t i = 0; i < clients; ++i)
+  {
+    sockets.emplace_back(new udp::socket(io_service, udp::endpoint(boost::asio::ip::address_v4::loopback(), 0)));
+    const uint8_t hello = 0;
+    sockets.back()->send_to(boost::asio::buffer(&hello, 1), server_endpoint);
+  }
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+  const std::vector<uint8_t> payload(payload_size, 42);
+  const auto syscalls_before = server.batched_io_syscalls();
+  size_t delivered = 0;
+  clock_type::duration elapsed{};
+  // Subscribers are drained every few updates, out of the measured time, so that their socket buffers never overflow
+  const size_t drain_period = 32;
+  for(size_t i = 0; i < updates; i += drain_period)
+  {
+    const auto start = clock_type::now();
+    for(size_t j = i; j < std::min(updates, i + drain_period); ++j) server.send_data(payload.data(), payload.size());
+    elapsed += clock_type::now() - start;
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    delivered += drain(sockets);
+  }
+  const double us_per_update = std::chrono::duration<double, std::micro>(elapsed).count() / updates;
+  const double syscalls = enabled ? static_cast<double>(server.batched_io_syscalls() - syscalls_before) / updates
+                                  : static_cast<double>(clients);
+  // The asio path conflates updates for a client whose previous send did not complete yet, only count what arrived
+  const char * mode = !enabled ? "asio" : io == Io::IoUring ? "io_uring" : "sendmmsg";
+  std::printf("%-8s %-10s %8zu %14.2f %14.1f %16.0f %10.1f%%\n", "fanout", mode, clients,
+              syscalls, us_per_update, delivered / std::chrono::duration<double>(elapsed).count(),
+              100.0 * delivered / (clients * updates));
+  server.stop_reception();
+}
+
+// One server publishing to a multicast group joined by the clients on the loopback interface
+void run_multicast(size_t clients, size_t updates, size_t payload_size)
+{
+  const uint16_t port = 45203, group_port = 45204;
+  const auto group = boost::asio::ip::make_address_v4("239.255.0.2");
+  FanoutServer server(port);
+  UDPDataLink::MulticastOptions options;
+  options.interface_address = "127.0.0.1";
+  server.set_multicast(group.to_string(), group_port, options);
+  server.start_reception();
+
+  boost::asio::io_service io_service;
+  std::vector<std::unique_ptr<udp::socket>> sockets;
+  for(size_t i = 0; i < clients; ++i)
+  {
+    sockets.emplace_back(new udp::socket(io_service, udp::v4()));
+    sockets.back()->set_option(udp::socket::reuse_address(true));
+    sockets.back()->bind(udp::endpoint(udp::v4(), group_port));
+    sockets.back()->set_option(
+        boost::asio::ip::multicast::join_group(group, boost::asio::ip::make_address_v4("127.0.0.1")));
+  }
+
+  const std::vector<uint8_t> payload(payload_size, 42);
+  size_t delivered = 0;
+  clock_type::duration elapsed{};
+  const size_t drain_period = 32;
+  for(size_t i = 0; i < updates; i += drain_period)
+  {
+    const auto start = clock_type::now();
+    for(size_t j = i; j < std::min(updates, i + drain_period); ++j) server.send_data(payload.data(), payload.size());
+    elapsed += clock_type::now() - start;
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    delivered += drain(sockets);
+  }
+  std::printf("%-8s %-10s %8zu %14.2f %14.1f %16.0f %10.1f%%\n", "fanout", "multicast", clients, 1.0,
+              std::chrono::duration<double, std::micro>(elapsed).count() / updates,
+              delivered / std::chrono::duration<double>(elapsed).count(), 100.0 * delivered / (clients * updates));
+  server.stop_reception();
+}
+
+// Bursts of datagrams read by one client, with asio, recvmmsg or an io_uring
+void run_burst(Io io, size_t datagrams, size_t payload_size)
+{
+  CountingClient client("127.0.0.1", 45201, 45202);
+  const bool enabled = io == Io::IoUring ? client.set_io_uring(true) : client.set_batched_io(io == Io::Batched);
+  client.start_reception();
+
+  boost::asio::io_service io_service;
+  udp::socket socket(io_service, udp::endpoint(udp::v4(), 0));
+  const udp::endpoint destination(boost::asio::ip::address_v4::loopback(), 45202);
+  const std::vector<uint8_t> payload(payload_size, 42);
+  const size_t burst = 64;
+  datagrams -= datagrams % burst;
+  const auto start = clock_type::now();
+  for(size_t i = 0; i < datagrams; i += burst)
+  {
+    for(size_t j = 0; j < burst; ++j) socket.send_to(boost::asio::buffer(payload), destination);
+    const auto deadline = clock_type::now() + std::chrono::milliseconds(20);
+    while(client.received < i + burst && clock_type::now() < deadline) std::this_thread::yield();
+  }
+  const auto elapsed = clock_type::now() - start;
+  const double syscalls =
+      enabled ? static_cast<double>(client.batched_io_syscalls()) / client.received : 1.0; // one recvfrom each
+  const char * mode = !enabled ? "asio" : io == Io::IoUring ? "io_uring" : "recvmmsg";
+  std::printf("%-8s %-10s %8s %14.2f %14.1f %16.0f %10.1f%%\n", "burst", mode, "1", syscalls,
+              std::chrono::duration<double, std::micro>(elapsed).count() / datagrams,
+              client.received / std::chrono::duration<double>(elapsed).count(), 100.0 * client.received / datagrams);
+  client.stop_reception();
+}
+
+} // namespace
+
+int main()
+{
+  std::printf("%-8s %-10s %8s %14s %14s %16s %11s\n", "test", "mode", "clients", "syscalls/upd", "us/update",
+              "delivered/s", "delivered");
+  std::vector<Io> modes = {Io::Asio, Io::Batched};
+  if(UDPDataLink::io_uring_supported()) modes.push_back(Io::IoUring);
+  for(size_t clients : {1, 16, 64, 200})
+  {
+    for(Io io : modes) run_fanout(io, clients, 512, 256);
+    run_multicast(clients, 512, 256);
+  }
+  for(Io io : modes) run_burst(io, 20000, 256);
+  return 0;
+}
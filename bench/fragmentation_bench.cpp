@@ -0,0 +1,162 @@
+#include <udp_client.h>
+#include <udp_server.h>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <thread>
+
+using namespace UDPDataLink;
+
+namespace
+{
+
+struct CountingClient : public UDPClient
+{
+  using UDPClient::UDPClient;
+  using UDPClient::send_data;
+
+  void reception_callback(const uint8_t * buffer, size_t size) override
+  {
+    bool valid = size == expected_size;
+    for(size_t i = 0; valid && i < size; i += 4099) valid = buffer[i] == static_cast<uint8_t>(i);
+    (valid ? received : corrupted)++;
+  }
+
+  size_t expected_size = 0;
+  std::atomic<size_t> received{0};
+  std::atomic<size_t> corrupted{0};
+};
+
+struct FragmentingServer : public UDPServer
+{
+  using UDPServer::send_data;
+  using UDPServer::UDPServer;
+
+  void reception_callback(const uint8_t *, size_t) override {}
+};
+
+std::vector<uint8_t> make_message(size_t size)
+{
+  std::vector<uint8_t> message(size);
+  for(size_t i = 0; i < size; ++i) message[i] = static_cast<uint8_t>(i);
+  return message;
+}
+
+// The chunks of a message are sent back to back, the default receive buffer of the socket does not hold all the
+// chunks of the largest messages and the kernel would drop some of them besides the injected losses
+void enlarge_receive_buffer(UDPClient & client)
+{
+  LowLatencyOptions options;
+  options.receive_buffer = 4 << 20;
+  client.set_low_latency(options);
+}
+
+// Wait for counter to go past value, or for a message to be considered lost
+void wait_for(const std::atomic<size_t> & counter, size_t value)
+{
+  const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(30);
+  while(counter <= value && std::chrono::steady_clock::now() < deadline)
+    std::this_thread::sleep_for(std::chrono::microseconds(100));
+}
+
+// Send messages through UDPServer::send_data with fragmentation enabled
+void run_server(size_t size, size_t messages)
+{
+  FragmentingServer server(45100);
+  server.set_fragmentation(true);
+  server.start_reception();
+  CountingClient client("127.0.0.1", 45100, 0);
+  client.set_fragmentation(true);
+  enlarge_receive_buffer(client);
+  client.expected_size = size;
+  client.start_reception();
+  const uint8_t hello = 0;
+  client.send_data(&hello, 1);
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+  const auto message = make_message(size);
+  const auto start = std::chrono::steady_clock::now();
+  for(size_t i = 0; i < messages; ++i)
+  {
+    const size_t received = client.received;
+    server.send_data(message.data(), message.size());
+    wait_for(client.received, received);
+  }
+  const double us =
+      std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / messages;
+  std::printf("%-10s %10zu %8zu %8.1f %10zu %10zu %12.1f\n", "UDPServer", size,
+              FragmentHeader::chunk_count(size, ethernet_udp_payload), 0.0, client.received.load(),
+              client.corrupted.load(), us);
+  client.stop_reception();
+  server.stop_reception();
+}
+
+// Send fragments from a raw socket, dropping each of them with the given probability
+// Returns false if a message was not received intact while all its fragments were sent, or the other way round
+bool run_loss(size_t size, size_t messages, double loss)
+{
+  boost::asio::io_service io_service;
+  boost::asio::ip::udp::socket socket(io_service, boost::asio::ip::udp::endpoint(boost::asio::ip::udp::v4(), 0));
+  CountingClient client("127.0.0.1", 45101, 45102);
+  client.set_fragmentation(true, std::chrono::milliseconds(20), size);
+  enlarge_receive_buffer(client);
+  client.expected_size = size;
+  client.start_reception();
+  const boost::asio::ip::udp::endpoint destination(boost::asio::ip::address_v4::loopback(), 45102);
+
+  std::mt19937 rng(42);
+  std::bernoulli_distribution drop(loss);
+  const auto message = make_message(size);
+  const auto chunk_size = FragmentHeader::chunk_size(ethernet_udp_payload);
+  const auto count = FragmentHeader::chunk_count(size, ethernet_udp_payload);
+  size_t intact = 0;
+  for(uint32_t id = 0; id < messages; ++id)
+  {
+    const size_t received = client.received;
+    bool lost = false;
+    for(size_t i = 0; i < count; ++i)
+    {
+      if(drop(rng))
+      {
+        lost = true;
+        continue;
+      }
+      FragmentHeader header;
+      header.message_id = id;
+      header.index = static_cast<uint16_t>(i);
+      header.count = static_cast<uint16_t>(count);
+      header.total_size = static_cast<uint32_t>(size);
+      const auto header_bytes = header.bytes();
+      const auto offset = i * chunk_size;
+      const std::array<boost::asio::const_buffer, 2> datagram = {
+          boost::asio::buffer(header_bytes),
+          boost::asio::buffer(message.data() + offset, std::min(chunk_size, size - offset))};
+      socket.send_to(datagram, destination);
+    }
+    intact += !lost;
+    // Leave the receiver time to drain its socket so that no datagram is lost besides the injected ones
+    if(!lost) wait_for(client.received, received);
+    else std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  const bool expected = client.received == intact && client.corrupted == 0;
+  std::printf("%-10s %10zu %8zu %8.1f %10zu %10zu %12s (expected %zu)%s\n", "loss", size, count, loss * 100,
+              client.received.load(), client.corrupted.load(), "-", intact, expected ? "" : " MISMATCH");
+  client.stop_reception();
+  return expected;
+}
+
+} // namespace
+
+int main()
+{
+  std::printf("%-10s %10s %8s %8s %10s %10s %12s\n", "sender", "bytes", "chunks", "loss %", "received", "corrupted",
+              "us/msg");
+  for(size_t size : {1000, 16000, 100000}) run_server(size, 100);
+  size_t mismatches = 0;
+  for(double loss : {0.0, 0.01, 0.05})
+  {
+    for(size_t size : {1000, 16000, 100000}) mismatches += !run_loss(size, 100, loss);
+  }
+  return mismatches == 0 ? 0 : 1;
+}
@@ -0,0 +1,80 @@
+#include "bench_types.h"
+#include <Publisher.h>
+#include <Receiver.h>
+#include <recording.h>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <thread>
+
+// Decode a recording offline: record loopback traffic first, or give the path of a recording made in production
+// along with the type it contains (FixedRobotState here)
+
+using namespace UDPDataLink;
+using bench::FixedRobotState;
+
+namespace
+{
+
+// Record the updates a Receiver gets from a Publisher at rate Hz for duration
+void record(const std::string & path, double rate, std::chrono::milliseconds duration)
+{
+  Publisher<FixedRobotState> publisher(45300);
+  publisher.start_reception();
+  Receiver<FixedRobotState> receiver("127.0.0.1", 45300, 0);
+  receiver.set_recorder(std::make_shared<Recorder>(path));
+  receiver.start_reception();
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+  FixedRobotState state;
+  bench::fill(state);
+  const auto period = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+      std::chrono::duration<double>(1 / rate));
+  const auto start = std::chrono::steady_clock::now();
+  for(auto next = start; next < start + duration; next += period)
+  {
+    std::this_thread::sleep_until(next);
+    state.time += 1e-3;
+    publisher.update_data(state);
+  }
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  receiver.stop_reception();
+  publisher.stop_reception();
+  // Closing the recorder truncates the file to the recorded datagrams
+  receiver.set_recorder(nullptr);
+}
+
+void replay(Replayer & replayer, double speed)
+{
+  Receiver<FixedRobotState> receiver;
+  const auto start = std::chrono::steady_clock::now();
+  const auto played = replayer.play([&](const uint8_t * datagram, size_t size, int64_t receive_time)
+                                    { receiver.replay_datagram(datagram, size, receive_time); },
+                                    speed);
+  const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  std::printf("%-8g %10llu %10llu %12.3f %14.0f %10.1f\n", speed, static_cast<unsigned long long>(played),
+              static_cast<unsigned long long>(receiver.sequence()), seconds, played / seconds,
+              seconds * 1e9 / played);
+}
+
+} // namespace
+
+int main(int argc, char ** argv)
+{
+  std::string path = argc > 1 ? argv[1] : "udpdatalink_replay_bench.rec";
+  if(argc <= 1)
+  {
+    std::printf("Recording 1 s of updates at 1 kHz to %s\n", path.c_str());
+    record(path, 1000, std::chrono::seconds(1));
+  }
+  Replayer replayer(path);
+  std::printf("%-8s %10s %10s %12s %14s %10s\n", "speed", "datagrams", "decoded", "seconds", "datagrams/s",
+              "ns/each");
+  replay(replayer, 1);
+  replay(replayer, 10);
+  replay(replayer, 0);
+  if(argc <= 1) std::remove(path.c_str());
+  return 0;
+}
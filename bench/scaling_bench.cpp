@@ -0,0 +1,114 @@
+#include <udp_server.h>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <memory>
+#include <thread>
+
+using boost::asio::ip::udp;
+using clock_type = std::chrono::steady_clock;
+
+namespace
+{
+
+struct ShardedServer : public UDPServer
+{
+  using UDPServer::send_data;
+  using UDPServer::UDPServer;
+
+  void reception_callback(const uint8_t *, size_t) override {}
+};
+
+// Subscribers reading their sockets on a thread of their own
+struct Subscribers
+{
+  Subscribers(size_t count, const udp::endpoint & server)
+  {
+    for(size_t i = 0; i < count; ++i)
+    {
+      sockets.emplace_back(new udp::socket(io_service, udp::endpoint(boost::asio::ip::address_v4::loopback(), 0)));
+      const uint8_t hello = 0;
+      sockets.back()->send_to(boost::asio::buffer(&hello, 1), server);
+      buffers.emplace_back(2048);
+      read(i);
+    }
+    thread = std::thread([this] { io_service.run(); });
+  }
+
+  ~Subscribers()
+  {
+    io_service.stop();
+    thread.join();
+  }
+
+  void read(size_t i)
+  {
+    sockets[i]->async_receive(boost::asio::buffer(buffers[i]), [this, i](auto error, auto)
+                              {
+                                if(error) return;
+                                ++received;
+                                read(i);
+                              });
+  }
+
+  boost::asio::io_service io_service;
+  std::vector<std::unique_ptr<udp::socket>> sockets;
+  std::vector<std::vector<uint8_t>> buffers;
+  std::atomic<size_t> received{0};
+  std::thread thread;
+};
+
+void run(size_t shards, size_t clients, double rate, bool batched)
+{
+  const uint16_t port = 45300;
+  ShardedServer server(port);
+  server.set_shards(shards);
+  server.set_batched_io(batched);
+  server.start_reception();
+  Subscribers subscribers(clients, udp::endpoint(boost::asio::ip::address_v4::loopback(), port));
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+  const std::vector<uint8_t> payload(256, 42);
+  const auto period = std::chrono::duration_cast<clock_type::duration>(std::chrono::duration<double>(1.0 / rate));
+  const auto duration = std::chrono::milliseconds(300);
+  const auto cpu_start = std::clock();
+  const auto start = clock_type::now();
+  auto next = start;
+  size_t updates = 0;
+  clock_type::duration publish_time{};
+  while(clock_type::now() - start < duration)
+  {
+    const auto before = clock_type::now();
+    server.send_data(payload.data(), payload.size());
+    publish_time += clock_type::now() - before;
+    ++updates;
+    next += period;
+    while(clock_type::now() < next) std::this_thread::yield();
+  }
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  const double cpu_ms = 1000.0 * static_cast<double>(std::clock() - cpu_start) / CLOCKS_PER_SEC;
+  const double seconds = std::chrono::duration<double>(clock_type::now() - start).count();
+  std::printf("%6zu %-9s %8zu %10.0f %12.0f %10.1f%% %14.2f %12.1f\n", shards, batched ? "sendmmsg" : "asio",
+              clients, updates / seconds, subscribers.received / seconds,
+              100.0 * subscribers.received / (updates * clients),
+              std::chrono::duration<double, std::micro>(publish_time).count() / updates, cpu_ms);
+  server.stop_reception();
+}
+
+} // namespace
+
+int main()
+{
+  std::printf("# %u hardware threads\n", std::thread::hardware_concurrency());
+  std::printf("%6s %-9s %8s %10s %12s %11s %14s %12s\n", "shards", "mode", "clients", "updates/s", "delivered/s",
+              "delivered", "us/send_data", "cpu ms");
+  for(size_t shards : {1, 2, 4})
+  {
+    for(size_t clients : {16, 64, 256})
+    {
+      for(double rate : {1000.0, 10000.0}) run(shards, clients, rate, true);
+    }
+  }
+  return 0;
+}
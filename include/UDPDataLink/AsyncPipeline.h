@@ -0,0 +1,244 @@
+/**
+ * @file AsyncPipeline.h
+ * @brief hand objects over to a sender thread without blocking the producer
+ */
+#pragma once
+#include "LatestValue.h"
+#include "LinkStats.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace UDPDataLink
+{
+
+/**
+ * @brief Bounded single producer, single consumer ring of preallocated slots
+ * @details Objects are copied or moved into slots allocated once, pushing and popping never allocate when T reuses its
+ * own storage on assignment.
+ */
+template<typename T>
+class SpscRing
+{
+public:
+  explicit SpscRing(size_t capacity) : slots_(std::max<size_t>(capacity, 1) + 1) {}
+
+  /** @return the slot to fill before calling push(), or nullptr if the ring is full */
+  T * back() noexcept
+  {
+    const auto tail = tail_.load(std::memory_order_relaxed);
+    return next(tail) == head_.load(std::memory_order_acquire) ? nullptr : &slots_[tail];
+  }
+
+  /** @brief hand the slot returned by back() over to the consumer */
+  void push() noexcept
+  {
+    tail_.store(next(tail_.load(std::memory_order_relaxed)), std::memory_order_release);
+  }
+
+  /** @return the oldest object, or nullptr if the ring is empty. It stays valid until pop() is called. */
+  T * front() noexcept
+  {
+    const auto head = head_.load(std::memory_order_relaxed);
+    return head == tail_.load(std::memory_order_acquire) ? nullptr : &slots_[head];
+  }
+
+  void pop() noexcept
+  {
+    head_.store(next(head_.load(std::memory_order_relaxed)), std::memory_order_release);
+  }
+
+  /** @brief number of objects in the ring, approximate when called concurrently with push or pop */
+  size_t size() const noexcept
+  {
+    const auto head = head_.load(std::memory_order_acquire);
+    const auto tail = tail_.load(std::memory_order_acquire);
+    return tail >= head ? tail - head : tail + slots_.size() - head;
+  }
+
+  size_t capacity() const noexcept
+  {
+    return slots_.size() - 1;
+  }
+
+private:
+  size_t next(size_t index) const noexcept
+  {
+    return index + 1 == slots_.size() ? 0 : index + 1;
+  }
+
+  std::vector<T> slots_;
+  alignas(64) std::atomic<size_t> head_{0};
+  alignas(64) std::atomic<size_t> tail_{0};
+};
+
+struct AsyncStats
+{
+  /** objects pushed by the producer */
+  uint64_t enqueued = 0;
+  /** objects written to the overflow slot because the ring was full */
+  uint64_t overflowed = 0;
+  /** overflowed objects replaced by a newer one before being sent */
+  uint64_t conflated = 0;
+  uint64_t sent = 0;
+  /** objects waiting to be sent when the stats were taken */
+  size_t depth = 0;
+  size_t max_depth = 0;
+  /** time between push() and the object being handed over to the sockets */
+  LatencyHistogram latency;
+};
+
+/**
+ * @brief Objects pushed by one producer thread, consumed in order by a dedicated sender thread
+ * @details push() never blocks, never allocates once the slots are filled, and never makes a system call. When the
+ * ring is full, the newest object goes to an overflow slot holding only the latest one, sent after everything queued
+ * before it. The sender thread polls the ring, sleeping for at most idle_sleep when it is empty. The destructor waits
+ * for every object pushed before it to be sent.
+ */
+template<typename T>
+class AsyncPipeline
+{
+public:
+  using Sink = std::function<void(const T &)>;
+
+  /**
+   * @param [in] capacity number of objects the ring holds
+   * @param [in] sink called on the sender thread with each object, in order
+   * @param [in] idle_sleep longest time the sender thread sleeps before looking at the ring again
+   */
+  AsyncPipeline(size_t capacity,
+                Sink sink,
+                std::chrono::microseconds idle_sleep = std::chrono::microseconds(50))
+  : ring_(capacity), sink_(std::move(sink)), idle_sleep_(idle_sleep)
+  {
+    thread_ = std::thread([this] { run(); });
+  }
+
+  ~AsyncPipeline()
+  {
+    stop_.store(true, std::memory_order_release);
+    thread_.join();
+  }
+
+  /** @return false if the ring was full and the object went to the overflow slot */
+  template<typename U>
+  bool push(U && value)
+  {
+    ++enqueued_;
+    const auto now = std::chrono::steady_clock::now();
+    // Once overflowing, keep using the overflow slot until the sender empties it so that objects stay in order
+    if(auto * slot = overflowing_.load(std::memory_order_acquire) != 0 ? nullptr : ring_.back())
+    {
+      slot->value = std::forward<U>(value);
+      slot->enqueued = now;
+      ring_.push();
+      return true;
+    }
+    auto & slot = overflow_.write_buffer();
+    slot.value = std::forward<U>(value);
+    slot.enqueued = now;
+    overflow_.publish();
+    overflowing_.store(overflow_.sequence(), std::memory_order_release);
+    ++overflowed_;
+    return false;
+  }
+
+  /** @brief counters of the pipeline, callable from any thread */
+  AsyncStats stats() const
+  {
+    AsyncStats stats;
+    {
+      std::lock_guard<std::mutex> lock(latency_mutex_);
+      stats.latency = latency_;
+    }
+    stats.enqueued = enqueued_;
+    stats.overflowed = overflowed_;
+    stats.sent = sent_;
+    stats.conflated = stats.overflowed - std::min(stats.overflowed, overflow_sent_.load());
+    stats.depth = ring_.size() + (overflowing_ != 0 ? 1 : 0);
+    stats.max_depth = max_depth_;
+    return stats;
+  }
+
+private:
+  struct Item
+  {
+    T value;
+    std::chrono::steady_clock::time_point enqueued;
+  };
+
+  void send(const Item & item)
+  {
+    sink_(item.value);
+    ++sent_;
+    const auto latency = std::chrono::steady_clock::now() - item.enqueued;
+    std::lock_guard<std::mutex> lock(latency_mutex_);
+    latency_.add(std::chrono::duration_cast<std::chrono::nanoseconds>(latency).count());
+  }
+
+  void run()
+  {
+    auto sleep = std::chrono::microseconds(1);
+    uint64_t overflow_sequence = 0;
+    while(true)
+    {
+      // Read before looking at the ring, so that the objects pushed before the destructor are all seen
+      const bool stopping = stop_.load(std::memory_order_acquire);
+      bool idle = true;
+      max_depth_ = std::max(max_depth_.load(std::memory_order_relaxed), ring_.size());
+      while(auto * item = ring_.front())
+      {
+        send(*item);
+        ring_.pop();
+        idle = false;
+      }
+      if(overflowing_.load(std::memory_order_acquire) != 0)
+      {
+        uint64_t sequence = 0;
+        if(overflow_.read(overflow_item_, sequence) && sequence != overflow_sequence)
+        {
+          overflow_sequence = sequence;
+          send(overflow_item_);
+          ++overflow_sent_;
+        }
+        // Only once the latest overflowed object is sent may the producer go back to the ring. A newer one published
+        // meanwhile keeps the flag set and is sent on the next turn
+        auto expected = overflow_sequence;
+        overflowing_.compare_exchange_strong(expected, 0, std::memory_order_acq_rel);
+        idle = false;
+      }
+      if(!idle)
+      {
+        sleep = std::chrono::microseconds(1);
+        continue;
+      }
+      if(stopping) break;
+      std::this_thread::sleep_for(sleep);
+      sleep = std::min(sleep * 2, idle_sleep_);
+    }
+  }
+
+  SpscRing<Item> ring_;
+  LatestValue<Item> overflow_;
+  Item overflow_item_;
+  // Sequence of the latest object written to overflow_ and not sent yet, 0 if none
+  std::atomic<uint64_t> overflowing_{0};
+  Sink sink_;
+  std::chrono::microseconds idle_sleep_;
+  std::atomic<bool> stop_{false};
+  std::atomic<uint64_t> enqueued_{0};
+  std::atomic<uint64_t> overflowed_{0};
+  std::atomic<uint64_t> overflow_sent_{0};
+  std::atomic<uint64_t> sent_{0};
+  std::atomic<size_t> max_depth_{0};
+  mutable std::mutex latency_mutex_;
+  LatencyHistogram latency_;
+  std::thread thread_;
+};
+
+} // namespace UDPDataLink
@@ -0,0 +1,371 @@
+#pragma once
+#include <boost/mpl/bool.hpp>
+#include <boost/serialization/array_wrapper.hpp>
+#include <boost/serialization/nvp.hpp>
+#include <boost/serialization/serialization.hpp>
+#include <boost/serialization/version.hpp>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace UDPDataLink
+{
+
+/**
+ * @brief Compact binary output archive writing into a caller-provided buffer
+ * @details The archive is compatible with the serialize() functions written for boost: arithmetic and enum values are
+ * written as raw bytes in host order, strings, vectors and maps as a 32 bits element count followed by the elements.
+ * The buffer is cleared but keeps its capacity, so encoding into the same buffer does not allocate once it is warm.
+ */
+class BinaryOArchive
+{
+public:
+  using is_saving = boost::mpl::true_;
+  using is_loading = boost::mpl::false_;
+
+  /** @param [in] append if true the values are written after the content of buffer instead of replacing it */
+  explicit BinaryOArchive(std::vector<uint8_t> & buffer, bool append = false) : buffer_(buffer)
+  {
+    if(!append) buffer_.clear();
+  }
+
+  template<typename U>
+  BinaryOArchive & operator<<(const U & value)
+  {
+    save(value);
+    return *this;
+  }
+
+  template<typename U>
+  BinaryOArchive & operator&(const U & value)
+  {
+    return *this << value;
+  }
+
+  unsigned int get_library_version() const noexcept
+  {
+    return 0;
+  }
+
+  void save_binary(const void * address, size_t size)
+  {
+    const auto offset = buffer_.size();
+    buffer_.resize(offset + size);
+    if(size) std::memcpy(buffer_.data() + offset, address, size);
+  }
+
+private:
+  template<typename U>
+  void save(const U & value)
+  {
+    static_assert(!std::is_pointer<U>::value, "BinaryOArchive does not serialize pointers");
+    if constexpr(std::is_arithmetic<U>::value || std::is_enum<U>::value) { save_binary(&value, sizeof(U)); }
+    else
+    {
+      boost::serialization::serialize_adl(*this, const_cast<U &>(value), boost::serialization::version<U>::value);
+    }
+  }
+
+  void save_size(size_t size)
+  {
+    const auto count = static_cast<uint32_t>(size);
+    save_binary(&count, sizeof(count));
+  }
+
+  void save(const std::string & value)
+  {
+    save_size(value.size());
+    save_binary(value.data(), value.size());
+  }
+
+  template<typename U, typename Alloc>
+  void save(const std::vector<U, Alloc> & value)
+  {
+    save_size(value.size());
+    if constexpr(std::is_arithmetic<U>::value) { save_binary(value.data(), value.size() * sizeof(U)); }
+    else
+    {
+      for(const auto & item : value) save(item);
+    }
+  }
+
+  template<typename Alloc>
+  void save(const std::vector<bool, Alloc> & value)
+  {
+    save_size(value.size());
+    for(bool item : value) save(static_cast<uint8_t>(item));
+  }
+
+  template<typename U, size_t N>
+  void save(const std::array<U, N> & value)
+  {
+    if constexpr(std::is_arithmetic<U>::value) { save_binary(value.data(), N * sizeof(U)); }
+    else
+    {
+      for(const auto & item : value) save(item);
+    }
+  }
+
+  template<typename K, typename V, typename Compare, typename Alloc>
+  void save(const std::map<K, V, Compare, Alloc> & value)
+  {
+    save_size(value.size());
+    for(const auto & item : value)
+    {
+      save(item.first);
+      save(item.second);
+    }
+  }
+
+  template<typename A, typename B>
+  void save(const std::pair<A, B> & value)
+  {
+    save(value.first);
+    save(value.second);
+  }
+
+  template<typename U>
+  void save(const boost::serialization::nvp<U> & value)
+  {
+    save(value.const_value());
+  }
+
+  template<typename U>
+  void save(const boost::serialization::array_wrapper<U> & value)
+  {
+    if constexpr(std::is_arithmetic<U>::value) { save_binary(value.address(), value.count() * sizeof(U)); }
+    else
+    {
+      for(size_t i = 0; i < value.count(); ++i) save(value.address()[i]);
+    }
+  }
+
+  std::vector<uint8_t> & buffer_;
+};
+
+namespace detail
+{
+
+/**
+ * @brief fewest bytes BinaryOArchive writes for a U, at least 1
+ * @details bounds the element counts read by BinaryIArchive with the bytes left, so that a corrupt count fails the
+ * archive instead of allocating. Types written as nothing, such as empty classes, cannot be loaded in containers.
+ */
+template<typename U>
+struct min_archived_size
+{
+  static constexpr size_t value = std::is_arithmetic<U>::value || std::is_enum<U>::value ? sizeof(U) : 1;
+};
+
+template<typename C, typename Traits, typename Alloc>
+struct min_archived_size<std::basic_string<C, Traits, Alloc>>
+{
+  static constexpr size_t value = sizeof(uint32_t);
+};
+
+template<typename U, typename Alloc>
+struct min_archived_size<std::vector<U, Alloc>>
+{
+  static constexpr size_t value = sizeof(uint32_t);
+};
+
+template<typename K, typename V, typename Compare, typename Alloc>
+struct min_archived_size<std::map<K, V, Compare, Alloc>>
+{
+  static constexpr size_t value = sizeof(uint32_t);
+};
+
+template<typename U, size_t N>
+struct min_archived_size<std::array<U, N>>
+{
+  static constexpr size_t value = N != 0 ? N * min_archived_size<U>::value : 1;
+};
+
+template<typename A, typename B>
+struct min_archived_size<std::pair<A, B>>
+{
+  static constexpr size_t value = min_archived_size<A>::value + min_archived_size<B>::value;
+};
+
+} // namespace detail
+
+/**
+ * @brief Binary input archive reading what BinaryOArchive wrote
+ * @details Reads are bounds checked: a truncated or malformed buffer does not throw but sets the archive in a failed
+ * state, check it with ok() once loading is done.
+ */
+class BinaryIArchive
+{
+public:
+  using is_saving = boost::mpl::false_;
+  using is_loading = boost::mpl::true_;
+
+  BinaryIArchive(const uint8_t * buffer, size_t size) : buffer_(buffer), size_(size) {}
+
+  template<typename U>
+  BinaryIArchive & operator>>(U & value)
+  {
+    load(value);
+    return *this;
+  }
+
+  template<typename U>
+  BinaryIArchive & operator&(U & value)
+  {
+    return *this >> value;
+  }
+
+  template<typename U>
+  BinaryIArchive & operator&(const boost::serialization::nvp<U> & value)
+  {
+    load(value.value());
+    return *this;
+  }
+
+  template<typename U>
+  BinaryIArchive & operator&(const boost::serialization::array_wrapper<U> & value)
+  {
+    load_array(value.address(), value.count());
+    return *this;
+  }
+
+  unsigned int get_library_version() const noexcept
+  {
+    return 0;
+  }
+
+  void load_binary(void * address, size_t size)
+  {
+    if(!ok_ || size > size_ - offset_)
+    {
+      ok_ = false;
+      return;
+    }
+    if(size) std::memcpy(address, buffer_ + offset_, size);
+    offset_ += size;
+  }
+
+  /** @brief true if every read so far was within the buffer */
+  bool ok() const noexcept
+  {
+    return ok_;
+  }
+
+  /** @brief number of bytes consumed so far */
+  size_t consumed() const noexcept
+  {
+    return offset_;
+  }
+
+private:
+  template<typename U>
+  void load(U & value)
+  {
+    static_assert(!std::is_pointer<U>::value, "BinaryIArchive does not deserialize pointers");
+    if constexpr(std::is_arithmetic<U>::value || std::is_enum<U>::value) { load_binary(&value, sizeof(U)); }
+    else
+    {
+      boost::serialization::serialize_adl(*this, value, boost::serialization::version<U>::value);
+    }
+  }
+
+  bool load_size(size_t & size, size_t min_element_size)
+  {
+    uint32_t count = 0;
+    load_binary(&count, sizeof(count));
+    // Reject counts that cannot fit in what is left before resizing anything
+    if(!ok_ || count > (size_ - offset_) / min_element_size)
+    {
+      ok_ = false;
+      return false;
+    }
+    size = count;
+    return true;
+  }
+
+  void load(std::string & value)
+  {
+    size_t size = 0;
+    if(!load_size(size, 1)) return;
+    value.assign(reinterpret_cast<const char *>(buffer_ + offset_), size);
+    offset_ += size;
+  }
+
+  template<typename U, typename Alloc>
+  void load(std::vector<U, Alloc> & value)
+  {
+    size_t size = 0;
+    if(!load_size(size, detail::min_archived_size<U>::value)) return;
+    value.resize(size);
+    load_array(value.data(), size);
+  }
+
+  template<typename Alloc>
+  void load(std::vector<bool, Alloc> & value)
+  {
+    size_t size = 0;
+    if(!load_size(size, 1)) return;
+    value.resize(size);
+    for(size_t i = 0; i < size; ++i)
+    {
+      uint8_t item = 0;
+      load(item);
+      value[i] = item != 0;
+    }
+  }
+
+  template<typename U, size_t N>
+  void load(std::array<U, N> & value)
+  {
+    load_array(value.data(), N);
+  }
+
+  template<typename K, typename V, typename Compare, typename Alloc>
+  void load(std::map<K, V, Compare, Alloc> & value)
+  {
+    size_t size = 0;
+    if(!load_size(size, detail::min_archived_size<std::pair<K, V>>::value)) return;
+    value.clear();
+    for(size_t i = 0; i < size && ok_; ++i)
+    {
+      std::pair<K, V> item;
+      load(item);
+      value.insert(value.end(), std::move(item));
+    }
+  }
+
+  template<typename A, typename B>
+  void load(std::pair<A, B> & value)
+  {
+    load(value.first);
+    load(value.second);
+  }
+
+  template<typename U>
+  void load(boost::serialization::nvp<U> & value)
+  {
+    load(value.value());
+  }
+
+  template<typename U>
+  void load_array(U * address, size_t count)
+  {
+    if constexpr(std::is_arithmetic<U>::value) { load_binary(address, count * sizeof(U)); }
+    else
+    {
+      for(size_t i = 0; i < count && ok_; ++i) load(address[i]);
+    }
+  }
+
+  const uint8_t * buffer_;
+  size_t size_;
+  size_t offset_ = 0;
+  bool ok_ = true;
+};
+
+} // namespace UDPDataLink
@@ -0,0 +1,590 @@
+/**
+ * @file Channel.h
+ * @brief encoding and decoding of the updates of one stream, independently of the transport carrying them
+ */
+#pragma once
+#include "AsyncPipeline.h"
+#include "Checksum.h"
+#include "Codec.h"
+#include "Delta.h"
+#include "History.h"
+#include "LatestValue.h"
+#include "LinkStats.h"
+#include "MessageHeader.h"
+#include "shared_buffer.h"
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <random>
+
+// The library is built as C++17, ChannelReader::next() is only declared to the code compiled with coroutines
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+#  include <coroutine>
+#  define UDPDATALINK_COROUTINES
+#endif
+
+namespace UDPDataLink
+{
+
+/**
+ * @brief Part of a ChannelWriter that does not depend on the type written
+ */
+class ChannelWriterBase
+{
+public:
+  explicit ChannelWriterBase(TopicId topic) : topic_(topic) {}
+
+  virtual ~ChannelWriterBase() = default;
+
+  TopicId topic() const noexcept
+  {
+    return topic_;
+  }
+
+  /** @brief fingerprint of the encoding of the updates, see type_fingerprint() */
+  virtual uint32_t fingerprint() const noexcept = 0;
+
+  /**
+   * @brief largest update, header included, known when the codec declares max_encoded_size
+   * @return 0 if the size of the updates is not bounded
+   */
+  virtual size_t max_update_size() const noexcept = 0;
+
+  /** @brief make the next update a keyframe when delta is enabled, callable from any thread */
+  void request_keyframe() noexcept
+  {
+    keyframe_requested_ = true;
+  }
+
+protected:
+  TopicId topic_;
+  std::atomic<bool> keyframe_requested_{false};
+};
+
+/**
+ * @brief Turn objects of type T into updates: a MessageHeader followed by the encoded object or its delta
+ * @details write() must always be called from the same thread. Derived classes send the updates in send_update(), and
+ * must call stop_async() in their destructor since the sender thread may be calling it.
+ */
+template<typename T, typename Codec = DefaultCodec<T>>
+class ChannelWriter : public ChannelWriterBase
+{
+public:
+  explicit ChannelWriter(TopicId topic = 0) : ChannelWriterBase(topic), epoch_(make_epoch())
+  {
+    delta_encoder_.set_epoch(epoch_);
+    // Codecs with a bounded size get buffers large enough for any update from the start
+    if constexpr(has_max_encoded_size<Codec>::value)
+    {
+      buffers_.note_size(MessageHeader::size + max_delta_size(Codec::max_encoded_size));
+    }
+  }
+
+  virtual ~ChannelWriter() = default;
+
+  uint32_t fingerprint() const noexcept override
+  {
+    return type_fingerprint<T, Codec>();
+  }
+
+  size_t max_update_size() const noexcept override
+  {
+    if constexpr(has_max_encoded_size<Codec>::value)
+    {
+      return MessageHeader::size + (delta_ ? max_delta_size(Codec::max_encoded_size) : Codec::max_encoded_size);
+    }
+    return 0;
+  }
+
+  /**
+   * @brief send the difference with the last keyframe instead of the whole object, see Delta.h
+   * @details the receiving end must enable it as well. Keyframes are also sent when a receiver misses one.
+   * @param [in] keyframe_interval a keyframe is sent every keyframe_interval updates, 0 to only send them on request
+   */
+  void set_delta(bool enabled, size_t keyframe_interval = 100)
+  {
+    delta_ = enabled;
+    delta_encoder_.set_keyframe_interval(keyframe_interval);
+    delta_encoder_.request_keyframe();
+  }
+
+  /** @brief number of updates encoded so far */
+  uint64_t sequence() const noexcept
+  {
+    return sequence_;
+  }
+
+  /**
+   * @brief write the CRC-32C of the payload in the header of each update, checked by the receivers before decoding
+   * @details enabled by default, disable it to save the time of checksumming large updates
+   */
+  void set_checksum(bool enabled) noexcept
+  {
+    checksum_ = enabled;
+  }
+
+  /**
+   * @brief allocate the buffers of the updates up front
+   * @details updates are encoded into recycled buffers, one per update still being sent. Reserving as many as the
+   * sends that can be in flight at once, one per client and per conflation key for a slow client, avoids allocating
+   * when the sockets fall behind for a moment. Must be called before publishing
+   * @param [in] count number of buffers
+   * @param [in] size bytes reserved in each buffer, the size of the largest update
+   */
+  void reserve_buffers(size_t count, size_t size)
+  {
+    buffers_.reserve(count, size);
+  }
+
+  /**
+   * @brief encode and send the updates on a dedicated thread, see AsyncPipeline
+   * @details update_data() then only copies or moves the object into a ring of capacity slots and returns, it never
+   * blocks. When the ring is full only the latest object is kept. Must be called from the thread calling update_data().
+   * The objects already queued are sent before the asynchronous mode is disabled or changed
+   */
+  void set_async(bool enabled, size_t capacity = 64)
+  {
+    stop_async();
+    if(enabled)
+    {
+      async_ = std::make_unique<AsyncPipeline<T>>(capacity, [this](const T & data) { encode_and_send(data); });
+    }
+  }
+
+  /** @brief queue depth and enqueue to send latency of the asynchronous mode, callable from any thread */
+  AsyncStats async_stats() const
+  {
+    return async_ ? async_->stats() : AsyncStats{};
+  }
+
+protected:
+  /** @param [in] keyframe true for a keyframe of delta encoding, that must not be conflated into the next deltas */
+  virtual void send_update(SharedBuffer update, bool keyframe) = 0;
+
+  template<typename U>
+  void write(U && data)
+  {
+    if(async_) { async_->push(std::forward<U>(data)); }
+    else
+    {
+      encode_and_send(data);
+    }
+  }
+
+  void stop_async()
+  {
+    async_.reset();
+  }
+
+  void encode_and_send(const T & data)
+  {
+    bool keyframe = false;
+    auto update = encode_update(data, keyframe);
+    send_update(std::move(update), keyframe);
+  }
+
+  // Encode once in a pooled buffer, every client is sent the same one
+  SharedBuffer encode_update(const T & data, bool & keyframe)
+  {
+    auto buffer = buffers_.acquire();
+    keyframe = false;
+    if(delta_)
+    {
+      if(keyframe_requested_.exchange(false)) delta_encoder_.request_keyframe();
+      Codec::encode(data, encoded_);
+      buffer->resize(MessageHeader::size);
+      keyframe = delta_encoder_.encode(encoded_.data(), encoded_.size(), *buffer);
+    }
+    else if constexpr(has_encode_append<Codec>::value)
+    {
+      buffer->resize(MessageHeader::size);
+      Codec::encode_append(data, *buffer);
+    }
+    else
+    {
+      Codec::encode(data, encoded_);
+      buffer->resize(MessageHeader::size);
+      buffer->insert(buffer->end(), encoded_.begin(), encoded_.end());
+    }
+    MessageHeader header;
+    header.topic = topic_;
+    header.epoch = epoch_;
+    header.type_id = type_fingerprint<T, Codec>();
+    header.sequence = sequence_++;
+    header.send_time = MessageHeader::now();
+    if(checksum_)
+    {
+      header.flags |= MessageHeader::checksum_flag;
+      header.checksum = crc32c(buffer->data() + MessageHeader::size, buffer->size() - MessageHeader::size);
+    }
+    header.write(buffer->data());
+    buffers_.note_size(buffer->size());
+    return SharedBuffer(std::move(buffer));
+  }
+
+  // Nonzero and different for each writer instance, so that receivers tell a restarted writer apart
+  static uint16_t make_epoch()
+  {
+    std::random_device device;
+    const auto seed = device() ^ static_cast<uint32_t>(std::chrono::steady_clock::now().time_since_epoch().count());
+    const auto epoch = static_cast<uint16_t>(seed ^ (seed >> 16));
+    return epoch != 0 ? epoch : 1;
+  }
+
+  uint16_t epoch_;
+  SharedBufferPool buffers_;
+  bool delta_ = false;
+  bool checksum_ = true;
+  DeltaEncoder delta_encoder_;
+  std::vector<uint8_t> encoded_;
+  uint64_t sequence_ = 0;
+  std::unique_ptr<AsyncPipeline<T>> async_;
+};
+
+/**
+ * @brief what became of an update, see ChannelReader::decode_stats()
+ */
+enum class DecodeStatus : uint8_t
+{
+  /** decoded, the latest value */
+  Ok,
+  /** older than the latest update or a duplicate, counted in LinkStats */
+  Stale,
+  /** too short or not starting with a MessageHeader of this version */
+  InvalidHeader,
+  /** written for another type or codec, see type_fingerprint() */
+  TypeMismatch,
+  /** the payload does not match its checksum */
+  BadChecksum,
+  /** a delta whose keyframe was not received */
+  MissingKeyframe,
+  /** rejected by the codec or the delta decoder */
+  Malformed
+};
+
+/**
+ * @brief number of updates per DecodeStatus
+ */
+struct DecodeStats
+{
+  uint64_t decoded = 0;
+  uint64_t stale = 0;
+  uint64_t invalid_header = 0;
+  uint64_t type_mismatch = 0;
+  uint64_t bad_checksum = 0;
+  uint64_t missing_keyframe = 0;
+  uint64_t malformed = 0;
+
+  /** @brief updates dropped because they were not valid */
+  uint64_t errors() const noexcept
+  {
+    return invalid_header + type_mismatch + bad_checksum + malformed;
+  }
+};
+
+/**
+ * @brief Decode the updates written by a ChannelWriter into a LatestValue
+ * @details Updates are decoded once, on the reception thread. get() copies the latest decoded object without locking
+ * and can be called from one other thread at any rate. Updates older than the latest one received are dropped, and
+ * counted with the losses and latencies in link_stats(). Updates of another type or failing their checksum are dropped
+ * before being decoded, nothing on this path throws: what became of each update is counted in decode_stats().
+ *
+ * Instead of polling get(), a consumer can be handed each object by on_data(), sleep until a new one arrives with
+ * wait_for_new() or, in C++20, co_await next().
+ */
+template<typename T, typename Codec = DefaultCodec<T>>
+class ChannelReader
+{
+public:
+  /**
+   * @brief copy the latest object received
+   * @return false if no object was received yet
+   */
+  bool get(T & data)
+  {
+    uint64_t sequence = 0;
+    return get(data, sequence);
+  }
+
+  /**
+   * @brief copy the latest object received
+   * @param [out] data the latest object received
+   * @param [out] sequence number of objects received up to this one, compare it with the one of the previous call to
+   * know if data is new
+   * @return false if no object was received yet
+   */
+  bool get(T & data, uint64_t & sequence)
+  {
+    if(!latest_.read(data, sequence)) return false;
+    last_read_ = sequence;
+    return true;
+  }
+
+  /**
+   * @brief sleep until an object newer than the one last returned by get() is received
+   * @details called from the thread calling get(), the reception thread wakes it up as soon as the object is decoded
+   * @return false if none was received within timeout
+   */
+  bool wait_for_new(std::chrono::nanoseconds timeout)
+  {
+    return latest_.wait_newer(last_read_, timeout);
+  }
+
+  /**
+   * @brief call callback with each object decoded, on the reception thread and before get() can return it
+   * @details must be called before the reception starts. callback must neither throw nor block: the next datagrams are
+   * not received until it returns
+   */
+  void on_data(std::function<void(const T &)> callback)
+  {
+    on_data_ = std::move(callback);
+  }
+
+#ifdef UDPDATALINK_COROUTINES
+  /**
+   * @brief awaitable returned by next()
+   */
+  class NextAwaiter
+  {
+  public:
+    explicit NextAwaiter(ChannelReader & reader) noexcept : reader_(reader) {}
+
+    bool await_ready() const noexcept
+    {
+      return reader_.sequence() > reader_.last_read_;
+    }
+
+    bool await_suspend(std::coroutine_handle<> handle) noexcept
+    {
+      // The awaiter lives in the coroutine frame, which is not touched once the reception thread can resume it
+      auto & reader = reader_;
+      const auto last_read = reader.last_read_;
+      reader.resume_ = [](void * address) { std::coroutine_handle<>::from_address(address).resume(); };
+      reader.awaiting_.store(handle.address(), std::memory_order_release);
+      // Orders the store of the handle before the load of the sequence, publish() does the opposite
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      if(reader.sequence() <= last_read) return true;
+      // An object arrived meanwhile: go on unless the reception thread already took the handle to resume it
+      return reader.awaiting_.exchange(nullptr, std::memory_order_acq_rel) == nullptr;
+    }
+
+    T await_resume()
+    {
+      T data{};
+      reader_.get(data);
+      return data;
+    }
+
+  private:
+    ChannelReader & reader_;
+  };
+
+  /**
+   * @brief co_await next() returns the first object newer than the one last returned by get() or next()
+   * @details a single coroutine can wait at a time, in place of the thread calling get(). It is resumed on the
+   * reception thread as soon as the object is decoded, and must not block it any longer than an on_data() callback. A
+   * coroutine still waiting when the reader is destroyed is never resumed.
+   */
+  NextAwaiter next() noexcept
+  {
+    return NextAwaiter(*this);
+  }
+#endif
+
+  /** @brief number of objects received so far */
+  uint64_t sequence() const noexcept
+  {
+    return latest_.sequence();
+  }
+
+  /**
+   * @brief decode the keyframes and deltas sent by a writer with delta enabled, see ChannelWriter::set_delta()
+   * @details must be called before the reception starts
+   */
+  void set_delta(bool enabled)
+  {
+    delta_ = enabled;
+  }
+
+  /**
+   * @brief largest update the writer can send, header included, known when Codec declares max_encoded_size
+   * @return 0 if the size of the updates is not bounded
+   */
+  size_t max_update_size() const noexcept
+  {
+    if constexpr(has_max_encoded_size<Codec>::value)
+    {
+      return MessageHeader::size + (delta_ ? max_delta_size(Codec::max_encoded_size) : Codec::max_encoded_size);
+    }
+    return 0;
+  }
+
+  /** @brief number of deltas dropped because their keyframe was not received */
+  uint64_t missing_keyframes() const noexcept
+  {
+    return count(DecodeStatus::MissingKeyframe);
+  }
+
+  /**
+   * @brief statistics of the updates received so far, callable from any thread
+   */
+  LinkStats link_stats() const
+  {
+    std::lock_guard<std::mutex> lock(link_mutex_);
+    return link_.stats();
+  }
+
+  /**
+   * @brief count the updates received later than threshold after being sent, see LinkStats::late
+   * @param [in] threshold 0 to disable
+   */
+  void set_late_threshold(std::chrono::nanoseconds threshold)
+  {
+    std::lock_guard<std::mutex> lock(link_mutex_);
+    link_.set_late_threshold(threshold);
+  }
+
+  /** @brief number of updates that could not be decoded, see DecodeStats::errors() */
+  uint64_t decode_errors() const noexcept
+  {
+    return decode_stats().errors();
+  }
+
+  /** @brief number of updates per DecodeStatus, callable from any thread */
+  DecodeStats decode_stats() const noexcept
+  {
+    DecodeStats stats;
+    stats.decoded = count(DecodeStatus::Ok);
+    stats.stale = count(DecodeStatus::Stale);
+    stats.invalid_header = count(DecodeStatus::InvalidHeader);
+    stats.type_mismatch = count(DecodeStatus::TypeMismatch);
+    stats.bad_checksum = count(DecodeStatus::BadChecksum);
+    stats.missing_keyframe = count(DecodeStatus::MissingKeyframe);
+    stats.malformed = count(DecodeStatus::Malformed);
+    return stats;
+  }
+
+  /**
+   * @brief also keep the last objects received with their send and receive times, see SampleHistory
+   * @details must be called before the reception starts
+   * @param [in] capacity number of objects kept, 0 to keep none
+   * @param [in] playout_delay see SampleHistory::playout()
+   */
+  void set_history(size_t capacity, std::chrono::nanoseconds playout_delay = std::chrono::nanoseconds(0))
+  {
+    history_.set_capacity(capacity);
+    history_.set_playout_delay(playout_delay);
+  }
+
+  /** @brief the last objects received, empty unless enabled with set_history(), callable from any thread */
+  const SampleHistory<T> & history() const noexcept
+  {
+    return history_;
+  }
+
+  /** @see history() */
+  SampleHistory<T> & history() noexcept
+  {
+    return history_;
+  }
+
+protected:
+  /**
+   * @brief decode an update whose header was already read, and count its status
+   * @param [in] receive_time kernel receive timestamp of the update used for its latency, 0 to use the current time
+   */
+  DecodeStatus handle_update(const MessageHeader & header,
+                             const uint8_t * buffer,
+                             size_t size,
+                             int64_t receive_time = 0)
+  {
+    const auto status = decode_update(header, buffer, size, receive_time);
+    counted(status);
+    return status;
+  }
+
+  /**
+   * @brief true if a keyframe should be requested to the writer after a MissingKeyframe status
+   * @details every delta until the keyframe arrives is lost, but asking for it on each one would flood the writer
+   */
+  bool keyframe_request_due()
+  {
+    const auto now = std::chrono::steady_clock::now();
+    if(now - last_keyframe_request_ < keyframe_request_period) return false;
+    last_keyframe_request_ = now;
+    return true;
+  }
+
+  /** @brief count an update, from the reception thread only */
+  void counted(DecodeStatus status) noexcept
+  {
+    // A single writer, a plain increment is enough
+    auto & counter = decode_counts_[static_cast<size_t>(status)];
+    counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+  }
+
+  uint64_t count(DecodeStatus status) const noexcept
+  {
+    return decode_counts_[static_cast<size_t>(status)].load(std::memory_order_relaxed);
+  }
+
+  static constexpr std::chrono::milliseconds keyframe_request_period{20};
+
+  LatestValue<T> latest_;
+  bool delta_ = false;
+  DeltaDecoder delta_decoder_;
+  std::chrono::steady_clock::time_point last_keyframe_request_{};
+  std::array<std::atomic<uint64_t>, static_cast<size_t>(DecodeStatus::Malformed) + 1> decode_counts_{};
+  mutable std::mutex link_mutex_;
+  LinkMonitor link_;
+  SampleHistory<T> history_;
+  std::function<void(const T &)> on_data_;
+  // Only accessed by the thread calling get()
+  uint64_t last_read_ = 0;
+  // Handle of the coroutine waiting in next(), resumed through resume_ so that the code compiled without coroutines
+  // still resumes it
+  std::atomic<void *> awaiting_{nullptr};
+  void (*resume_)(void *) = nullptr;
+
+private:
+  DecodeStatus decode_update(const MessageHeader & header, const uint8_t * buffer, size_t size, int64_t receive_time)
+  {
+    // Cheapest checks first, before the update counts as received
+    if(header.type_id != type_fingerprint<T, Codec>()) return DecodeStatus::TypeMismatch;
+    if((header.flags & MessageHeader::checksum_flag) && crc32c(buffer, size) != header.checksum)
+    {
+      return DecodeStatus::BadChecksum;
+    }
+    const auto now = receive_time != 0 ? receive_time : MessageHeader::now();
+    {
+      std::lock_guard<std::mutex> lock(link_mutex_);
+      if(link_.update(header, now) != LinkMonitor::Order::InOrder) return DecodeStatus::Stale;
+    }
+    if(delta_)
+    {
+      switch(delta_decoder_.decode(buffer, size, buffer, size))
+      {
+        case DeltaDecoder::Status::Ok:
+          break;
+        case DeltaDecoder::Status::MissingKeyframe:
+          return DecodeStatus::MissingKeyframe;
+        default:
+          return DecodeStatus::Malformed;
+      }
+    }
+    if(!Codec::decode(buffer, size, latest_.write_buffer())) return DecodeStatus::Malformed;
+    if(history_.capacity() != 0) history_.push(latest_.write_buffer(), header, now);
+    if(on_data_) on_data_(latest_.write_buffer());
+    latest_.publish();
+    if(awaiting_.load(std::memory_order_relaxed) != nullptr)
+    {
+      if(auto * address = awaiting_.exchange(nullptr, std::memory_order_acq_rel)) resume_(address);
+    }
+    return DecodeStatus::Ok;
+  }
+};
+
+} // namespace UDPDataLink
@@ -0,0 +1,147 @@
+/**
+ * @file Checksum.h
+ * @brief CRC-32C of the payload of the updates, and the hash used to build the fingerprints of their types
+ */
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__SSE4_2__) && defined(__x86_64__)
+#  include <nmmintrin.h>
+#elif defined(__x86_64__) && defined(__GNUC__)
+// Not enabled at compile time, the CRC instruction is used when the CPU has it
+#  define UDPDATALINK_CRC32C_DISPATCH
+#elif defined(__ARM_FEATURE_CRC32) && defined(__aarch64__)
+#  include <arm_acle.h>
+#endif
+
+namespace UDPDataLink
+{
+
+namespace detail
+{
+
+// Reflected Castagnoli polynomial
+constexpr uint32_t crc32c_polynomial = 0x82f63b78;
+
+// Tables of the slicing-by-8 algorithm: table[k][b] is the CRC of byte b followed by k zero bytes
+struct Crc32cTables
+{
+  uint32_t table[8][256] = {};
+};
+
+constexpr Crc32cTables make_crc32c_tables() noexcept
+{
+  Crc32cTables tables;
+  for(uint32_t i = 0; i < 256; ++i)
+  {
+    uint32_t crc = i;
+    for(int bit = 0; bit < 8; ++bit) crc = (crc >> 1) ^ (crc & 1 ? crc32c_polynomial : 0);
+    tables.table[0][i] = crc;
+  }
+  for(size_t k = 1; k < 8; ++k)
+  {
+    for(size_t i = 0; i < 256; ++i)
+    {
+      const auto previous = tables.table[k - 1][i];
+      tables.table[k][i] = (previous >> 8) ^ tables.table[0][previous & 0xff];
+    }
+  }
+  return tables;
+}
+
+inline constexpr Crc32cTables crc32c_tables = make_crc32c_tables();
+
+inline uint32_t load_le32(const uint8_t * data) noexcept
+{
+  return static_cast<uint32_t>(data[0]) | static_cast<uint32_t>(data[1]) << 8 | static_cast<uint32_t>(data[2]) << 16
+         | static_cast<uint32_t>(data[3]) << 24;
+}
+
+// Slicing-by-8 on the inverted crc
+inline uint32_t crc32c_table(const uint8_t * data, size_t size, uint32_t crc) noexcept
+{
+  const auto & table = crc32c_tables.table;
+  for(; size >= 8; data += 8, size -= 8)
+  {
+    const auto low = load_le32(data) ^ crc;
+    const auto high = load_le32(data + 4);
+    crc = table[7][low & 0xff] ^ table[6][(low >> 8) & 0xff] ^ table[5][(low >> 16) & 0xff] ^ table[4][low >> 24]
+          ^ table[3][high & 0xff] ^ table[2][(high >> 8) & 0xff] ^ table[1][(high >> 16) & 0xff] ^ table[0][high >> 24];
+  }
+  for(; size > 0; ++data, --size) crc = table[0][(crc ^ *data) & 0xff] ^ (crc >> 8);
+  return crc;
+}
+
+#ifdef UDPDATALINK_CRC32C_DISPATCH
+__attribute__((target("sse4.2"))) inline uint32_t crc32c_sse42(const uint8_t * data, size_t size, uint32_t crc) noexcept
+{
+  for(; size >= 8; data += 8, size -= 8)
+  {
+    unsigned long long word;
+    std::memcpy(&word, data, sizeof(word));
+    crc = static_cast<uint32_t>(__builtin_ia32_crc32di(crc, word));
+  }
+  for(; size > 0; ++data, --size) crc = __builtin_ia32_crc32qi(crc, *data);
+  return crc;
+}
+
+// Initialized with the other globals, maybe before the CPU detection of the runtime
+inline const bool has_sse42 = []()
+{
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("sse4.2") != 0;
+}();
+#endif
+
+} // namespace detail
+
+/**
+ * @brief CRC-32C (Castagnoli) of size bytes
+ * @details uses the CRC instructions of the CPU when it has them, a table driven loop processing 8 bytes per step
+ * otherwise
+ * @param [in] crc CRC of the bytes preceding data, to checksum a message in several parts
+ */
+inline uint32_t crc32c(const uint8_t * data, size_t size, uint32_t crc = 0) noexcept
+{
+  crc = ~crc;
+#if defined(__SSE4_2__) && defined(__x86_64__)
+  for(; size >= 8; data += 8, size -= 8)
+  {
+    uint64_t word;
+    std::memcpy(&word, data, sizeof(word));
+    crc = static_cast<uint32_t>(_mm_crc32_u64(crc, word));
+  }
+  for(; size > 0; ++data, --size) crc = _mm_crc32_u8(crc, *data);
+#elif defined(UDPDATALINK_CRC32C_DISPATCH)
+  crc = detail::has_sse42 ? detail::crc32c_sse42(data, size, crc) : detail::crc32c_table(data, size, crc);
+#elif defined(__ARM_FEATURE_CRC32) && defined(__aarch64__)
+  for(; size >= 8; data += 8, size -= 8)
+  {
+    uint64_t word;
+    std::memcpy(&word, data, sizeof(word));
+    crc = __crc32cd(crc, word);
+  }
+  for(; size > 0; ++data, --size) crc = __crc32cb(crc, *data);
+#else
+  crc = detail::crc32c_table(data, size, crc);
+#endif
+  return ~crc;
+}
+
+/** @brief FNV-1a hash of a string, computed at compile time to build fingerprints */
+constexpr uint32_t fingerprint_of(const char * text, uint32_t hash = 2166136261u) noexcept
+{
+  for(; *text != '\0'; ++text) hash = (hash ^ static_cast<uint8_t>(*text)) * 16777619u;
+  return hash;
+}
+
+/** @brief add the 8 bytes of value to an FNV-1a hash */
+constexpr uint32_t fingerprint_mix(uint32_t hash, uint64_t value) noexcept
+{
+  for(size_t i = 0; i < 8; ++i) hash = (hash ^ static_cast<uint8_t>(value >> (8 * i))) * 16777619u;
+  return hash;
+}
+
+} // namespace UDPDataLink
@@ -0,0 +1,239 @@
+#pragma once
+#include "BinaryArchive.h"
+#include "Checksum.h"
+#include "MessageHeader.h"
+#include "Serialize.h"
+#include <boost/archive/text_iarchive.hpp>
+#include <boost/archive/text_oarchive.hpp>
+#include <boost/serialization/version.hpp>
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace UDPDataLink
+{
+
+/**
+ * Codecs are the policies used by Publisher and Receiver to turn an object into the bytes put on the wire. A codec is
+ * a stateless type providing:
+ *  - `static constexpr const char * name`
+ *  - `static void encode(const T & data, std::vector<uint8_t> & buffer)` writing the encoded object in buffer (its
+ *    previous content is discarded, its capacity is reused)
+ *  - `static bool decode(const uint8_t * buffer, size_t size, T & data)` returning false if buffer cannot be decoded
+ *  - optionally `static void encode_append(const T & data, std::vector<uint8_t> & buffer)` writing the encoded object
+ *    after the content of buffer, so that writers encode it right behind the MessageHeader instead of copying it there
+ *  - optionally `static constexpr size_t max_encoded_size`, the size of the largest encoded object, used to size the
+ *    reception buffers exactly
+ *  - optionally `static constexpr uint32_t fingerprint`, a hash of the layout of the encoded objects, see
+ *    type_fingerprint()
+ * decode() must not throw, a datagram that cannot be decoded is counted by the receiver and dropped.
+ * See also SchemaCodec in Schema.h.
+ */
+
+/**
+ * @brief Raw copy of the object memory, only available for trivially copyable types
+ * @details Both ends must share the same architecture and the same definition of T
+ */
+template<typename T>
+struct MemcpyCodec
+{
+  static_assert(std::is_trivially_copyable<T>::value, "MemcpyCodec requires a trivially copyable type");
+
+  static constexpr const char * name = "memcpy";
+  static constexpr size_t max_encoded_size = sizeof(T);
+
+  static void encode(const T & data, std::vector<uint8_t> & buffer)
+  {
+    buffer.clear();
+    encode_append(data, buffer);
+  }
+
+  static void encode_append(const T & data, std::vector<uint8_t> & buffer)
+  {
+    const auto offset = buffer.size();
+    buffer.resize(offset + sizeof(T));
+    std::memcpy(buffer.data() + offset, &data, sizeof(T));
+  }
+
+  static bool decode(const uint8_t * buffer, size_t size, T & data)
+  {
+    if(size != sizeof(T)) return false;
+    std::memcpy(&data, buffer, sizeof(T));
+    return true;
+  }
+};
+
+/**
+ * @brief Compact binary encoding of any type serializable by boost
+ * @see BinaryOArchive
+ */
+template<typename T>
+struct BinaryCodec
+{
+  static constexpr const char * name = "binary";
+
+  static void encode(const T & data, std::vector<uint8_t> & buffer)
+  {
+    BinaryOArchive archive(buffer);
+    archive << data;
+  }
+
+  static void encode_append(const T & data, std::vector<uint8_t> & buffer)
+  {
+    BinaryOArchive archive(buffer, true);
+    archive << data;
+  }
+
+  static bool decode(const uint8_t * buffer, size_t size, T & data)
+  {
+    BinaryIArchive archive(buffer, size);
+    archive >> data;
+    return archive.ok() && archive.consumed() == size;
+  }
+};
+
+/**
+ * @brief Boost text archive of T
+ * @details Much larger and slower than the other codecs. Sent behind a MessageHeader like the others, it does not
+ * interoperate with the peers of the versions of the library that sent the archive alone
+ */
+template<typename T>
+struct BoostTextCodec
+{
+  static constexpr const char * name = "boost_text";
+
+  static void encode(const T & data, std::vector<uint8_t> & buffer)
+  {
+    std::ostringstream stream;
+    {
+      boost::archive::text_oarchive archive(stream);
+      archive << data;
+    }
+    const auto serialized = stream.str();
+    buffer.assign(serialized.begin(), serialized.end());
+  }
+
+  static bool decode(const uint8_t * buffer, size_t size, T & data)
+  {
+    try
+    {
+      std::istringstream stream(std::string(reinterpret_cast<const char *>(buffer), size));
+      boost::archive::text_iarchive archive(stream);
+      archive >> data;
+    }
+    catch(const std::exception &)
+    {
+      return false;
+    }
+    return true;
+  }
+};
+
+/**
+ * @brief true if Codec declares max_encoded_size
+ */
+template<typename Codec, typename = void>
+struct has_max_encoded_size : std::false_type
+{
+};
+
+template<typename Codec>
+struct has_max_encoded_size<Codec, std::void_t<decltype(Codec::max_encoded_size)>> : std::true_type
+{
+};
+
+/**
+ * @brief true if Codec declares fingerprint
+ */
+template<typename Codec, typename = void>
+struct has_fingerprint : std::false_type
+{
+};
+
+template<typename Codec>
+struct has_fingerprint<Codec, std::void_t<decltype(Codec::fingerprint)>> : std::true_type
+{
+};
+
+/**
+ * @brief true if Codec declares encode_append()
+ */
+template<typename Codec, typename = void>
+struct has_encode_append : std::false_type
+{
+};
+
+template<typename Codec>
+struct has_encode_append<Codec, std::void_t<decltype(&Codec::encode_append)>> : std::true_type
+{
+};
+
+namespace detail
+{
+
+/**
+ * @brief hash of the name of T, as spelled by the compiler in __PRETTY_FUNCTION__ or __FUNCSIG__
+ * @details the compilers spell names differently, e.g. "struct ns::Type" with MSVC and templates arguments or
+ * anonymous namespaces with gcc and clang: the hash only identifies T between binaries built by the same toolchain
+ */
+template<typename T>
+constexpr uint32_t type_name_fingerprint() noexcept
+{
+#ifdef _MSC_VER
+  // "unsigned int __cdecl UDPDataLink::detail::type_name_fingerprint<name>(void) noexcept"
+  const char * it = __FUNCSIG__;
+  const char * end = it;
+  for(const char * c = it; *c != '\0'; ++c)
+  {
+    if(*c == '>') end = c;
+  }
+  while(it != end && *it != '<') ++it;
+  if(it != end) ++it;
+#else
+  // "[with T = name; ...]" with gcc and "[T = name]" with clang
+  const char * it = __PRETTY_FUNCTION__;
+  while(*it != '\0' && !(it[0] == 'T' && it[1] == ' ' && it[2] == '=' && it[3] == ' ')) ++it;
+  if(*it != '\0') it += 4;
+  const char * end = it;
+  while(*end != '\0' && *end != ';' && *end != ']') ++end;
+#endif
+  uint32_t hash = 2166136261u;
+  for(; it != end; ++it) hash = (hash ^ static_cast<uint8_t>(*it)) * 16777619u;
+  return hash;
+}
+
+} // namespace detail
+
+/**
+ * @brief 32 bits identifying how T is encoded by Codec, written in the header of every update
+ * @details a hash of the name of the codec, of its max_encoded_size and fingerprint when it declares them, of the id
+ * of T and of the boost serialization version of T. The id of T is MessageTypeId<T> when specialized, none when the
+ * codec declares a fingerprint, e.g. SchemaCodec, and otherwise the hash of the name of T, which only matches between
+ * binaries built by the same toolchain: specialize MessageTypeId<T> or use a codec with a fingerprint when the two
+ * ends are built by different compilers.
+ * Receivers drop the updates with another fingerprint before decoding them, so that a publisher and a receiver built
+ * with different types or versions of a type do not silently exchange garbage.
+ */
+template<typename T, typename Codec>
+constexpr uint32_t type_fingerprint() noexcept
+{
+  auto hash = fingerprint_of(Codec::name);
+  if constexpr(has_max_encoded_size<Codec>::value) hash = fingerprint_mix(hash, Codec::max_encoded_size);
+  if constexpr(has_fingerprint<Codec>::value) hash = fingerprint_mix(hash, Codec::fingerprint);
+  if constexpr(MessageTypeId<T>::value != 0)
+    hash = fingerprint_mix(hash, MessageTypeId<T>::value);
+  else if constexpr(!has_fingerprint<Codec>::value)
+    hash = fingerprint_mix(hash, detail::type_name_fingerprint<T>());
+  return fingerprint_mix(hash, boost::serialization::version<T>::value);
+}
+
+/**
+ * @brief Codec used when none is specified: a memory copy for trivially copyable types, BinaryCodec otherwise
+ */
+template<typename T>
+using DefaultCodec =
+    typename std::conditional<std::is_trivially_copyable<T>::value, MemcpyCodec<T>, BinaryCodec<T>>::type;
+
+} // namespace UDPDataLink
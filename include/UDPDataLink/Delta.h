@@ -0,0 +1,322 @@
+/**
+ * @file Delta.h
+ * @brief delta encoding of successive messages against a keyframe
+ * @details Each message starts with a 12 bytes little endian header: a magic number, the kind of message (keyframe or
+ * delta), a reserved byte, the id of the keyframe and the size of the decoded message.
+ * A keyframe carries the encoded object as it is. A delta carries the XOR of the encoded object with the keyframe it
+ * refers to, zero extended to the longest of the two, compressed as a sequence of [zero run][literal length][literal
+ * bytes] with the lengths written as varints. Objects whose encoding changes in a few bytes between two keyframes give
+ * deltas of a few bytes. Deltas always refer to the last keyframe and not to the previous delta, so that losing a
+ * delta does not prevent decoding the next ones.
+ * The high 16 bits of keyframe ids hold an epoch chosen by each writer, so that a delta from a restarted writer is
+ * never applied to a keyframe of its previous instance that carries the same counter.
+ */
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace UDPDataLink
+{
+
+enum class DeltaKind : uint8_t
+{
+  Keyframe = 1,
+  Delta = 2,
+};
+
+struct DeltaHeader
+{
+  static constexpr uint16_t magic = 0x4455; // "UD" on the wire
+  static constexpr size_t size = 12;
+
+  DeltaKind kind = DeltaKind::Keyframe;
+  uint32_t keyframe_id = 0;
+  /** size of the decoded message */
+  uint32_t message_size = 0;
+
+  /** @brief write the header to the beginning of buffer, which must hold at least size bytes */
+  void write(uint8_t * buffer) const noexcept
+  {
+    buffer[0] = static_cast<uint8_t>(magic);
+    buffer[1] = static_cast<uint8_t>(magic >> 8);
+    buffer[2] = static_cast<uint8_t>(kind);
+    buffer[3] = 0;
+    for(size_t i = 0; i < 4; ++i)
+    {
+      buffer[4 + i] = static_cast<uint8_t>(keyframe_id >> (8 * i));
+      buffer[8 + i] = static_cast<uint8_t>(message_size >> (8 * i));
+    }
+  }
+
+  /**
+   * @brief read the header at the beginning of a message
+   * @return false if the message does not start with a valid header
+   */
+  static bool read(const uint8_t * buffer, size_t size, DeltaHeader & header) noexcept
+  {
+    if(size < DeltaHeader::size || buffer[0] != static_cast<uint8_t>(magic)
+       || buffer[1] != static_cast<uint8_t>(magic >> 8))
+    {
+      return false;
+    }
+    if(buffer[2] != static_cast<uint8_t>(DeltaKind::Keyframe) && buffer[2] != static_cast<uint8_t>(DeltaKind::Delta))
+    {
+      return false;
+    }
+    header.kind = static_cast<DeltaKind>(buffer[2]);
+    header.keyframe_id = 0;
+    header.message_size = 0;
+    for(size_t i = 0; i < 4; ++i)
+    {
+      header.keyframe_id |= static_cast<uint32_t>(buffer[4 + i]) << (8 * i);
+      header.message_size |= static_cast<uint32_t>(buffer[8 + i]) << (8 * i);
+    }
+    return true;
+  }
+};
+
+/**
+ * @brief upper bound of the size of a keyframe or delta of a message of message_size bytes
+ * @details a zero run of at least 3 bytes costs at most the bytes it covers, the varints of long literals add a byte
+ * every 128 bytes at worst
+ */
+constexpr size_t max_delta_size(size_t message_size) noexcept
+{
+  return DeltaHeader::size + message_size + message_size / 128 + 8;
+}
+
+namespace detail
+{
+
+inline void write_varint(size_t value, std::vector<uint8_t> & out)
+{
+  while(value >= 0x80)
+  {
+    out.push_back(static_cast<uint8_t>(value | 0x80));
+    value >>= 7;
+  }
+  out.push_back(static_cast<uint8_t>(value));
+}
+
+inline bool read_varint(const uint8_t *& it, const uint8_t * end, size_t & value) noexcept
+{
+  value = 0;
+  for(unsigned shift = 0; it != end && shift < 8 * sizeof(size_t); shift += 7)
+  {
+    const auto byte = *it++;
+    value |= static_cast<size_t>(byte & 0x7f) << shift;
+    if((byte & 0x80) == 0) return true;
+  }
+  return false;
+}
+
+inline uint8_t byte_at(const uint8_t * data, size_t size, size_t i) noexcept
+{
+  return i < size ? data[i] : 0;
+}
+
+} // namespace detail
+
+/**
+ * @brief append to out the difference between message and base
+ */
+inline void delta_encode(const uint8_t * base,
+                         size_t base_size,
+                         const uint8_t * message,
+                         size_t size,
+                         std::vector<uint8_t> & out)
+{
+  // Runs of less than a few equal bytes cost more as a zero run than as literals
+  const size_t min_zero_run = 3;
+  size_t i = 0;
+  while(i < size)
+  {
+    const auto zero_start = i;
+    while(i < size && detail::byte_at(base, base_size, i) == message[i]) ++i;
+    if(i == size) break; // trailing zeros are implied by the message size
+    const auto literal_start = i;
+    size_t zeros = 0;
+    while(i < size && zeros < min_zero_run)
+    {
+      zeros = detail::byte_at(base, base_size, i) == message[i] ? zeros + 1 : 0;
+      ++i;
+    }
+    if(zeros == min_zero_run) i -= zeros;
+    detail::write_varint(literal_start - zero_start, out);
+    detail::write_varint(i - literal_start, out);
+    for(size_t j = literal_start; j < i; ++j) out.push_back(message[j] ^ detail::byte_at(base, base_size, j));
+  }
+}
+
+/**
+ * @brief rebuild a message from its base and the difference written by delta_encode()
+ * @param [in] size size of the message
+ * @return false if the delta is invalid
+ */
+inline bool delta_decode(const uint8_t * base,
+                         size_t base_size,
+                         const uint8_t * delta,
+                         size_t delta_size,
+                         size_t size,
+                         std::vector<uint8_t> & message)
+{
+  message.resize(size);
+  const auto common = std::min(base_size, size);
+  std::copy(base, base + common, message.begin());
+  std::fill(message.begin() + common, message.end(), 0);
+  const auto * it = delta;
+  const auto * end = delta + delta_size;
+  size_t position = 0;
+  while(it != end)
+  {
+    size_t zeros = 0, literals = 0;
+    if(!detail::read_varint(it, end, zeros) || !detail::read_varint(it, end, literals)) return false;
+    if(zeros > size - position || literals > size - position - zeros
+       || literals > static_cast<size_t>(end - it))
+    {
+      return false;
+    }
+    position += zeros;
+    for(size_t j = 0; j < literals; ++j) message[position++] ^= *it++;
+  }
+  return true;
+}
+
+/**
+ * @brief Turn successive encoded objects into keyframes and deltas against the last keyframe
+ */
+class DeltaEncoder
+{
+public:
+  /**
+   * @param [in] keyframe_interval a keyframe is sent every keyframe_interval messages, 0 to only send them when one is
+   * requested
+   */
+  explicit DeltaEncoder(size_t keyframe_interval = 100) : keyframe_interval_(keyframe_interval) {}
+
+  void set_keyframe_interval(size_t keyframe_interval) noexcept
+  {
+    keyframe_interval_ = keyframe_interval;
+  }
+
+  /** @brief make the next message a keyframe */
+  void request_keyframe() noexcept
+  {
+    keyframe_requested_ = true;
+  }
+
+  /**
+   * @brief set the high 16 bits of the keyframe ids, different for each writer instance
+   * @details restarts the keyframe counter and makes the next message a keyframe
+   */
+  void set_epoch(uint16_t epoch) noexcept
+  {
+    keyframe_id_ = static_cast<uint32_t>(epoch) << 16;
+    keyframe_requested_ = true;
+  }
+
+  /**
+   * @brief append the header and the keyframe or delta of message to out
+   * @return true if a keyframe was written, false for a delta
+   */
+  bool encode(const uint8_t * message, size_t size, std::vector<uint8_t> & out)
+  {
+    const auto start = out.size();
+    out.resize(start + DeltaHeader::size);
+    DeltaHeader header;
+    header.message_size = static_cast<uint32_t>(size);
+    const bool keyframe_due = keyframe_interval_ != 0 && since_keyframe_ >= keyframe_interval_;
+    if(!keyframe_requested_ && !keyframe_due && has_keyframe_)
+    {
+      delta_encode(keyframe_.data(), keyframe_.size(), message, size, out);
+      // A delta larger than the message is better sent as a keyframe
+      if(out.size() - start < DeltaHeader::size + size)
+      {
+        header.kind = DeltaKind::Delta;
+        header.keyframe_id = keyframe_id_;
+        header.write(out.data() + start);
+        ++since_keyframe_;
+        return false;
+      }
+      out.resize(start + DeltaHeader::size);
+    }
+    keyframe_.assign(message, message + size);
+    has_keyframe_ = true;
+    keyframe_requested_ = false;
+    since_keyframe_ = 1;
+    header.kind = DeltaKind::Keyframe;
+    // The counter wraps within the epoch
+    keyframe_id_ = (keyframe_id_ & 0xffff0000u) | ((keyframe_id_ + 1) & 0xffffu);
+    header.keyframe_id = keyframe_id_;
+    header.write(out.data() + start);
+    out.insert(out.end(), message, message + size);
+    return true;
+  }
+
+private:
+  size_t keyframe_interval_;
+  size_t since_keyframe_ = 0;
+  bool has_keyframe_ = false;
+  bool keyframe_requested_ = false;
+  uint32_t keyframe_id_ = 0;
+  std::vector<uint8_t> keyframe_;
+};
+
+/**
+ * @brief Rebuild the encoded objects sent by a DeltaEncoder
+ */
+class DeltaDecoder
+{
+public:
+  enum class Status
+  {
+    Ok,
+    /** a delta refers to a keyframe that was not received */
+    MissingKeyframe,
+    Invalid,
+  };
+
+  /** @param [in] max_message_size larger decoded messages are rejected as invalid */
+  explicit DeltaDecoder(size_t max_message_size = 64 * 1024 * 1024) : max_message_size_(max_message_size) {}
+
+  /**
+   * @brief decode a keyframe or a delta
+   * @param [out] message the encoded object, valid until the next call when status is Ok
+   */
+  Status decode(const uint8_t * buffer, size_t size, const uint8_t *& message, size_t & message_size)
+  {
+    DeltaHeader header;
+    if(!DeltaHeader::read(buffer, size, header) || header.message_size > max_message_size_) return Status::Invalid;
+    const auto * payload = buffer + DeltaHeader::size;
+    const auto payload_size = size - DeltaHeader::size;
+    if(header.kind == DeltaKind::Keyframe)
+    {
+      if(payload_size != header.message_size) return Status::Invalid;
+      keyframe_.assign(payload, payload + payload_size);
+      keyframe_id_ = header.keyframe_id;
+      has_keyframe_ = true;
+      message = keyframe_.data();
+      message_size = keyframe_.size();
+      return Status::Ok;
+    }
+    if(!has_keyframe_ || header.keyframe_id != keyframe_id_) return Status::MissingKeyframe;
+    if(!delta_decode(keyframe_.data(), keyframe_.size(), payload, payload_size, header.message_size, message_))
+    {
+      return Status::Invalid;
+    }
+    message = message_.data();
+    message_size = message_.size();
+    return Status::Ok;
+  }
+
+private:
+  size_t max_message_size_;
+  bool has_keyframe_ = false;
+  uint32_t keyframe_id_ = 0;
+  std::vector<uint8_t> keyframe_;
+  std::vector<uint8_t> message_;
+};
+
+} // namespace UDPDataLink
@@ -0,0 +1,253 @@
+/**
+ * @file History.h
+ * @brief the last objects received on a stream with their timestamps, looked up by send time, and a playout delay
+ * absorbing the jitter of the network
+ */
+#pragma once
+#include "MessageHeader.h"
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace UDPDataLink
+{
+
+/**
+ * @brief an object received with its timestamps
+ */
+template<typename T>
+struct Sample
+{
+  T value{};
+  /** sequence number of the update given by the writer */
+  uint64_t sequence = 0;
+  /** nanoseconds since the epoch of the system clock of the sender */
+  int64_t send_time = 0;
+  /** nanoseconds since the epoch of the system clock of the receiver */
+  int64_t receive_time = 0;
+};
+
+/**
+ * @brief Bounded ring of the last samples received, ordered by send time
+ * @details written by the reception thread and queried from any thread. The ring is allocated once by set_capacity()
+ * and the samples are copied in place. Lookups are binary searches on the send times, they copy the samples out and do
+ * not allocate unless copying T does. A send time going back, e.g. a restarted writer or a step of its clock, clears
+ * the ring.
+ *
+ * The playout delay turns the ring into a jitter buffer: playout() returns the sample sent delay before the sample that
+ * would have arrived now with the shortest transit time seen in the ring, so that samples late by less than delay are
+ * played on time. Transit times are receive minus send times, the clocks of the two hosts do not have to be
+ * synchronized as long as they do not drift apart faster than the ring is renewed.
+ */
+template<typename T>
+class SampleHistory
+{
+public:
+  /**
+   * @brief number of samples kept, 0 to keep none
+   * @details allocates the ring and clears it, must be called before the reception starts
+   */
+  void set_capacity(size_t capacity)
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    samples_.assign(capacity, Sample<T>{});
+    transits_.assign(capacity, {});
+    begin_ = size_ = 0;
+    pushed_ = transits_begin_ = transits_size_ = 0;
+  }
+
+  /** @brief only changed by set_capacity(), read without locking */
+  size_t capacity() const noexcept
+  {
+    return samples_.size();
+  }
+
+  size_t size() const
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return size_;
+  }
+
+  /** @brief delay added to the transit time of the samples before they are played, see playout() */
+  void set_playout_delay(std::chrono::nanoseconds delay)
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    playout_delay_ = delay.count();
+  }
+
+  /** @brief add a sample, replacing the oldest one when the ring is full */
+  void push(const T & value, const MessageHeader & header, int64_t receive_time)
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if(samples_.empty()) return;
+    if(size_ > 0 && header.send_time < at(size_ - 1).send_time)
+    {
+      begin_ = size_ = 0;
+      transits_begin_ = transits_size_ = 0;
+    }
+    Sample<T> * slot = nullptr;
+    if(size_ < samples_.size())
+    {
+      slot = &samples_[(begin_ + size_++) % samples_.size()];
+    }
+    else
+    {
+      slot = &samples_[begin_];
+      begin_ = (begin_ + 1) % samples_.size();
+    }
+    auto & sample = *slot;
+    sample.value = value;
+    sample.sequence = header.sequence;
+    sample.send_time = header.send_time;
+    sample.receive_time = receive_time;
+    push_transit(receive_time - header.send_time);
+  }
+
+  /** @brief copy the latest sample, false if the ring is empty */
+  bool latest(Sample<T> & sample) const
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if(size_ == 0) return false;
+    sample = at(size_ - 1);
+    return true;
+  }
+
+  /**
+   * @brief copy the latest sample sent at or before time
+   * @param [in] time nanoseconds since the epoch of the system clock of the sender
+   * @return false if every sample of the ring was sent after time
+   */
+  bool latest_before(int64_t time, Sample<T> & sample) const
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    const auto index = first_after(time);
+    if(index == 0) return false;
+    sample = at(index - 1);
+    return true;
+  }
+
+  /**
+   * @brief copy the two consecutive samples sent around time, to interpolate between them
+   * @param [out] before latest sample sent at or before time
+   * @param [out] after next sample, sent after time
+   * @return false if time is not between the first and the latest sample of the ring
+   */
+  bool bracket(int64_t time, Sample<T> & before, Sample<T> & after) const
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    const auto index = first_after(time);
+    if(index == 0 || index == size_) return false;
+    before = at(index - 1);
+    after = at(index);
+    return true;
+  }
+
+  /**
+   * @brief send time of the sample to play at now, see the playout delay in SampleHistory
+   * @param [in] now nanoseconds since the epoch of the system clock of the receiver
+   * @return 0 if the ring is empty
+   */
+  int64_t playout_time(int64_t now = MessageHeader::now()) const
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return playout_time_locked(now);
+  }
+
+  /**
+   * @brief copy the sample to play at now, the latest one sent at or before playout_time()
+   * @return false if the ring is empty or every sample is still to be played
+   */
+  bool playout(Sample<T> & sample, int64_t now = MessageHeader::now()) const
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    const auto index = first_after(playout_time_locked(now));
+    if(index == 0) return false;
+    sample = at(index - 1);
+    return true;
+  }
+
+  /**
+   * @brief copy the samples to interpolate between to play at now
+   * @param [out] time playout_time() of now, between before.send_time and after.send_time
+   * @return false if no sample was sent after playout_time(), e.g. when the delay is shorter than the jitter
+   */
+  bool playout(Sample<T> & before, Sample<T> & after, int64_t & time, int64_t now = MessageHeader::now()) const
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    time = playout_time_locked(now);
+    const auto index = first_after(time);
+    if(index == 0 || index == size_) return false;
+    before = at(index - 1);
+    after = at(index);
+    return true;
+  }
+
+  void clear()
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    begin_ = size_ = 0;
+    transits_begin_ = transits_size_ = 0;
+  }
+
+private:
+  // Logical index, 0 being the oldest sample
+  const Sample<T> & at(size_t index) const noexcept
+  {
+    return samples_[(begin_ + index) % samples_.size()];
+  }
+
+  // Index of the first sample sent after time, size_ if none
+  size_t first_after(int64_t time) const noexcept
+  {
+    size_t low = 0;
+    size_t high = size_;
+    while(low < high)
+    {
+      const auto middle = low + (high - low) / 2;
+      if(at(middle).send_time <= time)
+        low = middle + 1;
+      else
+        high = middle;
+    }
+    return low;
+  }
+
+  int64_t playout_time_locked(int64_t now) const noexcept
+  {
+    if(transits_size_ == 0) return 0;
+    return now - transits_[transits_begin_].second - playout_delay_;
+  }
+
+  // Sliding minimum of the transit times of the samples in the ring: a queue of increasing transit times, each tagged
+  // with the number of the sample it belongs to, so that the front is the minimum
+  void push_transit(int64_t transit) noexcept
+  {
+    const auto capacity = transits_.size();
+    while(transits_size_ > 0 && transits_[(transits_begin_ + transits_size_ - 1) % capacity].second >= transit)
+    {
+      --transits_size_;
+    }
+    // The front leaves the window once capacity newer samples are pushed
+    if(transits_size_ > 0 && transits_[transits_begin_].first + capacity <= pushed_)
+    {
+      transits_begin_ = (transits_begin_ + 1) % capacity;
+      --transits_size_;
+    }
+    transits_[(transits_begin_ + transits_size_++) % capacity] = {pushed_++, transit};
+  }
+
+  mutable std::mutex mutex_;
+  std::vector<Sample<T>> samples_;
+  size_t begin_ = 0;
+  size_t size_ = 0;
+  std::vector<std::pair<uint64_t, int64_t>> transits_;
+  size_t transits_begin_ = 0;
+  size_t transits_size_ = 0;
+  uint64_t pushed_ = 0;
+  int64_t playout_delay_ = 0;
+};
+
+} // namespace UDPDataLink
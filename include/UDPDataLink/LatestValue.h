@@ -0,0 +1,117 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+
+namespace UDPDataLink
+{
+
+/**
+ * @brief Single producer, single consumer slot holding the latest value written
+ * @details Implemented as a triple buffer: the writer fills its own back buffer and swaps it with the shared middle
+ * one, the reader swaps the middle buffer with its own front buffer when a fresh one is available. Neither side ever
+ * waits for the other one and values are never copied between threads, only buffer indices are exchanged.
+ *
+ * Threads can also sleep until a new value is published with wait_newer(). publish() only takes a lock to wake them up
+ * while one of them waits.
+ */
+template<typename T>
+class LatestValue
+{
+public:
+  /** @brief buffer to fill before calling publish(), only accessible to the writer thread */
+  T & write_buffer() noexcept
+  {
+    return slots_[back_].value;
+  }
+
+  /** @brief make the content of write_buffer() the latest value */
+  void publish() noexcept
+  {
+    const auto sequence = sequence_.load(std::memory_order_relaxed) + 1;
+    slots_[back_].sequence = sequence;
+    back_ = middle_.exchange(static_cast<uint8_t>(back_ | fresh_bit), std::memory_order_acq_rel) & index_mask;
+    sequence_.store(sequence, std::memory_order_release);
+    // Orders the store of the sequence before the load of waiters_, wait_newer() does the opposite
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if(waiters_.load(std::memory_order_relaxed) != 0)
+    {
+      // A waiter that saw the old sequence holds the mutex until it sleeps, so the notification cannot be missed
+      std::lock_guard<std::mutex> lock(wait_mutex_);
+      wait_condition_.notify_all();
+    }
+  }
+
+  /**
+   * @brief copy the latest value, only callable from the reader thread
+   * @param [out] value the latest value published
+   * @param [out] sequence number of values published up to this one, starting at 1
+   * @return false if nothing was published yet
+   */
+  bool read(T & value, uint64_t & sequence)
+  {
+    if(middle_.load(std::memory_order_relaxed) & fresh_bit)
+    {
+      front_ = middle_.exchange(front_, std::memory_order_acq_rel) & index_mask;
+    }
+    const auto & slot = slots_[front_];
+    if(slot.sequence == 0) return false;
+    value = slot.value;
+    sequence = slot.sequence;
+    return true;
+  }
+
+  bool read(T & value)
+  {
+    uint64_t sequence = 0;
+    return read(value, sequence);
+  }
+
+  /** @brief sequence number of the latest value published, 0 if none, callable from any thread */
+  uint64_t sequence() const noexcept
+  {
+    return sequence_.load(std::memory_order_acquire);
+  }
+
+  /**
+   * @brief sleep until a value newer than sequence is published, callable from any thread
+   * @return false if none was published within timeout
+   */
+  bool wait_newer(uint64_t sequence, std::chrono::nanoseconds timeout)
+  {
+    if(this->sequence() > sequence) return true;
+    waiters_.fetch_add(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    bool newer = false;
+    {
+      std::unique_lock<std::mutex> lock(wait_mutex_);
+      newer = wait_condition_.wait_for(lock, timeout, [&]() { return this->sequence() > sequence; });
+    }
+    waiters_.fetch_sub(1, std::memory_order_relaxed);
+    return newer;
+  }
+
+private:
+  static constexpr uint8_t fresh_bit = 0x4;
+  static constexpr uint8_t index_mask = 0x3;
+
+  struct Slot
+  {
+    T value{};
+    uint64_t sequence = 0;
+  };
+
+  Slot slots_[3];
+  // Keep the indices owned by each side on their own cache line
+  alignas(64) uint8_t back_ = 0;
+  alignas(64) uint8_t front_ = 1;
+  alignas(64) std::atomic<uint8_t> middle_{2};
+  std::atomic<uint64_t> sequence_{0};
+  std::atomic<uint32_t> waiters_{0};
+  std::mutex wait_mutex_;
+  std::condition_variable wait_condition_;
+};
+
+} // namespace UDPDataLink
@@ -0,0 +1,218 @@
+/**
+ * @file LinkStats.h
+ * @brief loss, ordering and latency statistics of the updates received from a Publisher
+ */
+#pragma once
+#include "MessageHeader.h"
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <limits>
+
+namespace UDPDataLink
+{
+
+/**
+ * @brief Latencies counted in buckets of exponentially growing width
+ * @details Bucket i counts the latencies in [2^i, 2^(i+1)) microseconds, bucket 0 also counts the ones below 1 us and
+ * the last one the ones above. Latencies are computed from the clock of the sender, they are only meaningful between
+ * hosts with synchronized clocks.
+ */
+struct LatencyHistogram
+{
+  static constexpr size_t bucket_count = 32;
+
+  std::array<uint64_t, bucket_count> buckets{};
+  uint64_t count = 0;
+  int64_t min = std::numeric_limits<int64_t>::max();
+  int64_t max = std::numeric_limits<int64_t>::min();
+  /** in nanoseconds, like min and max */
+  double mean = 0;
+
+  static size_t bucket(int64_t latency) noexcept
+  {
+    size_t index = 0;
+    for(auto us = latency / 1000; us > 1 && index + 1 < bucket_count; us >>= 1) ++index;
+    return index;
+  }
+
+  /** @brief upper bound, in nanoseconds, of the bucket i */
+  static int64_t upper_bound(size_t i) noexcept
+  {
+    return (int64_t{2} << i) * 1000;
+  }
+
+  void add(int64_t latency) noexcept
+  {
+    ++buckets[bucket(latency)];
+    ++count;
+    min = std::min(min, latency);
+    max = std::max(max, latency);
+    mean += (static_cast<double>(latency) - mean) / static_cast<double>(count);
+  }
+
+  /**
+   * @brief latency below which a fraction of the updates was received
+   * @param [in] fraction between 0 and 1, e.g. 0.99
+   * @return the upper bound of the bucket holding the percentile in nanoseconds, capped by the maximum latency, 0 if
+   * nothing was received
+   */
+  int64_t percentile(double fraction) const noexcept
+  {
+    if(count == 0) return 0;
+    const auto rank = static_cast<uint64_t>(fraction * static_cast<double>(count - 1)) + 1;
+    uint64_t seen = 0;
+    for(size_t i = 0; i < bucket_count; ++i)
+    {
+      seen += buckets[i];
+      if(seen >= rank) return std::min(upper_bound(i), max);
+    }
+    return max;
+  }
+};
+
+struct LinkStats
+{
+  /** valid updates received, duplicates included */
+  uint64_t received = 0;
+  /** sequence numbers skipped and not received since, or received more than 64 updates late */
+  uint64_t lost = 0;
+  /** updates received after a more recent one, they are not delivered */
+  uint64_t reordered = 0;
+  /** updates received twice, they are not delivered */
+  uint64_t duplicate = 0;
+  /** updates whose latency exceeds the threshold given to LinkMonitor::set_late_threshold() */
+  uint64_t late = 0;
+  /** new writer epochs, or sequence numbers going back far enough to be a restarted publisher */
+  uint64_t restarts = 0;
+  /** variation of the latency between consecutive updates as defined by RFC 3550, in nanoseconds */
+  double jitter = 0;
+  LatencyHistogram latency;
+};
+
+/**
+ * @brief Follow the sequence numbers and send times of the updates of a link
+ */
+class LinkMonitor
+{
+public:
+  enum class Order
+  {
+    /** newer than every update received before */
+    InOrder,
+    Reordered,
+    Duplicate,
+  };
+
+  /**
+   * @brief sequence numbers this far behind the latest one are considered as a restart of the publisher
+   * @details only for writers that do not send an epoch, a change of MessageHeader::epoch is a restart otherwise
+   */
+  static constexpr uint64_t restart_distance = 1024;
+
+  /** @param [in] threshold latency above which updates are counted as late, 0 to disable */
+  void set_late_threshold(std::chrono::nanoseconds threshold) noexcept
+  {
+    late_threshold_ = threshold.count();
+  }
+
+  /**
+   * @brief account for a received update
+   * @param [in] receive_time nanoseconds since the epoch of the system clock, see MessageHeader::now()
+   */
+  Order update(const MessageHeader & header, int64_t receive_time) noexcept
+  {
+    ++stats_.received;
+    const auto latency = receive_time - header.send_time;
+    stats_.latency.add(latency);
+    if(late_threshold_ > 0 && latency > late_threshold_) ++stats_.late;
+    if(started_)
+    {
+      const auto transit_change = latency - last_latency_;
+      stats_.jitter += (static_cast<double>(transit_change < 0 ? -transit_change : transit_change) - stats_.jitter) / 16;
+    }
+    last_latency_ = latency;
+
+    const auto sequence = header.sequence;
+    // A late update of the instance that was replaced
+    if(started_ && header.epoch != 0 && header.epoch == previous_epoch_ && header.epoch != epoch_)
+    {
+      ++stats_.reordered;
+      return Order::Reordered;
+    }
+    const bool same_epoch = header.epoch == epoch_;
+    if(started_ && same_epoch && sequence <= highest_ && (epoch_ != 0 || highest_ - sequence < restart_distance))
+    {
+      const auto distance = highest_ - sequence;
+      if(distance < window_bits)
+      {
+        const auto bit = uint64_t{1} << distance;
+        if(window_ & bit)
+        {
+          ++stats_.duplicate;
+          return Order::Duplicate;
+        }
+        window_ |= bit;
+        // Counted as lost when the more recent update arrived, unless it precedes the first one received
+        if(sequence >= first_ && stats_.lost > 0) --stats_.lost;
+      }
+      // Older updates may be duplicates as well, they stay counted as lost
+      ++stats_.reordered;
+      return Order::Reordered;
+    }
+    if(!started_ || !same_epoch || sequence <= highest_)
+    {
+      if(started_)
+      {
+        ++stats_.restarts;
+        if(!same_epoch) previous_epoch_ = epoch_;
+      }
+      started_ = true;
+      epoch_ = header.epoch;
+      first_ = sequence;
+      window_ = 1;
+    }
+    else
+    {
+      const auto gap = sequence - highest_;
+      stats_.lost += gap - 1;
+      window_ = (gap < window_bits ? window_ << gap : 0) | 1;
+    }
+    highest_ = sequence;
+    return Order::InOrder;
+  }
+
+  const LinkStats & stats() const noexcept
+  {
+    return stats_;
+  }
+
+  void reset() noexcept
+  {
+    stats_ = LinkStats{};
+    started_ = false;
+    epoch_ = 0;
+    previous_epoch_ = 0;
+    first_ = 0;
+    highest_ = 0;
+    window_ = 0;
+    last_latency_ = 0;
+  }
+
+private:
+  static constexpr uint64_t window_bits = 64;
+
+  LinkStats stats_;
+  int64_t late_threshold_ = 0;
+  bool started_ = false;
+  uint16_t epoch_ = 0;
+  uint16_t previous_epoch_ = 0;
+  // Sequence of the first update received from the current epoch
+  uint64_t first_ = 0;
+  uint64_t highest_ = 0;
+  // Bit i is set when the update highest_ - i was received
+  uint64_t window_ = 0;
+  int64_t last_latency_ = 0;
+};
+
+} // namespace UDPDataLink
@@ -0,0 +1,108 @@
+/**
+ * @file MessageHeader.h
+ * @brief header put by a Publisher in front of every update
+ * @details 32 bytes, little endian: a magic number, a version, flags, the topic of the update, the epoch of the writer,
+ * the fingerprint of the type of the payload, the sequence number of the update in its topic, the time it was sent in
+ * nanoseconds since the epoch of the system clock, and the CRC-32C of the payload when the checksum flag is set.
+ */
+#pragma once
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+namespace UDPDataLink
+{
+
+/** @brief id of a stream of updates sharing a transport with others, see Topics.h */
+using TopicId = uint16_t;
+
+/**
+ * @brief id identifying T on the wire, added to the fingerprint checked by the receivers, see type_fingerprint()
+ * @details 0 uses a hash of the name of T instead, unless the codec declares a fingerprint. That hash only matches
+ * between binaries built by the same toolchain: specialize it when the two ends are built by different compilers, or
+ * to keep the fingerprint of a type that is renamed or moved to another namespace
+ */
+template<typename T>
+struct MessageTypeId
+{
+  static constexpr uint32_t value = 0;
+};
+
+struct MessageHeader
+{
+  static constexpr uint16_t magic = 0x4d55; // "UM" on the wire
+  static constexpr uint8_t version = 3;
+  static constexpr size_t size = 32;
+  /** checksum holds the CRC-32C of the payload */
+  static constexpr uint8_t checksum_flag = 1;
+
+  uint8_t flags = 0;
+  TopicId topic = 0;
+  /** chosen at random by each writer instance, a new one tells the receivers that the publisher restarted, 0 if none */
+  uint16_t epoch = 0;
+  /** fingerprint of the type of the payload and of its codec */
+  uint32_t type_id = 0;
+  uint64_t sequence = 0;
+  /** nanoseconds since the epoch of the system clock of the sender */
+  int64_t send_time = 0;
+  /** CRC-32C of the payload, valid if flags has checksum_flag */
+  uint32_t checksum = 0;
+
+  static int64_t now() noexcept
+  {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::system_clock::now().time_since_epoch())
+        .count();
+  }
+
+  /** @brief write the header to the beginning of buffer, which must hold at least size bytes */
+  void write(uint8_t * buffer) const noexcept
+  {
+    buffer[0] = static_cast<uint8_t>(magic);
+    buffer[1] = static_cast<uint8_t>(magic >> 8);
+    buffer[2] = version;
+    buffer[3] = flags;
+    buffer[4] = static_cast<uint8_t>(topic);
+    buffer[5] = static_cast<uint8_t>(topic >> 8);
+    buffer[6] = static_cast<uint8_t>(epoch);
+    buffer[7] = static_cast<uint8_t>(epoch >> 8);
+    for(size_t i = 0; i < 4; ++i) buffer[8 + i] = static_cast<uint8_t>(type_id >> (8 * i));
+    for(size_t i = 0; i < 8; ++i)
+    {
+      buffer[12 + i] = static_cast<uint8_t>(sequence >> (8 * i));
+      buffer[20 + i] = static_cast<uint8_t>(static_cast<uint64_t>(send_time) >> (8 * i));
+    }
+    for(size_t i = 0; i < 4; ++i) buffer[28 + i] = static_cast<uint8_t>(checksum >> (8 * i));
+  }
+
+  /**
+   * @brief read the header at the beginning of a message
+   * @return false if the message does not start with a valid header
+   */
+  static bool read(const uint8_t * buffer, size_t size, MessageHeader & header) noexcept
+  {
+    if(size < MessageHeader::size || buffer[0] != static_cast<uint8_t>(magic)
+       || buffer[1] != static_cast<uint8_t>(magic >> 8) || buffer[2] != version)
+    {
+      return false;
+    }
+    header.flags = buffer[3];
+    header.topic = static_cast<TopicId>(buffer[4] | buffer[5] << 8);
+    header.epoch = static_cast<uint16_t>(buffer[6] | buffer[7] << 8);
+    header.type_id = 0;
+    header.sequence = 0;
+    header.checksum = 0;
+    uint64_t send_time = 0;
+    for(size_t i = 0; i < 4; ++i) header.type_id |= static_cast<uint32_t>(buffer[8 + i]) << (8 * i);
+    for(size_t i = 0; i < 8; ++i)
+    {
+      header.sequence |= static_cast<uint64_t>(buffer[12 + i]) << (8 * i);
+      send_time |= static_cast<uint64_t>(buffer[20 + i]) << (8 * i);
+    }
+    for(size_t i = 0; i < 4; ++i) header.checksum |= static_cast<uint32_t>(buffer[28 + i]) << (8 * i);
+    header.send_time = static_cast<int64_t>(send_time);
+    return true;
+  }
+};
+
+} // namespace UDPDataLink
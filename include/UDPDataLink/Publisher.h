@@ -1,32 +1,83 @@
 #pragma once
-#include "Serialize.h"
-#include <iostream>
+#include "Channel.h"
 #include <udp_server.h>
+#include <utility>
 
 namespace UDPDataLink
 {
 
-template<typename T>
-struct Publisher : public UDPServer
+/**
+ * @brief Publish objects of type T to every client of a UDPServer
+ * @details every update starts with a MessageHeader holding its sequence number and send time. Only the clients
+ * that subscribed with a matching codec receive them, see subscription.h. To publish several types over one socket, see
+ * TopicServer. Subscribers silent for default_client_timeout are removed, Receiver sends heartbeats by default;
+ * set_client_timeout(std::chrono::milliseconds(0)) keeps them until they unsubscribe, e.g. for receivers without
+ * heartbeats.
+ * @tparam T type of the published objects
+ * @tparam Codec policy encoding T on the wire, see Codec.h
+ */
+template<typename T, typename Codec = DefaultCodec<T>>
+struct Publisher : public UDPServer, public ChannelWriter<T, Codec>
 {
-  using UDPServer::UDPServer;
+  template<typename... Args>
+  Publisher(Args &&... args) : UDPServer(std::forward<Args>(args)...)
+  {
+    set_subscription_required(true);
+    set_client_timeout(default_client_timeout);
+  }
 
-  // Optionally handle incoming messages
-  void reception_callback(const uint8_t * buffer, size_t size) override
+  ~Publisher() override
   {
-    std::cout << "Received message from client: " << std::string((const char *)buffer, size) << std::endl;
+    this->stop_async();
   }
 
+  // Optionally handle incoming messages
+  void reception_callback(const uint8_t *, size_t) override {}
+
   // Publish data to the lastx client that sent a message
   void publish(const std::string & message)
   {
     send_data(reinterpret_cast<const uint8_t *>(message.data()), message.size());
   }
 
+  /**
+   * @brief send an update as it is, e.g. one recorded by a Recorder, see Replayer::play()
+   */
+  void publish(const uint8_t * update, size_t size)
+  {
+    send_data(update, size);
+  }
+
   void update_data(const T & data)
   {
-    SerializableClass<T> objToSend(data, "Hello, Server!");
-    publish(serializeObject(objToSend));
+    this->write(data);
+  }
+
+  /** @brief avoid copying data in the asynchronous mode, see ChannelWriter::set_async() */
+  void update_data(T && data)
+  {
+    this->write(std::move(data));
+  }
+
+protected:
+  void send_update(SharedBuffer update, bool keyframe) override
+  {
+    send_data(std::move(update), 0, keyframe);
+  }
+
+  void control_callback(const ControlHeader & header, size_t) override
+  {
+    if(header.type == ControlType::KeyframeRequest) this->request_keyframe();
+  }
+
+  void subscription_callback(const ControlHeader & header,
+                             const SubscribeRequest & request,
+                             SubscribeReply & reply) override
+  {
+    if(header.topic != this->topic())
+      reply.status = SubscribeStatus::UnknownTopic;
+    else
+      reply.offer(request, this->fingerprint(), this->max_update_size());
   }
 };
 
@@ -1,48 +1,71 @@
 #pragma once
 
-#include "Serialize.h"
-#include <iostream>
-#include <string>
+#include "Channel.h"
+#include <utility>
 #include <udp_client.h>
 
 namespace UDPDataLink
 {
 
-template<typename T>
-struct Receiver : public UDPClient
+/**
+ * @brief Receive objects of type T sent by a Publisher
+ * @details Datagrams are decoded once, on the reception thread, see ChannelReader. The receiver subscribes to the
+ * publisher with the fingerprint of its codec, the subscription is sent by the constructor and repeated by the
+ * reception until answered, see UDPClient::subscribe(). It sends a heartbeat every default_heartbeat_period to stay
+ * subscribed, set_heartbeat(std::chrono::milliseconds(0)) stops them, and unsubscribes when the reception stops or
+ * when it is destroyed. To receive several types over one socket, see TopicClient.
+ * @tparam T type of the received objects
+ * @tparam Codec policy decoding T from the wire, must match the one of the Publisher. When it declares max_encoded_size,
+ * the reception buffers are sized for the largest update instead of max_packet_size
+ */
+template<typename T, typename Codec = DefaultCodec<T>>
+struct Receiver : public UDPClient, public ChannelReader<T, Codec>
 {
-  using UDPClient::UDPClient;
+  using UDPClient::reception_callback;
 
-  void reception_callback(const uint8_t * buffer, size_t size) override
+  template<typename... Args>
+  Receiver(Args &&... args) : UDPClient(std::forward<Args>(args)...)
   {
-    serializedData_ = std::string(reinterpret_cast<const char *>(buffer), size);
+    size_buffers();
+    set_heartbeat(default_heartbeat_period);
+    subscribe(0, {type_fingerprint<T, Codec>()});
   }
 
-  void send_data(const uint8_t * buffer, size_t size)
+  ~Receiver() override
   {
-    std::string msg = "hello world";
-    UDPClient::send_data(reinterpret_cast<const uint8_t *>(msg.data()), msg.size());
+    // Also leaves when the reception never started, after stop_reception() the publisher ignores it
+    unsubscribe();
   }
 
-  bool get(T & data)
+  /** @see ChannelReader::set_delta() */
+  void set_delta(bool enabled)
   {
-    if(serializedData_.empty()) return false;
+    ChannelReader<T, Codec>::set_delta(enabled);
+    size_buffers();
+  }
 
-    try
+  void reception_callback(const uint8_t * buffer, size_t size, int64_t receive_time) override
+  {
+    MessageHeader header;
+    if(!MessageHeader::read(buffer, size, header))
     {
-      data = deserializeObject<T>(serializedData_).data;
+      this->counted(DecodeStatus::InvalidHeader);
+      return;
     }
-    catch(const boost::archive::archive_exception & ex)
+    const auto status =
+      this->handle_update(header, buffer + MessageHeader::size, size - MessageHeader::size, receive_time);
+    if(status == DecodeStatus::MissingKeyframe && this->keyframe_request_due())
     {
-      std::cout << "Caught archive_exception: deserializeObject failed " << ex.what() << std::endl;
-      std::cout << "Serialized Data are : " << serializedData_ << std::endl;
-      return false;
+      send_control(ControlType::KeyframeRequest, header.topic);
     }
-    return true;
   }
 
-protected:
-  std::string serializedData_;
+private:
+  void size_buffers()
+  {
+    // One byte more than the largest update, a datagram filling the buffer is taken as truncated
+    if(const auto size = this->max_update_size()) set_max_packet_size(size + 1);
+  }
 };
 
 } // namespace UDPDataLink
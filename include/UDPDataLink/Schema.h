@@ -0,0 +1,369 @@
+/**
+ * @file Schema.h
+ * @brief fixed layout encoding of structs whose fields are declared once at compile time
+ * @details A schema lists the fields of a struct, in wire order:
+ *
+ *     template<>
+ *     struct UDPDataLink::Schema<JointState>
+ *     {
+ *       static constexpr auto fields = std::make_tuple(&JointState::time, &JointState::mode, &JointState::q);
+ *     };
+ *
+ * Each field is written at an offset known at compile time, in little endian whatever the host, without padding.
+ * Fields can be arithmetic types, enums, std::array and C arrays of them, or structs that have a schema themselves.
+ * SchemaCodec<JointState> can then be given to Publisher and Receiver. The fingerprint of the schema, a hash of the
+ * kind and size of the fields in order, is checked by the receivers before decoding.
+ */
+#pragma once
+#include "Checksum.h"
+#include "MessageHeader.h"
+#include "fragmentation.h"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace UDPDataLink
+{
+
+/**
+ * @brief fields of T in wire order, specialize it with a static constexpr tuple of member pointers named fields
+ */
+template<typename T>
+struct Schema;
+
+namespace detail
+{
+
+template<typename T, typename = void>
+struct has_schema : std::false_type
+{
+};
+
+template<typename T>
+struct has_schema<T, std::void_t<decltype(Schema<T>::fields)>> : std::true_type
+{
+};
+
+template<typename M>
+struct member_type;
+
+template<typename C, typename U>
+struct member_type<U C::*>
+{
+  using type = U;
+};
+
+#if defined(__BYTE_ORDER__) && defined(__ORDER_LITTLE_ENDIAN__)
+constexpr bool little_endian_host = __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__;
+#elif defined(_WIN32)
+constexpr bool little_endian_host = true;
+#else
+constexpr bool little_endian_host = false;
+#endif
+
+// Name of the kind of a number in the fingerprints
+template<typename U>
+constexpr const char * number_kind() noexcept
+{
+  if constexpr(std::is_floating_point<U>::value)
+    return "float";
+  else if constexpr(std::is_enum<U>::value)
+    return "enum";
+  else if constexpr(std::is_signed<U>::value)
+    return "int";
+  else
+    return "uint";
+}
+
+template<size_t Size>
+struct unsigned_of_size;
+
+template<>
+struct unsigned_of_size<1>
+{
+  using type = uint8_t;
+};
+
+template<>
+struct unsigned_of_size<2>
+{
+  using type = uint16_t;
+};
+
+template<>
+struct unsigned_of_size<4>
+{
+  using type = uint32_t;
+};
+
+template<>
+struct unsigned_of_size<8>
+{
+  using type = uint64_t;
+};
+
+} // namespace detail
+
+/**
+ * @brief Size and little endian encoding of one field
+ */
+template<typename U, typename Enable = void>
+struct WireField
+{
+  static_assert(detail::has_schema<U>::value,
+                "UDPDataLink::Schema: fields must be arithmetic, enums, arrays or types with a Schema");
+};
+
+template<typename U>
+struct WireField<U, typename std::enable_if<std::is_arithmetic<U>::value || std::is_enum<U>::value>::type>
+{
+  static_assert(!std::is_floating_point<U>::value || std::numeric_limits<U>::is_iec559,
+                "UDPDataLink::Schema: floating point fields must be IEEE 754");
+
+  using Bits = typename detail::unsigned_of_size<sizeof(U)>::type;
+
+  static constexpr size_t size = sizeof(U);
+  static constexpr uint32_t fingerprint = fingerprint_mix(fingerprint_of(detail::number_kind<U>()), size);
+
+  static void write(uint8_t * out, const U & value) noexcept
+  {
+    if constexpr(detail::little_endian_host)
+    {
+      std::memcpy(out, &value, size);
+    }
+    else
+    {
+      Bits bits;
+      std::memcpy(&bits, &value, size);
+      for(size_t i = 0; i < size; ++i) out[i] = static_cast<uint8_t>(bits >> (8 * i));
+    }
+  }
+
+  static void read(const uint8_t * in, U & value) noexcept
+  {
+    if constexpr(detail::little_endian_host)
+    {
+      std::memcpy(&value, in, size);
+    }
+    else
+    {
+      Bits bits = 0;
+      for(size_t i = 0; i < size; ++i) bits = static_cast<Bits>(bits | static_cast<Bits>(in[i]) << (8 * i));
+      std::memcpy(&value, &bits, size);
+    }
+  }
+};
+
+template<>
+struct WireField<bool>
+{
+  static constexpr size_t size = 1;
+  static constexpr uint32_t fingerprint = fingerprint_of("bool");
+
+  static void write(uint8_t * out, bool value) noexcept
+  {
+    out[0] = value ? 1 : 0;
+  }
+
+  static void read(const uint8_t * in, bool & value) noexcept
+  {
+    value = in[0] != 0;
+  }
+};
+
+namespace detail
+{
+
+// Arrays of numbers are stored as they are in memory on little endian hosts, and copied at once
+template<typename U>
+constexpr bool contiguous_elements = little_endian_host && (std::is_arithmetic<U>::value || std::is_enum<U>::value)
+                                     && !std::is_same<U, bool>::value;
+
+template<typename U, size_t N>
+void write_elements(uint8_t * out, const U * value) noexcept
+{
+  if constexpr(contiguous_elements<U>)
+  {
+    std::memcpy(out, value, N * sizeof(U));
+  }
+  else
+  {
+    for(size_t i = 0; i < N; ++i) WireField<U>::write(out + i * WireField<U>::size, value[i]);
+  }
+}
+
+template<typename U, size_t N>
+void read_elements(const uint8_t * in, U * value) noexcept
+{
+  if constexpr(contiguous_elements<U>)
+  {
+    std::memcpy(value, in, N * sizeof(U));
+  }
+  else
+  {
+    for(size_t i = 0; i < N; ++i) WireField<U>::read(in + i * WireField<U>::size, value[i]);
+  }
+}
+
+} // namespace detail
+
+template<typename U, size_t N>
+struct WireField<std::array<U, N>>
+{
+  static constexpr size_t size = WireField<U[N]>::size;
+  static constexpr uint32_t fingerprint = WireField<U[N]>::fingerprint;
+
+  static void write(uint8_t * out, const std::array<U, N> & value) noexcept
+  {
+    detail::write_elements<U, N>(out, value.data());
+  }
+
+  static void read(const uint8_t * in, std::array<U, N> & value) noexcept
+  {
+    detail::read_elements<U, N>(in, value.data());
+  }
+};
+
+template<typename U, size_t N>
+struct WireField<U[N]>
+{
+  static constexpr size_t size = N * WireField<U>::size;
+  static constexpr uint32_t fingerprint = fingerprint_mix(fingerprint_mix(fingerprint_of("array"), N),
+                                                          WireField<U>::fingerprint);
+
+  static void write(uint8_t * out, const U (&value)[N]) noexcept
+  {
+    detail::write_elements<U, N>(out, value);
+  }
+
+  static void read(const uint8_t * in, U (&value)[N]) noexcept
+  {
+    detail::read_elements<U, N>(in, value);
+  }
+};
+
+namespace detail
+{
+
+template<typename T>
+using SchemaFields = typename std::decay<decltype(Schema<T>::fields)>::type;
+
+template<typename T, size_t I>
+using FieldType = typename member_type<typename std::tuple_element<I, SchemaFields<T>>::type>::type;
+
+template<typename T, size_t... Before>
+constexpr size_t fields_size(std::index_sequence<Before...>) noexcept
+{
+  return (size_t{0} + ... + WireField<FieldType<T, Before>>::size);
+}
+
+template<typename T, size_t... I>
+constexpr uint32_t fields_fingerprint(std::index_sequence<I...>) noexcept
+{
+  auto hash = fingerprint_of("schema");
+  ((hash = fingerprint_mix(hash, WireField<FieldType<T, I>>::fingerprint)), ...);
+  return hash;
+}
+
+} // namespace detail
+
+/**
+ * @brief Layout of a struct with a Schema: the fields one after the other, at offsets computed at compile time
+ */
+template<typename T>
+struct SchemaLayout
+{
+  static constexpr size_t field_count = std::tuple_size<detail::SchemaFields<T>>::value;
+
+  /** offset of the field I */
+  template<size_t I>
+  static constexpr size_t offset = detail::fields_size<T>(std::make_index_sequence<I>());
+
+  static constexpr size_t size = detail::fields_size<T>(std::make_index_sequence<field_count>());
+
+  /** hash of the kind and size of the fields, in order */
+  static constexpr uint32_t fingerprint = detail::fields_fingerprint<T>(std::make_index_sequence<field_count>());
+
+  static void write(uint8_t * out, const T & data) noexcept
+  {
+    write(out, data, std::make_index_sequence<field_count>());
+  }
+
+  static void read(const uint8_t * in, T & data) noexcept
+  {
+    read(in, data, std::make_index_sequence<field_count>());
+  }
+
+private:
+  template<size_t... I>
+  static void write(uint8_t * out, const T & data, std::index_sequence<I...>) noexcept
+  {
+    (WireField<detail::FieldType<T, I>>::write(out + offset<I>, data.*std::get<I>(Schema<T>::fields)), ...);
+  }
+
+  template<size_t... I>
+  static void read(const uint8_t * in, T & data, std::index_sequence<I...>) noexcept
+  {
+    (WireField<detail::FieldType<T, I>>::read(in + offset<I>, data.*std::get<I>(Schema<T>::fields)), ...);
+  }
+};
+
+template<typename U>
+struct WireField<U, typename std::enable_if<detail::has_schema<U>::value>::type>
+{
+  static constexpr size_t size = SchemaLayout<U>::size;
+  static constexpr uint32_t fingerprint = SchemaLayout<U>::fingerprint;
+
+  static void write(uint8_t * out, const U & value) noexcept
+  {
+    SchemaLayout<U>::write(out, value);
+  }
+
+  static void read(const uint8_t * in, U & value) noexcept
+  {
+    SchemaLayout<U>::read(in, value);
+  }
+};
+
+/**
+ * @brief Codec of the types with a Schema, every object is encoded in exactly max_encoded_size bytes
+ * @details Unlike MemcpyCodec, the encoding does not depend on the architecture or on the padding of T
+ */
+template<typename T>
+struct SchemaCodec
+{
+  static constexpr const char * name = "schema";
+  static constexpr size_t max_encoded_size = SchemaLayout<T>::size;
+  static constexpr uint32_t fingerprint = SchemaLayout<T>::fingerprint;
+
+  static_assert(MessageHeader::size + max_encoded_size <= max_udp_payload,
+                "UDPDataLink::SchemaCodec: the encoded object does not fit in one datagram");
+
+  static void encode(const T & data, std::vector<uint8_t> & buffer)
+  {
+    buffer.clear();
+    encode_append(data, buffer);
+  }
+
+  static void encode_append(const T & data, std::vector<uint8_t> & buffer)
+  {
+    const auto offset = buffer.size();
+    buffer.resize(offset + max_encoded_size);
+    SchemaLayout<T>::write(buffer.data() + offset, data);
+  }
+
+  static bool decode(const uint8_t * buffer, size_t size, T & data)
+  {
+    if(size != max_encoded_size) return false;
+    SchemaLayout<T>::read(buffer, data);
+    return true;
+  }
+};
+
+} // namespace UDPDataLink
@@ -0,0 +1,306 @@
+/**
+ * @file Topics.h
+ * @brief several typed streams of updates over one socket and one reception thread
+ * @details A TopicServer carries the updates of any number of TopicPublisher, each with its own type and topic id. A
+ * TopicClient dispatches the updates it receives to the TopicReceiver registered for their topic, found by indexing a
+ * table with the topic id of the MessageHeader. Topic ids are meant to be small consecutive numbers.
+ */
+#pragma once
+#include "Channel.h"
+#include <condition_variable>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <udp_client.h>
+#include <udp_server.h>
+#include <utility>
+#include <vector>
+
+namespace UDPDataLink
+{
+
+namespace detail
+{
+
+template<typename Entry>
+void register_topic(std::vector<Entry *> & table, TopicId topic, Entry * entry, const char * owner)
+{
+  if(topic >= table.size()) table.resize(topic + 1, nullptr);
+  if(table[topic] != nullptr)
+  {
+    throw std::invalid_argument(std::string(owner) + ": topic " + std::to_string(topic) + " is already registered");
+  }
+  table[topic] = entry;
+}
+
+template<typename Entry>
+void unregister_topic(std::vector<Entry *> & table, TopicId topic, Entry * entry) noexcept
+{
+  if(topic < table.size() && table[topic] == entry) table[topic] = nullptr;
+}
+
+} // namespace detail
+
+/**
+ * @brief A UDPServer publishing the updates of several TopicPublisher to all its clients
+ * @details like Publisher, subscribers silent for default_client_timeout are removed
+ */
+class TopicServer : public UDPServer
+{
+public:
+  template<typename... Args>
+  TopicServer(Args &&... args) : UDPServer(std::forward<Args>(args)...)
+  {
+    set_subscription_required(true);
+    set_client_timeout(default_client_timeout);
+  }
+
+  /**
+   * @brief send an update to every client, see ChannelWriter
+   * @details a client falling behind gets the latest update of each topic, or the last keyframe and the latest delta
+   */
+  void publish(TopicId topic, SharedBuffer update, bool keyframe = false)
+  {
+    send_data(std::move(update), topic, keyframe);
+  }
+
+  /** @throw std::invalid_argument if another writer already has the same topic */
+  void register_writer(ChannelWriterBase & writer)
+  {
+    std::lock_guard<std::mutex> lock(writers_mutex_);
+    detail::register_topic(writers_, writer.topic(), &writer, "TopicServer");
+  }
+
+  void unregister_writer(ChannelWriterBase & writer)
+  {
+    std::lock_guard<std::mutex> lock(writers_mutex_);
+    detail::unregister_topic(writers_, writer.topic(), &writer);
+  }
+
+protected:
+  void reception_callback(const uint8_t *, size_t) override {}
+
+  void control_callback(const ControlHeader & header, size_t) override
+  {
+    if(header.type != ControlType::KeyframeRequest) return;
+    std::lock_guard<std::mutex> lock(writers_mutex_);
+    if(header.topic < writers_.size() && writers_[header.topic]) writers_[header.topic]->request_keyframe();
+  }
+
+  void subscription_callback(const ControlHeader & header,
+                             const SubscribeRequest & request,
+                             SubscribeReply & reply) override
+  {
+    std::lock_guard<std::mutex> lock(writers_mutex_);
+    if(header.topic >= writers_.size() || writers_[header.topic] == nullptr)
+    {
+      reply.status = SubscribeStatus::UnknownTopic;
+      return;
+    }
+    const auto & writer = *writers_[header.topic];
+    reply.offer(request, writer.fingerprint(), writer.max_update_size());
+  }
+
+  std::mutex writers_mutex_;
+  std::vector<ChannelWriterBase *> writers_;
+};
+
+/**
+ * @brief Publish objects of type T on a topic of a TopicServer
+ */
+template<typename T, typename Codec = DefaultCodec<T>>
+class TopicPublisher : public ChannelWriter<T, Codec>
+{
+public:
+  /** @throw std::invalid_argument if the topic is already published on this server */
+  TopicPublisher(TopicServer & server, TopicId topic) : ChannelWriter<T, Codec>(topic), server_(server)
+  {
+    server_.register_writer(*this);
+  }
+
+  ~TopicPublisher() override
+  {
+    this->stop_async();
+    server_.unregister_writer(*this);
+  }
+
+  void update_data(const T & data)
+  {
+    this->write(data);
+  }
+
+  void update_data(T && data)
+  {
+    this->write(std::move(data));
+  }
+
+protected:
+  void send_update(SharedBuffer update, bool keyframe) override
+  {
+    server_.publish(this->topic(), std::move(update), keyframe);
+  }
+
+private:
+  TopicServer & server_;
+};
+
+/**
+ * @brief Interface of the readers a TopicClient dispatches updates to
+ */
+class TopicHandler
+{
+public:
+  virtual ~TopicHandler() = default;
+
+  /**
+   * @brief decode an update of the topic of the handler
+   * @param [in] receive_time receive timestamp of the update, 0 if not available
+   * @return true if a keyframe should be requested to the publisher
+   */
+  virtual bool dispatch(const MessageHeader & header, const uint8_t * buffer, size_t size, int64_t receive_time) = 0;
+
+  /** @brief fingerprint of the encoding the handler decodes, see type_fingerprint(), 0 to accept any */
+  virtual uint32_t fingerprint() const noexcept
+  {
+    return 0;
+  }
+};
+
+/**
+ * @brief A UDPClient receiving the updates of all the topics of a TopicServer
+ * @details like Receiver, a heartbeat is sent every default_heartbeat_period
+ */
+class TopicClient : public UDPClient
+{
+public:
+  template<typename... Args>
+  TopicClient(Args &&... args) : UDPClient(std::forward<Args>(args)...)
+  {
+    set_heartbeat(default_heartbeat_period);
+  }
+
+  /**
+   * @brief dispatch the updates of topic to handler, and subscribe to it
+   * @throw std::invalid_argument if another handler already has the same topic
+   */
+  void register_handler(TopicId topic, TopicHandler & handler)
+  {
+    {
+      std::lock_guard<std::mutex> lock(handlers_mutex_);
+      detail::register_topic(handlers_, topic, &handler, "TopicClient");
+    }
+    const auto codec = handler.fingerprint();
+    subscribe(topic, codec != 0 ? std::vector<uint32_t>{codec} : std::vector<uint32_t>{});
+  }
+
+  /**
+   * @brief stop dispatching the updates of topic to handler
+   * @details waits for an update being dispatched to handler to be done, unless called from the callbacks of that
+   * update. The callbacks of a handler can register and unregister the other handlers, but not destroy their own
+   */
+  void unregister_handler(TopicId topic, TopicHandler & handler)
+  {
+    std::unique_lock<std::mutex> lock(handlers_mutex_);
+    detail::unregister_topic(handlers_, topic, &handler);
+    dispatch_done_.wait(lock, [&]
+                        { return dispatching_ != &handler || dispatching_thread_ == std::this_thread::get_id(); });
+  }
+
+  /** @brief number of datagrams that are not updates */
+  uint64_t invalid_updates() const noexcept
+  {
+    return invalid_updates_;
+  }
+
+  /** @brief number of updates received for a topic without handler */
+  uint64_t unknown_topics() const noexcept
+  {
+    return unknown_topics_;
+  }
+
+protected:
+  using UDPClient::reception_callback;
+
+  void reception_callback(const uint8_t * buffer, size_t size, int64_t receive_time) override
+  {
+    MessageHeader header;
+    if(!MessageHeader::read(buffer, size, header))
+    {
+      ++invalid_updates_;
+      return;
+    }
+    TopicHandler * handler = nullptr;
+    {
+      std::lock_guard<std::mutex> lock(handlers_mutex_);
+      if(header.topic >= handlers_.size() || handlers_[header.topic] == nullptr)
+      {
+        ++unknown_topics_;
+        return;
+      }
+      // Dispatched without the lock so that the callbacks can register and unregister handlers, unregister_handler()
+      // waits for it instead
+      handler = handlers_[header.topic];
+      dispatching_ = handler;
+      dispatching_thread_ = std::this_thread::get_id();
+    }
+    const bool keyframe_needed = handler->dispatch(header, buffer + MessageHeader::size, size - MessageHeader::size,
+                                                   receive_time);
+    {
+      std::lock_guard<std::mutex> lock(handlers_mutex_);
+      dispatching_ = nullptr;
+    }
+    dispatch_done_.notify_all();
+    if(keyframe_needed) send_control(ControlType::KeyframeRequest, header.topic);
+  }
+
+  std::mutex handlers_mutex_;
+  std::vector<TopicHandler *> handlers_;
+  // The UDP and shared memory threads never call reception_callback at the same time, one update is dispatched at once
+  std::condition_variable dispatch_done_;
+  TopicHandler * dispatching_ = nullptr;
+  std::thread::id dispatching_thread_;
+  std::atomic<uint64_t> invalid_updates_{0};
+  std::atomic<uint64_t> unknown_topics_{0};
+};
+
+/**
+ * @brief Receive objects of type T from a topic of a TopicClient
+ */
+template<typename T, typename Codec = DefaultCodec<T>>
+class TopicReceiver : public ChannelReader<T, Codec>, public TopicHandler
+{
+public:
+  /** @throw std::invalid_argument if the topic is already received by this client */
+  TopicReceiver(TopicClient & client, TopicId topic) : client_(client), topic_(topic)
+  {
+    client_.register_handler(topic_, *this);
+  }
+
+  ~TopicReceiver() override
+  {
+    client_.unregister_handler(topic_, *this);
+  }
+
+  TopicId topic() const noexcept
+  {
+    return topic_;
+  }
+
+  uint32_t fingerprint() const noexcept override
+  {
+    return type_fingerprint<T, Codec>();
+  }
+
+  bool dispatch(const MessageHeader & header, const uint8_t * buffer, size_t size, int64_t receive_time) override
+  {
+    return this->handle_update(header, buffer, size, receive_time) == DecodeStatus::MissingKeyframe
+           && this->keyframe_request_due();
+  }
+
+private:
+  TopicClient & client_;
+  TopicId topic_;
+};
+
+} // namespace UDPDataLink
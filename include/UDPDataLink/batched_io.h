@@ -0,0 +1,109 @@
+/**
+ * @file batched_io.h
+ * @brief batched datagram I/O with sendmmsg/recvmmsg
+ * @details Only available on Linux, batched_io_supported() returns false elsewhere and UDPServer/UDPClient then keep
+ * using one asio operation per datagram.
+ */
+#pragma once
+#include <boost/asio/buffer.hpp>
+#include <boost/asio/ip/udp.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace UDPDataLink
+{
+
+/** @brief true if sendmmsg/recvmmsg can be used on this platform */
+bool batched_io_supported() noexcept;
+
+/**
+ * @brief Queue datagrams and send them with as few sendmmsg calls as possible
+ * @details The queued buffers are not copied, they must stay valid until flush() returns
+ */
+class BatchSender
+{
+public:
+  explicit BatchSender(size_t batch_size = 64);
+  ~BatchSender();
+  BatchSender(const BatchSender &) = delete;
+  BatchSender & operator=(const BatchSender &) = delete;
+
+  /** @brief queue a datagram made of header followed by payload, header may be empty */
+  void add(const boost::asio::ip::udp::endpoint & destination,
+           boost::asio::const_buffer header,
+           boost::asio::const_buffer payload);
+
+  /**
+   * @brief send every queued datagram
+   * @param [in] fd native handle of the socket
+   * @return number of datagrams sent, the others were dropped because of an error
+   */
+  size_t flush(int fd);
+
+  /** @brief number of datagrams queued */
+  size_t size() const noexcept;
+
+  /** @brief number of system calls made since construction */
+  size_t syscalls() const noexcept
+  {
+    return syscalls_;
+  }
+
+private:
+  struct Impl;
+  std::unique_ptr<Impl> impl_;
+  size_t batch_size_;
+  size_t syscalls_ = 0;
+};
+
+/**
+ * @brief Receive up to batch_size datagrams with a single recvmmsg call
+ */
+class BatchReceiver
+{
+public:
+  BatchReceiver(size_t batch_size = 64, size_t buffer_size = 1024);
+  ~BatchReceiver();
+  BatchReceiver(const BatchReceiver &) = delete;
+  BatchReceiver & operator=(const BatchReceiver &) = delete;
+
+  /** @brief size of each reception buffer, datagrams larger than this are truncated */
+  void resize_buffers(size_t buffer_size);
+
+  size_t buffer_size() const noexcept
+  {
+    return buffer_size_;
+  }
+
+  /**
+   * @brief read the datagrams waiting on the socket, without blocking
+   * @param [in] fd native handle of the socket
+   * @return number of datagrams read, 0 if none was waiting or on error
+   */
+  size_t receive(int fd);
+
+  const uint8_t * data(size_t index) const noexcept;
+  size_t size(size_t index) const noexcept;
+  /** @brief true if the datagram did not fit in the buffer */
+  bool truncated(size_t index) const noexcept;
+  boost::asio::ip::udp::endpoint sender(size_t index) const;
+  /** @brief receive timestamp of the datagram in nanoseconds, 0 unless enabled on the socket, see low_latency.h */
+  int64_t timestamp(size_t index) const noexcept;
+
+  /** @brief number of system calls made since construction */
+  size_t syscalls() const noexcept
+  {
+    return syscalls_;
+  }
+
+private:
+  struct Impl;
+  std::unique_ptr<Impl> impl_;
+  size_t batch_size_;
+  size_t buffer_size_;
+  size_t syscalls_ = 0;
+};
+
+} // namespace UDPDataLink
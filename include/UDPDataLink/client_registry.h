@@ -0,0 +1,153 @@
+/**
+ * @file client_registry.h
+ * @brief clients of a UDPServer, indexed by endpoint
+ */
+#pragma once
+#include <boost/asio/ip/udp.hpp>
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+namespace UDPDataLink
+{
+
+struct EndpointHash
+{
+  size_t operator()(const boost::asio::ip::udp::endpoint & endpoint) const noexcept
+  {
+    const auto & address = endpoint.address();
+    if(address.is_v4())
+    {
+      return std::hash<uint64_t>{}(static_cast<uint64_t>(address.to_v4().to_uint()) << 16 | endpoint.port());
+    }
+    const auto bytes = address.to_v6().to_bytes();
+    uint64_t high = 0, low = 0;
+    std::memcpy(&high, bytes.data(), 8);
+    std::memcpy(&low, bytes.data() + 8, 8);
+    return std::hash<uint64_t>{}(high ^ (low * 0x9e3779b97f4a7c15ULL) ^ endpoint.port());
+  }
+};
+
+/**
+ * @brief Clients stored contiguously for fast iteration, with constant time lookup by endpoint
+ * @details Removing a client moves the last one to its place, pointers to entries are invalidated by insert() and
+ * erase(). The client objects themselves are shared pointers and can be kept alive by pending operations.
+ */
+template<typename Client>
+class ClientRegistry
+{
+public:
+  using clock = std::chrono::steady_clock;
+  using endpoint_type = boost::asio::ip::udp::endpoint;
+
+  struct Entry
+  {
+    endpoint_type endpoint;
+    std::shared_ptr<Client> client;
+    clock::time_point connected;
+    clock::time_point last_seen;
+  };
+
+  Entry * find(const endpoint_type & endpoint) noexcept
+  {
+    const auto it = index_.find(endpoint);
+    return it == index_.end() ? nullptr : &entries_[it->second];
+  }
+
+  Entry & insert(const endpoint_type & endpoint, std::shared_ptr<Client> client, clock::time_point now)
+  {
+    index_.emplace(endpoint, entries_.size());
+    entries_.push_back(Entry{endpoint, std::move(client), now, now});
+    return entries_.back();
+  }
+
+  /** @return false if no client has this endpoint */
+  bool erase(const endpoint_type & endpoint)
+  {
+    const auto it = index_.find(endpoint);
+    if(it == index_.end()) return false;
+    erase_at(it->second);
+    return true;
+  }
+
+  /**
+   * @brief remove the clients not seen for more than timeout
+   * @param [in] on_expired called with each removed entry before its removal
+   * @return number of clients removed
+   */
+  template<typename Callback>
+  size_t expire(clock::time_point now, clock::duration timeout, Callback && on_expired)
+  {
+    size_t removed = 0;
+    for(size_t i = 0; i < entries_.size();)
+    {
+      if(now - entries_[i].last_seen > timeout)
+      {
+        on_expired(entries_[i]);
+        erase_at(i);
+        ++removed;
+      }
+      else
+      {
+        ++i;
+      }
+    }
+    return removed;
+  }
+
+  size_t size() const noexcept
+  {
+    return entries_.size();
+  }
+
+  bool empty() const noexcept
+  {
+    return entries_.empty();
+  }
+
+  void clear()
+  {
+    entries_.clear();
+    index_.clear();
+  }
+
+  typename std::vector<Entry>::iterator begin() noexcept
+  {
+    return entries_.begin();
+  }
+
+  typename std::vector<Entry>::iterator end() noexcept
+  {
+    return entries_.end();
+  }
+
+  typename std::vector<Entry>::const_iterator begin() const noexcept
+  {
+    return entries_.begin();
+  }
+
+  typename std::vector<Entry>::const_iterator end() const noexcept
+  {
+    return entries_.end();
+  }
+
+private:
+  void erase_at(size_t position)
+  {
+    index_.erase(entries_[position].endpoint);
+    if(position + 1 != entries_.size())
+    {
+      entries_[position] = std::move(entries_.back());
+      index_[entries_[position].endpoint] = position;
+    }
+    entries_.pop_back();
+  }
+
+  std::vector<Entry> entries_;
+  std::unordered_map<endpoint_type, size_t, EndpointHash> index_;
+};
+
+} // namespace UDPDataLink
@@ -0,0 +1,83 @@
+/**
+ * @file control.h
+ * @brief control messages sent by clients to a UDPServer, and the answers of the server to their subscriptions
+ * @details A control message starts with a 8 bytes header: a magic number, the message type, flags, the topic the
+ * message refers to (see Topics.h) and two reserved bytes.
+ * Datagrams not starting with this header are not control messages and are handed over to the server as they are.
+ */
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+namespace UDPDataLink
+{
+
+enum class ControlType : uint8_t
+{
+  /** keeps the client registered, see UDPServer::set_client_timeout() */
+  Heartbeat = 1,
+  /** removes the client from the server */
+  Unsubscribe = 2,
+  /** asks a Publisher in delta mode to send a keyframe, see Delta.h */
+  KeyframeRequest = 3,
+  /** acknowledges reliable messages, followed by an AckPayload, see reliability.h */
+  Ack = 4,
+  /** same as Ack, sent when reliable messages are missing so that the server retransmits them right away */
+  Nack = 5,
+  /** sets the maximum rate at which the server sends messages to the client, followed by a RatePayload, see
+     rate_limit.h. Also keeps the client registered */
+  RateRequest = 6,
+  /** tells the server that the client reads its messages from shared memory, followed by a SharedMemoryPayload, see
+     shared_memory.h. Also keeps the client registered */
+  SharedMemory = 7,
+  /** subscribes the client to the stream of the topic, followed by a SubscribeRequest, see subscription.h. Also keeps
+     the client registered */
+  Subscribe = 8,
+  /** sent by the server to answer a Subscribe, followed by a SubscribeReply */
+  SubscribeReply = 9,
+};
+
+struct ControlHeader
+{
+  static constexpr uint16_t magic = 0x4355; // "UC" on the wire
+  static constexpr size_t size = 8;
+  /** set by a client accepting reliable messages, see UDPClient::set_reliable_messages() */
+  static constexpr uint8_t reliable_flag = 1;
+
+  ControlType type = ControlType::Heartbeat;
+  /** topic of the updates the message refers to, 0 when the server publishes a single stream */
+  uint16_t topic = 0;
+  uint8_t flags = 0;
+
+  /** @brief write the header to the beginning of buffer, which must hold at least size bytes */
+  void write(uint8_t * buffer) const noexcept
+  {
+    buffer[0] = static_cast<uint8_t>(magic);
+    buffer[1] = static_cast<uint8_t>(magic >> 8);
+    buffer[2] = static_cast<uint8_t>(type);
+    buffer[3] = flags;
+    buffer[4] = static_cast<uint8_t>(topic);
+    buffer[5] = static_cast<uint8_t>(topic >> 8);
+    buffer[6] = 0;
+    buffer[7] = 0;
+  }
+
+  /**
+   * @brief read the header at the beginning of a datagram
+   * @return false if the datagram is not a control message
+   */
+  static bool read(const uint8_t * buffer, size_t size, ControlHeader & header) noexcept
+  {
+    if(size < ControlHeader::size || buffer[0] != static_cast<uint8_t>(magic)
+       || buffer[1] != static_cast<uint8_t>(magic >> 8))
+    {
+      return false;
+    }
+    header.type = static_cast<ControlType>(buffer[2]);
+    header.flags = buffer[3];
+    header.topic = static_cast<uint16_t>(buffer[4] | buffer[5] << 8);
+    return true;
+  }
+};
+
+} // namespace UDPDataLink
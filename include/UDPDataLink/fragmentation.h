@@ -0,0 +1,168 @@
+/**
+ * @file fragmentation.h
+ * @brief application level fragmentation of messages larger than one datagram
+ * @details A fragmented message is sent as a sequence of datagrams, each starting with a FragmentHeader giving the
+ * message id, the index of the chunk and the total number of chunks. The receiver reassembles them with a Reassembler.
+ */
+#pragma once
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace UDPDataLink
+{
+
+/** @brief largest payload of an IPv4 UDP datagram */
+constexpr size_t max_udp_payload = 65507;
+
+/** @brief largest UDP payload fitting in an Ethernet frame without IP fragmentation */
+constexpr size_t ethernet_udp_payload = 1472;
+
+/** @brief largest message reassembled unless configured otherwise, see Reassembler::set_max_message_size() */
+constexpr size_t default_max_message_size = 64 * 1024 * 1024;
+
+/**
+ * @brief header put in front of every chunk of a fragmented message
+ */
+struct FragmentHeader
+{
+  static constexpr uint16_t magic = 0x4655; // "UF" on the wire
+  static constexpr size_t size = 14;
+  using Bytes = std::array<uint8_t, size>;
+
+  uint32_t message_id = 0;
+  uint16_t index = 0;
+  uint16_t count = 0;
+  uint32_t total_size = 0;
+
+  /** @brief write the header, in little endian, to the beginning of buffer */
+  void write(uint8_t * buffer) const noexcept;
+
+  Bytes bytes() const noexcept
+  {
+    Bytes out;
+    write(out.data());
+    return out;
+  }
+
+  /**
+   * @brief read the header at the beginning of a datagram
+   * @return false if the datagram does not start with a valid header
+   */
+  static bool read(const uint8_t * buffer, size_t size, FragmentHeader & header) noexcept;
+
+  /** @brief number of payload bytes carried by each chunk of a datagram of max_datagram_size bytes */
+  static constexpr size_t chunk_size(size_t max_datagram_size) noexcept
+  {
+    return max_datagram_size - size;
+  }
+
+  /** @brief number of chunks needed to send message_size bytes */
+  static constexpr size_t chunk_count(size_t message_size, size_t max_datagram_size) noexcept
+  {
+    return message_size == 0 ? 1 : (message_size + chunk_size(max_datagram_size) - 1) / chunk_size(max_datagram_size);
+  }
+};
+
+/**
+ * @brief compute the headers of every chunk of a message
+ * @param [in] message_id identifier shared by all the chunks
+ * @param [in] size size of the message
+ * @param [in] max_datagram_size maximum size of each datagram, header included
+ * @param [out] headers resized to the number of chunks, filled with their headers
+ */
+void make_fragment_headers(uint32_t message_id,
+                           size_t size,
+                           size_t max_datagram_size,
+                           std::vector<FragmentHeader::Bytes> & headers);
+
+/**
+ * @brief Reassemble fragmented messages
+ * @details Messages being reassembled are kept in a fixed number of slots whose buffers are reused from one message to
+ * the next. A message that is still incomplete after the timeout is evicted, as is the oldest message when a new one
+ * arrives and all slots are busy.
+ */
+class Reassembler
+{
+public:
+  using clock = std::chrono::steady_clock;
+
+  /**
+   * @param [in] timeout time after which an incomplete message is dropped
+   * @param [in] slots maximum number of messages being reassembled at the same time
+   * @param [in] max_message_size messages announced larger than this are dropped
+   */
+  explicit Reassembler(std::chrono::milliseconds timeout = std::chrono::milliseconds(100),
+                       size_t slots = 4,
+                       size_t max_message_size = default_max_message_size);
+
+  void set_timeout(std::chrono::milliseconds timeout) noexcept
+  {
+    timeout_ = timeout;
+  }
+
+  /** @brief drop the messages announced larger than max_message_size, before allocating anything for them */
+  void set_max_message_size(size_t max_message_size) noexcept
+  {
+    max_message_size_ = max_message_size;
+  }
+
+  /**
+   * @brief process a received datagram
+   * @param [in] datagram the datagram, starting with a FragmentHeader
+   * @param [in] size size of the datagram
+   * @param [out] message set to the reassembled message, valid until the next call
+   * @param [out] message_size set to the size of the reassembled message
+   * @return true if the datagram completed a message
+   */
+  bool push(const uint8_t * datagram, size_t size, const uint8_t *& message, size_t & message_size);
+
+  /** @brief drop the messages that are incomplete since more than the timeout */
+  void evict_expired(clock::time_point now);
+
+  /** @brief number of messages fully reassembled */
+  size_t completed() const noexcept
+  {
+    return completed_;
+  }
+
+  /** @brief number of incomplete messages dropped, either on timeout or to make room */
+  size_t evicted() const noexcept
+  {
+    return evicted_;
+  }
+
+  /** @brief number of datagrams rejected because of an invalid header */
+  size_t invalid() const noexcept
+  {
+    return invalid_;
+  }
+
+private:
+  struct Slot
+  {
+    bool in_use = false;
+    uint32_t message_id = 0;
+    uint16_t count = 0;
+    uint16_t received = 0;
+    uint32_t total_size = 0;
+    // Payload size of every chunk but the last one, 0 until a chunk is received
+    size_t chunk_size = 0;
+    clock::time_point first_seen;
+    std::vector<uint8_t> data;
+    std::vector<bool> chunks;
+  };
+
+  Slot & acquire(const FragmentHeader & header, clock::time_point now);
+
+  std::chrono::milliseconds timeout_;
+  size_t max_message_size_;
+  std::vector<Slot> slots_;
+  size_t completed_ = 0;
+  size_t evicted_ = 0;
+  size_t invalid_ = 0;
+};
+
+} // namespace UDPDataLink
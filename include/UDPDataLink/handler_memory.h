@@ -0,0 +1,148 @@
+/**
+ * @file handler_memory.h
+ * @brief memory reused by the handlers of asynchronous operations
+ * @details asio allocates each operation started outside of the io_service threads on the heap. Binding the handler
+ * to a HandlerMemory makes asio take the memory from blocks that are recycled once the handler completes, so that
+ * steady state sends do not allocate.
+ */
+#pragma once
+#include <boost/asio/associated_allocator.hpp>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace UDPDataLink
+{
+
+/**
+ * @brief Blocks of memory allocated once and recycled, thread safe
+ * @details The number of blocks grows up to the number of operations in flight at once and is then kept.
+ */
+class HandlerMemory
+{
+public:
+  void * allocate(size_t size)
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for(auto & block : blocks_)
+    {
+      if(!block.in_use && block.size >= size)
+      {
+        block.in_use = true;
+        return block.data.get();
+      }
+    }
+    const auto count = (size + sizeof(std::max_align_t) - 1) / sizeof(std::max_align_t);
+    blocks_.push_back(Block{std::make_unique<std::max_align_t[]>(count), count * sizeof(std::max_align_t), true});
+    return blocks_.back().data.get();
+  }
+
+  void deallocate(void * pointer) noexcept
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for(auto & block : blocks_)
+    {
+      if(block.data.get() == pointer) block.in_use = false;
+    }
+  }
+
+private:
+  struct Block
+  {
+    std::unique_ptr<std::max_align_t[]> data;
+    size_t size;
+    bool in_use;
+  };
+
+  std::mutex mutex_;
+  std::vector<Block> blocks_;
+};
+
+/**
+ * @brief Allocator taking its memory from a HandlerMemory, which it keeps alive
+ * @details the operation memory is released after its handler is destroyed, possibly along with the object owning
+ * the HandlerMemory
+ */
+template<typename T>
+class HandlerAllocator
+{
+public:
+  using value_type = T;
+
+  explicit HandlerAllocator(std::shared_ptr<HandlerMemory> memory) noexcept : memory_(std::move(memory)) {}
+
+  template<typename U>
+  HandlerAllocator(const HandlerAllocator<U> & other) noexcept : memory_(other.memory_)
+  {
+  }
+
+  T * allocate(size_t n)
+  {
+    return static_cast<T *>(memory_->allocate(sizeof(T) * n));
+  }
+
+  void deallocate(T * pointer, size_t) noexcept
+  {
+    memory_->deallocate(pointer);
+  }
+
+  template<typename U>
+  bool operator==(const HandlerAllocator<U> & other) const noexcept
+  {
+    return memory_ == other.memory_;
+  }
+
+  template<typename U>
+  bool operator!=(const HandlerAllocator<U> & other) const noexcept
+  {
+    return memory_ != other.memory_;
+  }
+
+private:
+  template<typename>
+  friend class HandlerAllocator;
+
+  std::shared_ptr<HandlerMemory> memory_;
+};
+
+/**
+ * @brief Handler whose operation is allocated by a HandlerAllocator, see bind_handler_memory()
+ */
+template<typename Handler>
+class AllocatingHandler
+{
+public:
+  using allocator_type = HandlerAllocator<Handler>;
+
+  AllocatingHandler(std::shared_ptr<HandlerMemory> memory, Handler handler)
+  : memory_(std::move(memory)), handler_(std::move(handler))
+  {
+  }
+
+  allocator_type get_allocator() const noexcept
+  {
+    return allocator_type(memory_);
+  }
+
+  template<typename... Args>
+  void operator()(Args &&... args)
+  {
+    handler_(std::forward<Args>(args)...);
+  }
+
+private:
+  std::shared_ptr<HandlerMemory> memory_;
+  Handler handler_;
+};
+
+template<typename Handler>
+AllocatingHandler<typename std::decay<Handler>::type> bind_handler_memory(std::shared_ptr<HandlerMemory> memory,
+                                                                           Handler && handler)
+{
+  return AllocatingHandler<typename std::decay<Handler>::type>(std::move(memory), std::forward<Handler>(handler));
+}
+
+} // namespace UDPDataLink
@@ -0,0 +1,128 @@
+/**
+ * @file io_uring.h
+ * @brief datagram I/O through an io_uring
+ * @details Only available on Linux 6.0 and later, io_uring_supported() returns false elsewhere or when the kernel
+ * refuses to create a ring, UDPServer then falls back to batched I/O and UDPClient to asio. Receiving arms a single
+ * multishot recvmsg on the socket: the kernel picks the buffers from a ring registered once, so that datagrams are read
+ * without any system call and the thread only wakes up when completions are waiting. Sending submits the datagrams of
+ * a fan-out with a single system call, like sendmmsg.
+ */
+#pragma once
+#include <boost/asio/buffer.hpp>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/ip/udp.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+
+namespace UDPDataLink
+{
+
+/** @brief true if the kernel supports the io_uring features used by UringSender and UringReceiver */
+bool io_uring_supported() noexcept;
+
+/**
+ * @brief Queue datagrams and submit their sends to an io_uring at once, same interface as BatchSender
+ * @details The queued buffers are not copied, they must stay valid until flush() returns
+ * @throw std::runtime_error from the constructor if the ring cannot be created
+ */
+class UringSender
+{
+public:
+  explicit UringSender(size_t batch_size = 64);
+  ~UringSender();
+  UringSender(const UringSender &) = delete;
+  UringSender & operator=(const UringSender &) = delete;
+
+  /** @brief queue a datagram made of header followed by payload, header may be empty */
+  void add(const boost::asio::ip::udp::endpoint & destination,
+           boost::asio::const_buffer header,
+           boost::asio::const_buffer payload);
+
+  /**
+   * @brief send every queued datagram and wait for the sends to complete
+   * @param [in] fd native handle of the socket
+   * @return number of datagrams sent, the others were dropped because of an error
+   */
+  size_t flush(int fd);
+
+  /** @brief number of datagrams queued */
+  size_t size() const noexcept;
+
+  /** @brief number of system calls made since construction */
+  size_t syscalls() const noexcept
+  {
+    return syscalls_;
+  }
+
+private:
+  struct Impl;
+  std::unique_ptr<Impl> impl_;
+  size_t batch_size_;
+  size_t syscalls_ = 0;
+};
+
+/**
+ * @brief Receive datagrams with a multishot recvmsg into a ring of provided buffers
+ * @details the datagrams returned by receive() stay valid until the next call, their buffers are then given back to
+ * the kernel. When every buffer is in use the kernel stops the receive and drops the datagrams, async_wait() arms it
+ * again. Receive timestamps are not read.
+ * @throw std::runtime_error from the constructor if the ring cannot be created
+ */
+class UringReceiver
+{
+public:
+  /**
+   * @param [in] io_context the one running the handlers given to async_wait()
+   * @param [in] buffer_count number of reception buffers, rounded up to a power of two
+   * @param [in] buffer_size size of each reception buffer, datagrams larger than this are truncated
+   */
+  UringReceiver(boost::asio::io_context & io_context, size_t buffer_count = 64, size_t buffer_size = 1024);
+  ~UringReceiver();
+  UringReceiver(const UringReceiver &) = delete;
+  UringReceiver & operator=(const UringReceiver &) = delete;
+
+  /**
+   * @brief size of each reception buffer
+   * @details cancels the receive, it is armed again with the new buffers by the next async_wait()
+   */
+  void resize_buffers(size_t buffer_size);
+
+  size_t buffer_size() const noexcept
+  {
+    return buffer_size_;
+  }
+
+  /**
+   * @brief call handler from the io_context once datagrams were received on the socket
+   * @param [in] fd native handle of the socket, the receive is armed on it if it is not yet
+   */
+  void async_wait(int fd, std::function<void(const boost::system::error_code &)> handler);
+
+  /**
+   * @brief read the datagrams received so far, without blocking
+   * @return number of datagrams read
+   */
+  size_t receive();
+
+  const uint8_t * data(size_t index) const noexcept;
+  size_t size(size_t index) const noexcept;
+  /** @brief true if the datagram did not fit in the buffer */
+  bool truncated(size_t index) const noexcept;
+  boost::asio::ip::udp::endpoint sender(size_t index) const;
+
+  /** @brief number of system calls made since construction */
+  size_t syscalls() const noexcept
+  {
+    return syscalls_;
+  }
+
+private:
+  struct Impl;
+  std::unique_ptr<Impl> impl_;
+  size_t buffer_size_;
+  size_t syscalls_ = 0;
+};
+
+} // namespace UDPDataLink
@@ -0,0 +1,76 @@
+/**
+ * @file low_latency.h
+ * @brief socket and thread options trading CPU time for latency, see UDPServer::set_low_latency() and
+ * UDPClient::set_low_latency()
+ * @details Only available on Linux, applying any option elsewhere fails.
+ */
+#pragma once
+#include <boost/asio/io_service.hpp>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace UDPDataLink
+{
+
+/** @brief source of the receive timestamps passed to UDPClient::reception_callback() */
+enum class ReceiveTimestamps
+{
+  None,
+  /** SO_TIMESTAMPNS: time the kernel received the datagram, system clock */
+  Software,
+  /**
+   * SO_TIMESTAMPING: time the network card received the datagram, on the clock of the card, falling back to the
+   * software timestamp. Hardware timestamping must be enabled on the interface beforehand, e.g. with hwstamp_ctl
+   */
+  Hardware
+};
+
+struct LowLatencyOptions
+{
+  /** SO_BUSY_POLL: microseconds the kernel polls the device queue before sleeping on a receive, 0 to disable */
+  int busy_poll_us = 0;
+  /** poll the sockets in a loop instead of sleeping in epoll, each io thread then keeps a core busy */
+  bool spin = false;
+  /** cores the io threads are pinned to, thread i to cpus[i % cpus.size()], empty to leave them unpinned */
+  std::vector<int> cpus;
+  /** SCHED_FIFO priority of the io threads, from 1 to 99, 0 to keep the default scheduling */
+  int fifo_priority = 0;
+  /** SO_RCVBUF and SO_SNDBUF in bytes, 0 to keep the system defaults */
+  int receive_buffer = 0;
+  int send_buffer = 0;
+  ReceiveTimestamps timestamps = ReceiveTimestamps::None;
+};
+
+/**
+ * @brief set the socket options of a LowLatencyOptions
+ * @param [in] fd native handle of the socket
+ * @param [out] error description of the first option that could not be set
+ * @return false if an option could not be set, the following ones are still set
+ */
+bool apply_socket_options(int fd, const LowLatencyOptions & options, std::string & error);
+
+/**
+ * @brief set the affinity and scheduling of an io thread
+ * @param [in] index index of the thread, selects its core in options.cpus
+ * @param [out] error description of the first option that could not be set
+ * @return false if an option could not be set, usually because SCHED_FIFO needs CAP_SYS_NICE
+ */
+bool apply_thread_options(std::thread & thread, const LowLatencyOptions & options, size_t index, std::string & error);
+
+/** @brief run the handlers of io_service until it is stopped, polling in a loop when spin is true */
+void run_io_service(boost::asio::io_service & io_service, bool spin);
+
+/**
+ * @brief receive timestamp held by the control messages of a datagram
+ * @param [in] control msg_control of the msghdr the datagram was received with
+ * @param [in] size msg_controllen of the msghdr
+ * @return nanoseconds since the epoch of the clock of the timestamp, 0 if there is none
+ */
+int64_t receive_timestamp(const void * control, size_t size) noexcept;
+
+/** @brief size of the control buffer needed to receive the timestamps */
+constexpr size_t timestamp_control_size = 128;
+
+} // namespace UDPDataLink
@@ -0,0 +1,29 @@
+/**
+ * @file multicast.h
+ * @brief options of the multicast transport, see UDPServer::set_multicast() and UDPClient::join_multicast()
+ */
+#pragma once
+#include <boost/asio/ip/address_v4.hpp>
+#include <string>
+
+namespace UDPDataLink
+{
+
+struct MulticastOptions
+{
+  /** number of routers the datagrams can cross, 1 keeps them on the local network */
+  int ttl = 1;
+  /** also deliver the datagrams to the receivers running on the sending host */
+  bool loopback = true;
+  /** IPv4 address of the local interface to send from, empty for the one chosen by the system */
+  std::string interface_address;
+};
+
+/** @brief address of a local interface, the one chosen by the system if empty */
+inline boost::asio::ip::address_v4 multicast_interface(const std::string & interface_address)
+{
+  return interface_address.empty() ? boost::asio::ip::address_v4::any()
+                                   : boost::asio::ip::make_address_v4(interface_address);
+}
+
+} // namespace UDPDataLink
@@ -0,0 +1,127 @@
+/**
+ * @file rate_limit.h
+ * @brief maximum rate at which a UDPServer sends messages to a client
+ * @details A client asks for a maximum rate with a RateRequest control message (see control.h) followed by a
+ * RatePayload. The server then sends it at most that many messages per second, using a TokenBucket: when a message
+ * arrives and no token is left, it waits for the next token, replaced by any newer message of the same stream meanwhile.
+ * The burst is the number of messages that can be sent back to back, a burst of 1 evenly paces the sends.
+ */
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+namespace UDPDataLink
+{
+
+/**
+ * @brief content of the RateRequest control messages, after the ControlHeader
+ */
+struct RatePayload
+{
+  static constexpr size_t size = 8;
+
+  /** messages per second, 0 for no limit */
+  double rate = 0;
+  /** messages that can be sent back to back */
+  uint32_t burst = 1;
+
+  void write(uint8_t * buffer) const noexcept
+  {
+    // The rate is sent in millihertz
+    const auto millihertz = static_cast<uint32_t>(std::clamp(rate * 1000., 0., 4294967295.));
+    for(size_t i = 0; i < 4; ++i)
+    {
+      buffer[i] = static_cast<uint8_t>(millihertz >> (8 * i));
+      buffer[4 + i] = static_cast<uint8_t>(burst >> (8 * i));
+    }
+  }
+
+  /** @return false if the message is too short */
+  static bool read(const uint8_t * buffer, size_t size, RatePayload & payload) noexcept
+  {
+    if(size < RatePayload::size) return false;
+    uint32_t millihertz = 0;
+    payload.burst = 0;
+    for(size_t i = 0; i < 4; ++i)
+    {
+      millihertz |= static_cast<uint32_t>(buffer[i]) << (8 * i);
+      payload.burst |= static_cast<uint32_t>(buffer[4 + i]) << (8 * i);
+    }
+    payload.rate = millihertz / 1000.;
+    payload.burst = std::max<uint32_t>(payload.burst, 1);
+    return true;
+  }
+};
+
+/**
+ * @brief Token bucket refilled at a fixed rate, holding at most burst tokens
+ * @details the clock is only read when a rate is set. Not thread safe.
+ */
+class TokenBucket
+{
+public:
+  using clock = std::chrono::steady_clock;
+
+  /**
+   * @param [in] rate tokens added per second, 0 for no limit
+   * @param [in] burst maximum number of tokens, the bucket starts full
+   */
+  void set_rate(double rate, size_t burst = 1) noexcept
+  {
+    rate_ = std::max(rate, 0.);
+    burst_ = static_cast<double>(std::max<size_t>(burst, 1));
+    tokens_ = burst_;
+    last_refill_ = clock::now();
+  }
+
+  double rate() const noexcept
+  {
+    return rate_;
+  }
+
+  size_t burst() const noexcept
+  {
+    return static_cast<size_t>(burst_);
+  }
+
+  bool limited() const noexcept
+  {
+    return rate_ > 0;
+  }
+
+  /** @return true if a token was available and taken */
+  bool take(clock::time_point now) noexcept
+  {
+    if(!limited()) return true;
+    refill(now);
+    if(tokens_ < 1) return false;
+    tokens_ -= 1;
+    return true;
+  }
+
+  /** @brief time at which the next token is available */
+  clock::time_point next_token(clock::time_point now) noexcept
+  {
+    if(!limited()) return now;
+    refill(now);
+    if(tokens_ >= 1) return now;
+    return now + std::chrono::ceil<clock::duration>(std::chrono::duration<double>((1 - tokens_) / rate_));
+  }
+
+private:
+  void refill(clock::time_point now) noexcept
+  {
+    if(now <= last_refill_) return;
+    tokens_ = std::min(burst_, tokens_ + std::chrono::duration<double>(now - last_refill_).count() * rate_);
+    last_refill_ = now;
+  }
+
+  double rate_ = 0;
+  double burst_ = 1;
+  double tokens_ = 1;
+  clock::time_point last_refill_;
+};
+
+} // namespace UDPDataLink
@@ -0,0 +1,155 @@
+/**
+ * @file recording.h
+ * @brief record the datagrams received by a UDPClient to a file, and replay them later
+ * @details A recording is an append-only, memory-mapped file: a 32 bytes header (the magic "UDLR", a version, the
+ * number of bytes used and the number of records) followed by the records. Each record is a 16 bytes header (the
+ * datagram size, a reserved field and the receive time in nanoseconds since the epoch of the system clock) followed
+ * by the datagram, padded to 8 bytes. Integers are little endian. The header of the file is updated after each record,
+ * a recording interrupted by a crash is readable up to the last complete record.
+ */
+#pragma once
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <thread>
+
+namespace UDPDataLink
+{
+
+/**
+ * @brief Append datagrams to a recording
+ * @details the file is mapped in memory and grown by chunks, recording a datagram is a copy into the mapping. Not
+ * thread safe, UDPClient calls it from its reception thread, see UDPClient::set_recorder()
+ */
+class Recorder
+{
+public:
+  /**
+   * @param [in] path file to create, replaced if it exists
+   * @param [in] chunk_size the file is grown by this many bytes when full
+   * @throw std::runtime_error if the file cannot be created or mapped
+   */
+  explicit Recorder(const std::string & path, size_t chunk_size = 64 * 1024 * 1024);
+  Recorder(const Recorder &) = delete;
+  Recorder & operator=(const Recorder &) = delete;
+  ~Recorder();
+
+  /**
+   * @brief append a datagram
+   * @param [in] receive_time nanoseconds since the epoch of the system clock
+   * @return false if the file could not be grown, the error is printed once on the error output
+   */
+  bool record(const uint8_t * datagram, size_t size, int64_t receive_time);
+
+  /** @brief ask the system to write the recorded datagrams to the disk, without waiting for it */
+  void flush();
+
+  /** @brief truncate the file to the recorded datagrams and close it, called by the destructor */
+  void close();
+
+  /** @brief number of datagrams recorded */
+  uint64_t count() const noexcept
+  {
+    return count_;
+  }
+
+  /** @brief size of the recording in bytes */
+  size_t size() const noexcept
+  {
+    return end_;
+  }
+
+private:
+  bool map(size_t capacity);
+
+  int fd_ = -1;
+  uint8_t * data_ = nullptr;
+  size_t capacity_ = 0;
+  size_t chunk_size_;
+  size_t end_ = 0;
+  uint64_t count_ = 0;
+  bool failed_ = false;
+};
+
+/**
+ * @brief Read the datagrams of a recording, in order
+ */
+class Replayer
+{
+public:
+  struct Record
+  {
+    const uint8_t * data = nullptr;
+    size_t size = 0;
+    /** nanoseconds since the epoch of the system clock */
+    int64_t receive_time = 0;
+  };
+
+  /**
+   * @param [in] path recording made by a Recorder
+   * @throw std::runtime_error if the file cannot be mapped or is not a recording
+   */
+  explicit Replayer(const std::string & path);
+  Replayer(const Replayer &) = delete;
+  Replayer & operator=(const Replayer &) = delete;
+  ~Replayer();
+
+  /**
+   * @brief read the next record
+   * @param [out] record points into the mapped file, valid as long as the Replayer
+   * @return false at the end of the recording
+   */
+  bool next(Record & record) noexcept;
+
+  /** @brief go back to the first record */
+  void rewind() noexcept;
+
+  /** @brief number of records in the recording */
+  uint64_t count() const noexcept
+  {
+    return count_;
+  }
+
+  /**
+   * @brief call sink(data, size, receive_time) with every record, from the first one
+   * @details to feed a Receiver, call UDPClient::replay_datagram() from the sink. To send the datagrams again, call
+   * Publisher::publish() from the sink
+   * @param [in] speed 1 to keep the original timing, 2 to replay twice as fast, 0 to replay as fast as possible
+   * @return number of records replayed
+   */
+  template<typename Sink>
+  uint64_t play(Sink && sink, double speed = 1)
+  {
+    rewind();
+    Record record;
+    uint64_t played = 0;
+    int64_t first_time = 0;
+    const auto start = std::chrono::steady_clock::now();
+    while(next(record))
+    {
+      if(played == 0)
+      {
+        first_time = record.receive_time;
+      }
+      else if(speed > 0)
+      {
+        const auto offset = static_cast<double>(record.receive_time - first_time) / speed;
+        std::this_thread::sleep_until(start + std::chrono::nanoseconds(static_cast<int64_t>(offset)));
+      }
+      sink(record.data, record.size, record.receive_time);
+      ++played;
+    }
+    return played;
+  }
+
+private:
+  int fd_ = -1;
+  const uint8_t * data_ = nullptr;
+  size_t size_ = 0;
+  size_t end_ = 0;
+  size_t position_ = 0;
+  uint64_t count_ = 0;
+};
+
+} // namespace UDPDataLink
@@ -0,0 +1,388 @@
+/**
+ * @file reliability.h
+ * @brief selective reliability: messages a UDPServer retransmits until each client acknowledges them
+ * @details A reliable message starts with a 16 bytes ReliableHeader: a magic number, two reserved bytes, the session of
+ * the client, the sequence number of the message for this client and the oldest sequence number the server still
+ * retransmits. Clients acknowledge reliable messages with Ack control messages (see control.h) followed by an
+ * AckPayload: the next sequence number expected and a bitmap of the following ones already received. A client noticing
+ * a gap sends a Nack instead, which makes the server retransmit the missing messages right away. Otherwise messages are
+ * retransmitted once a timeout computed from the measured round trip time expires.
+ * Reliable messages are only sent to the clients setting ControlHeader::reliable_flag in their control messages, the
+ * other clients never look for a ReliableHeader. Best-effort messages are sent as before and never wait behind reliable
+ * ones.
+ */
+#pragma once
+#include "shared_buffer.h"
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace UDPDataLink
+{
+
+struct ReliableHeader
+{
+  static constexpr uint16_t magic = 0x5255; // "UR" on the wire
+  static constexpr size_t size = 16;
+  using Bytes = std::array<uint8_t, size>;
+
+  /** identifies the client registration, a client seeing a new session starts over */
+  uint32_t session = 0;
+  uint32_t sequence = 0;
+  /** messages before this one are not retransmitted anymore, the client must not wait for them */
+  uint32_t oldest = 0;
+
+  /** @brief write the header, in little endian, to the beginning of buffer */
+  void write(uint8_t * buffer) const noexcept;
+
+  /**
+   * @brief read the header at the beginning of a message
+   * @return false if the message is not a reliable message
+   */
+  static bool read(const uint8_t * buffer, size_t size, ReliableHeader & header) noexcept;
+};
+
+/**
+ * @brief content of the Ack and Nack control messages, after the ControlHeader
+ */
+struct AckPayload
+{
+  static constexpr size_t size = 16;
+  /** number of bits of received */
+  static constexpr size_t window = 64;
+
+  uint32_t session = 0;
+  /** every message before this one was received */
+  uint32_t next_expected = 0;
+  /** bit i is set if message next_expected + 1 + i was received */
+  uint64_t received = 0;
+
+  void write(uint8_t * buffer) const noexcept;
+
+  /** @return false if the message is too short */
+  static bool read(const uint8_t * buffer, size_t size, AckPayload & payload) noexcept;
+};
+
+/**
+ * @brief reliability settings of a UDPServer, see UDPServer::set_reliability()
+ */
+struct ReliabilityOptions
+{
+  /** maximum number of messages per client waiting for an acknowledgement, at most AckPayload::window */
+  size_t window = 64;
+  /** retransmission timeout until a round trip time is measured */
+  std::chrono::milliseconds initial_timeout{100};
+  std::chrono::milliseconds min_timeout{2};
+  std::chrono::milliseconds max_timeout{1000};
+  /** retransmissions after which a message is given up */
+  size_t max_retries = 10;
+};
+
+/**
+ * @brief Round trip time estimation and retransmission timeout of RFC 6298
+ */
+class RttEstimator
+{
+public:
+  explicit RttEstimator(const ReliabilityOptions & options = {});
+
+  /** @brief add a round trip time measured on a message that was not retransmitted */
+  void add(std::chrono::nanoseconds sample) noexcept;
+
+  /** @brief smoothed round trip time, 0 until a first sample is added */
+  std::chrono::nanoseconds smoothed() const noexcept
+  {
+    return smoothed_;
+  }
+
+  /** @brief time after which an unacknowledged message is retransmitted */
+  std::chrono::nanoseconds timeout() const noexcept
+  {
+    return timeout_;
+  }
+
+  std::chrono::nanoseconds max_timeout() const noexcept
+  {
+    return max_timeout_;
+  }
+
+private:
+  std::chrono::nanoseconds min_timeout_;
+  std::chrono::nanoseconds max_timeout_;
+  std::chrono::nanoseconds smoothed_{0};
+  std::chrono::nanoseconds variation_{0};
+  std::chrono::nanoseconds timeout_;
+};
+
+/**
+ * @brief Reliable messages sent to one client and not acknowledged yet
+ * @details Messages are kept in a fixed number of slots, a message is refused when they are all waiting for an
+ * acknowledgement. The payload is shared by all clients, only the header is specific to each. Not thread safe.
+ */
+class RetransmitWindow
+{
+public:
+  using clock = std::chrono::steady_clock;
+
+  struct Entry
+  {
+    ReliableHeader::Bytes header;
+    SharedBuffer payload;
+    clock::time_point sent;
+    clock::time_point deadline;
+    size_t retries = 0;
+    bool pending = false;
+  };
+
+  explicit RetransmitWindow(const ReliabilityOptions & options = {}, uint32_t session = 0);
+
+  /**
+   * @brief give the next sequence number to a message
+   * @return the entry to send, nullptr if the window is full
+   */
+  const Entry * push(const SharedBuffer & payload, clock::time_point now);
+
+  /**
+   * @brief remove the messages acknowledged by the client, and retransmit the ones it reports missing on a Nack
+   * @details a missing message is retransmitted at most once per round trip time, the Nacks sent for each message
+   * received after it do not retransmit it again
+   * @param [in] send called with each entry to retransmit
+   */
+  template<typename Send>
+  void acknowledge(const AckPayload & ack, bool nack, clock::time_point now, Send && send)
+  {
+    if(!acknowledge(ack, now) || !nack) return;
+    for(uint32_t sequence = oldest_; sequence != next_; ++sequence)
+    {
+      auto & entry = slot(sequence);
+      if(entry.pending && before(sequence, highest_received(ack)) && now - entry.sent >= rtt_.smoothed())
+      {
+        retransmit(entry, now);
+        send(static_cast<const Entry &>(entry));
+      }
+    }
+  }
+
+  /**
+   * @brief retransmit the messages whose timeout expired, and give up the ones retransmitted too many times
+   * @param [in] send called with each entry to retransmit
+   * @return deadline of the next retransmission, clock::time_point::max() if no message is waiting
+   */
+  template<typename Send>
+  clock::time_point retransmit_expired(clock::time_point now, Send && send)
+  {
+    auto next_deadline = clock::time_point::max();
+    for(uint32_t sequence = oldest_; sequence != next_; ++sequence)
+    {
+      auto & entry = slot(sequence);
+      if(!entry.pending) continue;
+      if(entry.deadline <= now)
+      {
+        if(entry.retries == max_retries_)
+        {
+          entry.pending = false;
+          entry.payload.reset();
+          --unacknowledged_;
+          ++failed_;
+          continue;
+        }
+        retransmit(entry, now);
+        send(static_cast<const Entry &>(entry));
+      }
+      next_deadline = std::min(next_deadline, entry.deadline);
+    }
+    advance();
+    return next_deadline;
+  }
+
+  /** @brief number of messages waiting for an acknowledgement */
+  size_t unacknowledged() const noexcept
+  {
+    return unacknowledged_;
+  }
+
+  size_t sent() const noexcept
+  {
+    return sent_;
+  }
+
+  size_t retransmitted() const noexcept
+  {
+    return retransmitted_;
+  }
+
+  /** @brief number of messages given up after max_retries retransmissions */
+  size_t failed() const noexcept
+  {
+    return failed_;
+  }
+
+  const RttEstimator & rtt() const noexcept
+  {
+    return rtt_;
+  }
+
+private:
+  static bool before(uint32_t a, uint32_t b) noexcept
+  {
+    return static_cast<int32_t>(a - b) < 0;
+  }
+
+  static uint32_t highest_received(const AckPayload & ack) noexcept;
+
+  Entry & slot(uint32_t sequence) noexcept
+  {
+    return slots_[sequence % slots_.size()];
+  }
+
+  /** @return false if the acknowledgement is not for this session */
+  bool acknowledge(const AckPayload & ack, clock::time_point now);
+  void release(Entry & entry, clock::time_point now);
+  void retransmit(Entry & entry, clock::time_point now);
+  void advance() noexcept;
+
+  std::vector<Entry> slots_;
+  uint32_t session_;
+  uint32_t oldest_ = 0;
+  uint32_t next_ = 0;
+  size_t max_retries_;
+  RttEstimator rtt_;
+  size_t unacknowledged_ = 0;
+  size_t sent_ = 0;
+  size_t retransmitted_ = 0;
+  size_t failed_ = 0;
+};
+
+/**
+ * @brief Deliver the reliable messages of a server in order, once each, and compute the acknowledgements to send back
+ * @details Messages received ahead of a missing one are kept until it arrives, at most AckPayload::window of them, in
+ * slots whose buffers are reused. Not thread safe.
+ */
+class ReliableReceiver
+{
+public:
+  ReliableReceiver() : slots_(AckPayload::window) {}
+
+  /**
+   * @brief process a reliable message
+   * @param [in] deliver called with each message that can now be delivered, in order
+   * @param [out] ack acknowledgement to send back to the server
+   * @return true if messages are missing, the acknowledgement is then sent as a Nack
+   */
+  template<typename Deliver>
+  bool push(const ReliableHeader & header, const uint8_t * payload, size_t size, AckPayload & ack, Deliver && deliver)
+  {
+    if(!started_ || header.session != session_
+       || static_cast<int32_t>(header.oldest - next_) > static_cast<int32_t>(slots_.size()))
+    {
+      reset(header);
+    }
+    // Messages the server gave up are skipped, along with any gap before them
+    while(before(next_, header.oldest)) deliver_slot(deliver);
+    const auto distance = static_cast<int32_t>(header.sequence - next_);
+    if(distance < 0)
+    {
+      ++duplicates_;
+    }
+    else if(distance == 0)
+    {
+      ++next_;
+      ++delivered_;
+      deliver(payload, size);
+    }
+    else if(static_cast<size_t>(distance) <= slots_.size())
+    {
+      auto & slot = slots_[header.sequence % slots_.size()];
+      if(!slot.filled || slot.sequence != header.sequence)
+      {
+        slot.filled = true;
+        slot.sequence = header.sequence;
+        slot.data.assign(payload, payload + size);
+      }
+    }
+    // Messages beyond the slots are dropped, the server retransmits them
+    while(slot_filled(next_)) deliver_slot(deliver);
+    ack.session = session_;
+    ack.next_expected = next_;
+    ack.received = 0;
+    for(size_t i = 0; i < AckPayload::window; ++i)
+    {
+      if(slot_filled(next_ + 1 + static_cast<uint32_t>(i))) ack.received |= uint64_t{1} << i;
+    }
+    return ack.received != 0 || distance > 0;
+  }
+
+  /** @brief number of messages delivered */
+  size_t delivered() const noexcept
+  {
+    return delivered_;
+  }
+
+  /** @brief number of messages received again after being delivered, e.g. when an acknowledgement was lost */
+  size_t duplicates() const noexcept
+  {
+    return duplicates_;
+  }
+
+  /** @brief number of messages never received because the server gave them up */
+  size_t skipped() const noexcept
+  {
+    return skipped_;
+  }
+
+private:
+  struct Slot
+  {
+    bool filled = false;
+    uint32_t sequence = 0;
+    std::vector<uint8_t> data;
+  };
+
+  static bool before(uint32_t a, uint32_t b) noexcept
+  {
+    return static_cast<int32_t>(a - b) < 0;
+  }
+
+  bool slot_filled(uint32_t sequence) const noexcept
+  {
+    const auto & slot = slots_[sequence % slots_.size()];
+    return slot.filled && slot.sequence == sequence;
+  }
+
+  template<typename Deliver>
+  void deliver_slot(Deliver & deliver)
+  {
+    auto & slot = slots_[next_ % slots_.size()];
+    const bool filled = slot.filled && slot.sequence == next_;
+    ++next_;
+    if(!filled)
+    {
+      ++skipped_;
+      return;
+    }
+    slot.filled = false;
+    ++delivered_;
+    deliver(static_cast<const uint8_t *>(slot.data.data()), slot.data.size());
+  }
+
+  void reset(const ReliableHeader & header) noexcept
+  {
+    started_ = true;
+    session_ = header.session;
+    next_ = header.oldest;
+    for(auto & slot : slots_) slot.filled = false;
+  }
+
+  std::vector<Slot> slots_;
+  bool started_ = false;
+  uint32_t session_ = 0;
+  uint32_t next_ = 0;
+  size_t delivered_ = 0;
+  size_t duplicates_ = 0;
+  size_t skipped_ = 0;
+};
+
+} // namespace UDPDataLink
@@ -0,0 +1,173 @@
+/**
+ * @file shared_buffer.h
+ * @brief immutable reference counted message buffers shared by all the sends of an update
+ */
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace UDPDataLink
+{
+
+/** @brief a message that is not modified anymore, kept alive as long as a send refers to it */
+using SharedBuffer = std::shared_ptr<const std::vector<uint8_t>>;
+
+inline SharedBuffer make_shared_buffer(const uint8_t * data, size_t size)
+{
+  return std::make_shared<const std::vector<uint8_t>>(data, data + size);
+}
+
+/**
+ * @brief Recycle the buffers of messages that are not referenced by any send anymore
+ * @details acquire() returns a buffer only referenced by the pool, to be filled and then handed over as a SharedBuffer.
+ * Once every send holding it completes, the buffer goes back to the pool with its capacity, so that steady state
+ * publishing does not allocate. Must be used from a single thread.
+ */
+class SharedBufferPool
+{
+public:
+  std::shared_ptr<std::vector<uint8_t>> acquire()
+  {
+    for(auto & buffer : buffers_)
+    {
+      if(buffer.use_count() == 1)
+      {
+        // Pairs with the release of the last other reference, its reads of the content are done
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return buffer;
+      }
+    }
+    // Start from the largest buffer so far, the message will most likely need as much
+    buffers_.push_back(std::make_shared<std::vector<uint8_t>>());
+    buffers_.back()->reserve(capacity_);
+    return buffers_.back();
+  }
+
+  /**
+   * @brief allocate buffers up front, e.g. to absorb a burst of slow sends without allocating
+   * @param [in] count number of buffers owned by the pool, at least
+   * @param [in] capacity bytes reserved in every buffer, at least
+   */
+  void reserve(size_t count, size_t capacity)
+  {
+    capacity_ = std::max(capacity_, capacity);
+    buffers_.reserve(count);
+    while(buffers_.size() < count) buffers_.push_back(std::make_shared<std::vector<uint8_t>>());
+    for(auto & buffer : buffers_)
+    {
+      if(buffer.use_count() == 1) buffer->reserve(capacity_);
+    }
+  }
+
+  /** @brief record the size of a message, buffers allocated later reserve the largest one */
+  void note_size(size_t size) noexcept
+  {
+    capacity_ = std::max(capacity_, size);
+  }
+
+  /** @brief number of buffers owned by the pool */
+  size_t size() const noexcept
+  {
+    return buffers_.size();
+  }
+
+private:
+  std::vector<std::shared_ptr<std::vector<uint8_t>>> buffers_;
+  size_t capacity_ = 0;
+};
+
+/**
+ * @brief Messages waiting to be sent, in order, with at most one message per conflation key
+ * @details Pushing a message whose key is already waiting replaces the older message in place, so that a sender that
+ * falls behind only sends the latest message of each stream. Keyframes of delta encoding are the exception: the deltas
+ * that follow a keyframe waiting to be sent refer to it, they are queued after it instead of replacing it. A key thus
+ * has at most a keyframe and a message after it waiting. Not thread safe.
+ */
+class ConflatedQueue
+{
+public:
+  struct Entry
+  {
+    uint32_t key;
+    SharedBuffer buffer;
+    uint32_t message_id;
+    bool keyframe;
+  };
+
+  /**
+   * @param [in] keyframe true if the message is a keyframe that the next messages of the key need to be decoded
+   * @return true if a message with the same key was replaced
+   */
+  bool push(uint32_t key, SharedBuffer buffer, uint32_t message_id, bool keyframe = false)
+  {
+    for(size_t i = head_; i < entries_.size(); ++i)
+    {
+      auto & entry = entries_[i];
+      if(entry.key != key || (entry.keyframe && !keyframe)) continue;
+      entry.buffer = std::move(buffer);
+      entry.message_id = message_id;
+      entry.keyframe = keyframe;
+      // The message queued after the replaced keyframe refers to it
+      if(keyframe)
+      {
+        for(size_t j = i + 1; j < entries_.size(); ++j)
+        {
+          if(entries_[j].key != key) continue;
+          entries_.erase(entries_.begin() + static_cast<std::ptrdiff_t>(j));
+          break;
+        }
+      }
+      return true;
+    }
+    entries_.push_back(Entry{key, std::move(buffer), message_id, keyframe});
+    return false;
+  }
+
+  /** @return false if no message is waiting */
+  bool pop(Entry & entry)
+  {
+    if(empty()) return false;
+    entry = std::move(entries_[head_++]);
+    if(head_ == entries_.size()) clear();
+    return true;
+  }
+
+  bool empty() const noexcept
+  {
+    return head_ == entries_.size();
+  }
+
+  size_t size() const noexcept
+  {
+    return entries_.size() - head_;
+  }
+
+  void clear() noexcept
+  {
+    entries_.clear();
+    head_ = 0;
+  }
+
+  /** @brief make room for count messages, so that pushing up to count keys does not allocate */
+  void reserve(size_t count)
+  {
+    entries_.reserve(count);
+  }
+
+  void swap(ConflatedQueue & other) noexcept
+  {
+    entries_.swap(other.entries_);
+    std::swap(head_, other.head_);
+  }
+
+private:
+  std::vector<Entry> entries_;
+  size_t head_ = 0;
+};
+
+} // namespace UDPDataLink
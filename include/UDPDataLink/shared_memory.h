@@ -0,0 +1,173 @@
+/**
+ * @file shared_memory.h
+ * @brief deliver the messages of a UDPServer to the clients of the same host through shared memory
+ * @details The server copies its best-effort messages to a ring of slots in a POSIX shared memory segment named after
+ * its address and port, see shared_memory_name(). Each slot is a seqlock: its sequence is odd while the server copies a
+ * message in, and a client copying the message out tries again if the sequence changed meanwhile. The server never
+ * waits for the clients, a client falling more than the size of the ring behind skips to the oldest message left.
+ * A client reading the ring tells the server with a SharedMemory control message (see control.h) carrying the
+ * generation of the ring it mapped, the server then stops sending it over UDP the messages that fit in a slot. A
+ * restarted server creates a ring of another generation and keeps sending over UDP to the clients still reading the
+ * previous one. Larger messages and reliable messages still go through UDP.
+ */
+#pragma once
+#include <boost/asio/ip/address.hpp>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace UDPDataLink
+{
+
+struct SharedMemoryOptions
+{
+  /** number of messages kept in the ring, a client falling further behind loses the oldest ones */
+  size_t slots = 64;
+  /** largest message written to the ring, larger ones are sent over UDP */
+  size_t slot_size = 4096;
+};
+
+/**
+ * @brief name of the shared memory segment of the server bound to address and port
+ * @details address is the unspecified address for a server bound to every interface, so that servers sharing a port on
+ * different addresses do not replace each other's ring
+ */
+std::string shared_memory_name(const boost::asio::ip::address & address, uint16_t port);
+
+/** @brief true if address is a loopback address or the address of an interface of this host */
+bool is_local_address(const boost::asio::ip::address & address);
+
+/**
+ * @brief content of the SharedMemory control messages, after the ControlHeader
+ */
+struct SharedMemoryPayload
+{
+  static constexpr size_t size = 4;
+
+  /** generation of the ring the client mapped, see SharedMemoryReader::generation() */
+  uint32_t generation = 0;
+
+  void write(uint8_t * buffer) const noexcept
+  {
+    for(size_t i = 0; i < 4; ++i) buffer[i] = static_cast<uint8_t>(generation >> (8 * i));
+  }
+
+  /** @return false if the message is too short */
+  static bool read(const uint8_t * buffer, size_t size, SharedMemoryPayload & payload) noexcept
+  {
+    if(size < SharedMemoryPayload::size) return false;
+    payload.generation = 0;
+    for(size_t i = 0; i < 4; ++i) payload.generation |= static_cast<uint32_t>(buffer[i]) << (8 * i);
+    return true;
+  }
+};
+
+/**
+ * @brief Create a ring and write messages to it
+ * @details a single thread must write at a time. The segment is removed by the destructor, the clients that mapped it
+ * keep it until they stop reading.
+ */
+class SharedMemoryWriter
+{
+public:
+  /**
+   * @param [in] name name of the segment, replaced if it exists
+   * @throw std::invalid_argument if options has no slot
+   * @throw std::runtime_error if the segment cannot be created or mapped
+   */
+  SharedMemoryWriter(const std::string & name, const SharedMemoryOptions & options = {});
+  SharedMemoryWriter(const SharedMemoryWriter &) = delete;
+  SharedMemoryWriter & operator=(const SharedMemoryWriter &) = delete;
+  ~SharedMemoryWriter();
+
+  /**
+   * @brief copy a message to the next slot and wake the clients waiting for it
+   * @return false if the message does not fit in a slot
+   */
+  bool write(const uint8_t * message, size_t size) noexcept;
+
+  size_t slot_size() const noexcept
+  {
+    return slot_size_;
+  }
+
+  /** @brief random nonzero number telling this ring apart from the ones of previous servers of the same name */
+  uint32_t generation() const noexcept
+  {
+    return generation_;
+  }
+
+private:
+  std::string name_;
+  uint8_t * data_ = nullptr;
+  size_t size_ = 0;
+  size_t slots_ = 0;
+  size_t slot_size_ = 0;
+  uint32_t generation_ = 0;
+};
+
+/**
+ * @brief Read the messages of a ring created by a SharedMemoryWriter, in order
+ * @details not thread safe, except interrupt()
+ */
+class SharedMemoryReader
+{
+public:
+  /**
+   * @param [in] name name of the segment
+   * @throw std::runtime_error if the segment does not exist or is not a ring
+   */
+  explicit SharedMemoryReader(const std::string & name);
+  SharedMemoryReader(const SharedMemoryReader &) = delete;
+  SharedMemoryReader & operator=(const SharedMemoryReader &) = delete;
+  ~SharedMemoryReader();
+
+  /**
+   * @brief copy the next message, starting with the latest one written before the reader was created
+   * @param [out] buffer must hold slot_size() bytes
+   * @return size of the message, 0 if there is no new message
+   */
+  size_t read(uint8_t * buffer) noexcept;
+
+  /**
+   * @brief wait until a new message is written, interrupt() is called or timeout expires
+   * @details sleeps on a futex on Linux, elsewhere polls every 100 microseconds
+   */
+  void wait(std::chrono::nanoseconds timeout) noexcept;
+
+  /** @brief wake the thread waiting in wait() */
+  void interrupt() noexcept;
+
+  size_t slot_size() const noexcept
+  {
+    return slot_size_;
+  }
+
+  /** @see SharedMemoryWriter::generation() */
+  uint32_t generation() const noexcept
+  {
+    return generation_;
+  }
+
+  /** @brief number of messages overwritten before they could be read */
+  uint64_t skipped() const noexcept
+  {
+    return skipped_;
+  }
+
+private:
+  bool available() const noexcept;
+
+  uint8_t * data_ = nullptr;
+  size_t size_ = 0;
+  size_t slots_ = 0;
+  size_t slot_size_ = 0;
+  uint32_t generation_ = 0;
+  uint64_t next_ = 0;
+  uint64_t skipped_ = 0;
+  std::atomic<bool> interrupted_{false};
+};
+
+} // namespace UDPDataLink
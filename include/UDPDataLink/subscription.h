@@ -0,0 +1,204 @@
+/**
+ * @file subscription.h
+ * @brief handshake through which a client subscribes to a stream of a UDPServer
+ * @details The client sends a Subscribe control message (see control.h) followed by a SubscribeRequest: the largest
+ * datagram it accepts, the fingerprints of the encodings it decodes (see type_fingerprint() in Codec.h), the rate it
+ * wants and the generation of the shared memory ring it reads, if any. The topic is the one of the ControlHeader. The
+ * server answers with a SubscribeReply control message followed by a SubscribeReply: the fingerprint of its encoding,
+ * its largest datagram and the rate granted, or why it refuses.
+ * The client repeats its request until it is answered, and sizes its reception buffers after the reply.
+ *
+ * A server requiring subscriptions only sends to the clients it accepted. It answers the other control messages of an
+ * unknown client, e.g. the heartbeats of a client it timed out or sent before a restart, with a NotSubscribed reply
+ * that makes the client subscribe again.
+ *
+ * Publisher and TopicServer remove by default the subscribers silent for default_client_timeout, and Receiver sends
+ * by default a heartbeat every default_heartbeat_period, see UDPServer::set_client_timeout() and
+ * UDPClient::set_heartbeat(). A client also unsubscribes when its reception stops.
+ */
+#pragma once
+#include "rate_limit.h"
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+namespace UDPDataLink
+{
+
+/** @brief time after which Publisher and TopicServer remove a silent subscriber */
+constexpr std::chrono::milliseconds default_client_timeout{3000};
+/** @brief time between two heartbeats of Receiver, short enough to lose two of them before default_client_timeout */
+constexpr std::chrono::milliseconds default_heartbeat_period{1000};
+
+namespace detail
+{
+
+inline void put_u32(uint8_t * buffer, uint32_t value) noexcept
+{
+  for(size_t i = 0; i < 4; ++i) buffer[i] = static_cast<uint8_t>(value >> (8 * i));
+}
+
+inline uint32_t get_u32(const uint8_t * buffer) noexcept
+{
+  uint32_t value = 0;
+  for(size_t i = 0; i < 4; ++i) value |= static_cast<uint32_t>(buffer[i]) << (8 * i);
+  return value;
+}
+
+} // namespace detail
+
+/**
+ * @brief content of the Subscribe control messages, after the ControlHeader
+ */
+struct SubscribeRequest
+{
+  static constexpr size_t max_codecs = 8;
+  /** size of a request without codec */
+  static constexpr size_t min_size = 20;
+  /** the client reads the messages of the server from shared memory, see shared_memory.h */
+  static constexpr uint8_t shared_memory_flag = 1;
+
+  /** largest datagram the client accepts, 0 for any */
+  uint32_t max_datagram_size = 0;
+  /** maximum rate of the messages sent to the client, see rate_limit.h */
+  RatePayload rate;
+  uint8_t flags = 0;
+  /** generation of the ring the client reads when flags has shared_memory_flag, see SharedMemoryReader::generation() */
+  uint32_t shared_memory_generation = 0;
+  /** fingerprints of the encodings the client decodes, none to accept any */
+  std::array<uint32_t, max_codecs> codecs{};
+  uint8_t codec_count = 0;
+
+  /** @brief add a fingerprint to codecs, false if it is full */
+  bool add_codec(uint32_t codec) noexcept
+  {
+    if(codec_count == max_codecs) return false;
+    codecs[codec_count++] = codec;
+    return true;
+  }
+
+  /** @brief true if the client decodes the updates encoded with codec */
+  bool supports(uint32_t codec) const noexcept
+  {
+    for(size_t i = 0; i < codec_count; ++i)
+    {
+      if(codecs[i] == codec) return true;
+    }
+    return codec_count == 0;
+  }
+
+  size_t size() const noexcept
+  {
+    return min_size + 4 * codec_count;
+  }
+
+  /** @brief write the request to buffer, which must hold at least size() bytes */
+  void write(uint8_t * buffer) const noexcept
+  {
+    detail::put_u32(buffer, max_datagram_size);
+    rate.write(buffer + 4);
+    buffer[12] = flags;
+    buffer[13] = codec_count;
+    buffer[14] = 0;
+    buffer[15] = 0;
+    detail::put_u32(buffer + 16, shared_memory_generation);
+    for(size_t i = 0; i < codec_count; ++i) detail::put_u32(buffer + min_size + 4 * i, codecs[i]);
+  }
+
+  /** @return false if the message is too short or lists too many codecs */
+  static bool read(const uint8_t * buffer, size_t size, SubscribeRequest & request) noexcept
+  {
+    if(size < min_size || buffer[13] > max_codecs || size < min_size + 4 * size_t{buffer[13]}) return false;
+    request.max_datagram_size = detail::get_u32(buffer);
+    RatePayload::read(buffer + 4, RatePayload::size, request.rate);
+    request.flags = buffer[12];
+    request.codec_count = buffer[13];
+    request.shared_memory_generation = detail::get_u32(buffer + 16);
+    for(size_t i = 0; i < request.codec_count; ++i) request.codecs[i] = detail::get_u32(buffer + min_size + 4 * i);
+    return true;
+  }
+};
+
+enum class SubscribeStatus : uint8_t
+{
+  Accepted = 0,
+  /** answer to a control message of a client the server does not know, the client has to subscribe again */
+  NotSubscribed = 1,
+  /** nothing is published on the topic */
+  UnknownTopic = 2,
+  /** the client does not decode the encoding of the stream */
+  UnsupportedCodec = 3,
+  /** the server sends datagrams larger than the client accepts */
+  DatagramTooLarge = 4,
+};
+
+inline const char * to_string(SubscribeStatus status) noexcept
+{
+  switch(status)
+  {
+    case SubscribeStatus::Accepted:
+      return "accepted";
+    case SubscribeStatus::NotSubscribed:
+      return "not subscribed";
+    case SubscribeStatus::UnknownTopic:
+      return "unknown topic";
+    case SubscribeStatus::UnsupportedCodec:
+      return "unsupported codec";
+    case SubscribeStatus::DatagramTooLarge:
+      return "datagram too large";
+  }
+  return "invalid status";
+}
+
+/**
+ * @brief content of the SubscribeReply control messages, after the ControlHeader
+ */
+struct SubscribeReply
+{
+  static constexpr size_t size = 20;
+
+  SubscribeStatus status = SubscribeStatus::Accepted;
+  /** fingerprint of the encoding of the stream, 0 if unknown */
+  uint32_t codec = 0;
+  /** largest datagram the server sends to the client, 0 if unbounded */
+  uint32_t max_datagram_size = 0;
+  /** rate granted to the client */
+  RatePayload rate;
+
+  /**
+   * @brief answer a request for a stream encoded with codec, whose updates are at most max_update_size bytes
+   * @details keeps a max_datagram_size already set, the size of the fragments when the server splits the messages
+   * @param [in] max_update_size 0 if the size of the updates is not bounded
+   */
+  void offer(const SubscribeRequest & request, uint32_t codec, size_t max_update_size) noexcept
+  {
+    this->codec = codec;
+    if(max_datagram_size == 0) max_datagram_size = static_cast<uint32_t>(max_update_size);
+    if(!request.supports(codec)) status = SubscribeStatus::UnsupportedCodec;
+  }
+
+  void write(uint8_t * buffer) const noexcept
+  {
+    buffer[0] = static_cast<uint8_t>(status);
+    buffer[1] = 0;
+    buffer[2] = 0;
+    buffer[3] = 0;
+    detail::put_u32(buffer + 4, codec);
+    detail::put_u32(buffer + 8, max_datagram_size);
+    rate.write(buffer + 12);
+  }
+
+  /** @return false if the message is too short */
+  static bool read(const uint8_t * buffer, size_t size, SubscribeReply & reply) noexcept
+  {
+    if(size < SubscribeReply::size) return false;
+    reply.status = static_cast<SubscribeStatus>(buffer[0]);
+    reply.codec = detail::get_u32(buffer + 4);
+    reply.max_datagram_size = detail::get_u32(buffer + 8);
+    RatePayload::read(buffer + 12, RatePayload::size, reply.rate);
+    return true;
+  }
+};
+
+} // namespace UDPDataLink
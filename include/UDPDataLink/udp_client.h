@@ -32,7 +32,24 @@
  * @example example_udp_client.cpp
  */
 #pragma once
+#include "LinkStats.h"
+#include "batched_io.h"
+#include "control.h"
+#include "fragmentation.h"
+#include "handler_memory.h"
+#include "io_uring.h"
+#include "low_latency.h"
+#include "multicast.h"
+#include "rate_limit.h"
+#include "recording.h"
+#include "reliability.h"
+#include "shared_memory.h"
+#include "subscription.h"
 #include <boost/asio.hpp>
+#include <array>
+#include <atomic>
+#include <memory>
+#include <mutex>
 #include <thread>
 #include <vector>
 /**
@@ -107,11 +124,166 @@ public:
    * @param [in] max_packet_size maximum size for packets exchanged
    */
   void connect(const std::string & server_ip, uint16_t server_port, uint16_t local_port, size_t max_packet_size = 1024);
+  /**
+   * @brief size of the reception buffers
+   * @details datagrams that do not fit are dropped and the buffers doubled. When the largest message is known in
+   * advance, setting it to one byte more than that size avoids the drop. Must be called before the reception starts
+   * @param [in] max_packet_size maximum size for packets exchanged
+   */
+  void set_max_packet_size(size_t max_packet_size);
+  /**
+   * @brief current size of the reception buffers, see set_max_packet_size()
+   */
+  size_t max_packet_size() const noexcept;
   /**
    * @brief make the client verbose
    * @param state if true the client will be verbose
    */
   void set_verbose(bool state);
+  /**
+   * @brief reassemble the messages fragmented by the server
+   * @details the server must enable fragmentation too, see UDPServer::set_fragmentation(). Once enabled, datagrams
+   * without a fragment header are dropped
+   * @param [in] state if true received datagrams are reassembled before calling reception_callback
+   * @param [in] timeout time after which an incomplete message is dropped
+   * @param [in] max_message_size messages announced larger than this are dropped before any memory is allocated for
+   * them
+   */
+  void set_fragmentation(bool state,
+                         std::chrono::milliseconds timeout = std::chrono::milliseconds(100),
+                         size_t max_message_size = UDPDataLink::default_max_message_size);
+  /**
+   * @brief use recvmmsg to read bursts of datagrams with one system call
+   * @details only available on Linux, the default asio path is kept elsewhere. Must be called before
+   * start_reception() or receive(). Each of the batch_size reception buffers is max_packet_size bytes large and is
+   * doubled when a datagram does not fit
+   * @param [in] state if true batched I/O is used
+   * @param [in] batch_size maximum number of datagrams per system call
+   * @return true if batched I/O is enabled
+   */
+  bool set_batched_io(bool state, size_t batch_size = 64);
+  /**
+   * @brief receive with a multishot recvmsg on an io_uring, into buffers registered with the kernel
+   * @details only available on Linux 6.0 and later, see io_uring.h. Replaces the batched I/O path and does not read
+   * receive timestamps: refused while they are enabled with set_low_latency(), which also replaces the io_uring by
+   * the batched I/O path when enabling them. Must be called before start_reception() or receive(). Each of the
+   * buffer_count reception buffers is max_packet_size bytes large and is doubled when a datagram does not fit
+   * @param [in] state if true the io_uring is used
+   * @param [in] buffer_count number of reception buffers, datagrams are dropped while they are all in use
+   * @return true if the io_uring is used
+   */
+  bool set_io_uring(bool state, size_t buffer_count = 64);
+  /**
+   * @brief number of system calls made by the batched I/O path or the io_uring since it was enabled
+   */
+  size_t batched_io_syscalls() const noexcept;
+  /**
+   * @brief trade CPU time for reception latency, see LowLatencyOptions
+   * @details the socket options are set immediately, the thread options when start_reception() starts the reception
+   * thread, receive() leaves the calling thread untouched. Receive timestamps need recvmsg and are only available on
+   * Linux, the batched I/O path is then used with batches of one datagram unless enabled with a larger size. Must be
+   * called before the reception starts
+   * @return false if a socket option could not be set, the reason is printed on the error output
+   */
+  bool set_low_latency(const UDPDataLink::LowLatencyOptions & options);
+  /**
+   * @brief time between the receive timestamps of the datagrams and the start of their reception_callback
+   * @details only counted when timestamps are enabled with set_low_latency(), hardware timestamps are only comparable
+   * with the system clock when the clock of the card is synchronized with it
+   */
+  UDPDataLink::LatencyHistogram wakeup_latency() const;
+  /**
+   * @brief record every datagram received, before reassembly, with its receive time
+   * @details the datagrams are copied to the memory mapped file of the recorder by the reception thread. The messages
+   * read from shared memory are recorded as datagrams, unless fragmentation is enabled. Must be called while the
+   * reception is stopped
+   * @param [in] recorder the recorder to use, nullptr to stop recording
+   */
+  void set_recorder(std::shared_ptr<UDPDataLink::Recorder> recorder);
+  /**
+   * @brief process a datagram as if it had been received, e.g. one of a recording, see UDPDataLink::Replayer
+   * @details the datagram goes through reassembly and then to reception_callback. Must not be called while the
+   * reception runs
+   * @param [in] receive_time nanoseconds since the epoch of the system clock
+   */
+  void replay_datagram(const uint8_t * buffer, size_t size, int64_t receive_time);
+  /**
+   * @brief periodically tell the server that the client is still alive
+   * @details needed when the server removes silent clients, see UDPServer::set_client_timeout(). Heartbeats are sent
+   * from the reception thread, once start_reception() or receive() is called
+   * @param [in] period time between two heartbeats, zero to stop sending them
+   */
+  void set_heartbeat(std::chrono::milliseconds period);
+  /**
+   * @brief ask the server to send at most rate messages per second to this client
+   * @details the request is sent right away and then instead of the heartbeats, so that it reaches a server started
+   * later or restarted. The server keeps the latest message of each stream for the next allowed send, see
+   * UDPServer::set_rate_limit()
+   * @param [in] rate maximum number of messages per second, 0 for no limit
+   * @param [in] burst number of messages the server can send back to back, 1 to have them evenly paced
+   */
+  void set_max_rate(double rate, size_t burst = 1);
+  /**
+   * @brief accept the reliable messages of the server, see UDPServer::send_reliable()
+   * @details disabled by default: the server only sends reliable messages to the clients setting
+   * ControlHeader::reliable_flag in their control messages, sent right away and then with the heartbeats, and the other
+   * clients pass every datagram to reception_callback as it is. Once enabled, a datagram starting with a ReliableHeader
+   * is read as a reliable message, so the best-effort messages of the server must not start with its magic number,
+   * "UR". The updates of a Publisher never do
+   * @param [in] state if true the reliable messages are acknowledged and passed to reception_callback in order
+   */
+  void set_reliable_messages(bool state);
+  /**
+   * @brief read the messages of a server of the same host from its shared memory ring, see shared_memory.h
+   * @details enabled by default: start_reception() maps the ring when the server address belongs to this host and the
+   * server created one, UDP is used otherwise. The messages of the ring are passed to reception_callback by a second
+   * thread, never at the same time as the datagrams. It sleeps until a message is written, or polls the ring when
+   * spinning is enabled with set_low_latency(). Not used by receive(), nor once a maximum rate is set with
+   * set_max_rate(). Must be called before the reception starts
+   * @param [in] state if false the messages are always received over UDP
+   */
+  void set_shared_memory(bool state);
+  /**
+   * @brief true if the running reception reads the messages from shared memory, see set_shared_memory()
+   */
+  bool using_shared_memory() const noexcept;
+  /**
+   * @brief subscribe to the stream of a topic of the server, see subscription.h
+   * @details the request is sent right away, then by start_reception() or receive() and repeated by the reception
+   * thread until the server answers, less and less often. It carries the rate set with set_max_rate() and whether the
+   * client reads from shared memory. Once every topic is accepted with a bounded size, the reception buffers are sized
+   * for the largest datagram announced by the server, never below set_max_packet_size(). A refusal is printed on the
+   * error output
+   * @param [in] topic topic of the stream, 0 when the server publishes a single one
+   * @param [in] codecs fingerprints of the encodings the client decodes, empty to accept any, see type_fingerprint()
+   * @param [in] max_datagram_size largest datagram the client accepts, 0 for any
+   */
+  void subscribe(uint16_t topic, const std::vector<uint32_t> & codecs = {}, size_t max_datagram_size = 0);
+  /**
+   * @brief answer of the server to the subscription to topic, callable from any thread
+   * @return false until the server answered
+   */
+  bool subscription(uint16_t topic, UDPDataLink::SubscribeReply & reply) const;
+  /**
+   * @brief ask the server to stop sending data to this client
+   */
+  void unsubscribe();
+  /**
+   * @brief receive the messages a UDPServer sends to a multicast group, see UDPServer::set_multicast()
+   * @details the socket is bound again to the port of the group, which can be shared with the other receivers of the
+   * host. Messages to the server still go to the address given to connect(). Must be called before the reception
+   * starts.
+   * @param [in] group IPv4 multicast address of the group
+   * @param [in] port port the server sends the group messages to
+   * @param [in] interface_address IPv4 address of the local interface to join the group on, empty for the one
+   * chosen by the system
+   * @throw std::invalid_argument if group is not an IPv4 multicast address
+   */
+  void join_multicast(const std::string & group, uint16_t port, const std::string & interface_address = "");
+  /**
+   * @brief stop receiving the messages of the multicast group joined with join_multicast()
+   */
+  void leave_multicast();
   /**
    * @brief receive a message
    * @details this call is blocking until the reception_callback is called
@@ -126,19 +298,32 @@ public:
   /**
    * @brief stop asynchronous message reception
    * @details once called the reception_callback will no more be called any
-   * time a message is received
+   * time a message is received. A subscribed client tells the server to stop sending, start_reception() subscribes
+   * again
    */
   void stop_reception();
 
 protected:
   /**
    * @brief callback called anytime a message is received
+   * @details the reliable messages of the server, see set_reliable_messages(), are acknowledged by the client and
+   * passed here in order, once each, without their ReliableHeader
    *
    * @param [in] buffer the pointer to the buffer containing the message
    * received
    * @param [in] size size of the message received
    */
   virtual void reception_callback(const uint8_t * buffer, size_t size);
+  /**
+   * @brief callback called anytime a message is received, calls reception_callback(buffer, size) by default
+   *
+   * @param [in] buffer the pointer to the buffer containing the message
+   * received
+   * @param [in] size size of the message received
+   * @param [in] receive_time receive timestamp of the message in nanoseconds, 0 unless enabled with
+   * set_low_latency()
+   */
+  virtual void reception_callback(const uint8_t * buffer, size_t size, int64_t receive_time);
   /**
    * @brief send data to server
    *
@@ -146,15 +331,83 @@ protected:
    * @param[in] size size of the buffer in bytes
    */
   void send_data(const uint8_t * buffer, size_t size);
+  /**
+   * @brief send a control message to the server
+   *
+   * @param[in] type type of the control message, see control.h
+   * @param[in] topic topic the message refers to
+   */
+  void send_control(UDPDataLink::ControlType type, uint16_t topic = 0);
 
 private:
   void start_receive();
   void handle_receive(const boost::system::error_code & error, std::size_t bytes_transferred);
+  void handle_batch_receive(const boost::system::error_code & error);
+  void handle_uring_receive(const boost::system::error_code & error);
+  void handle_datagram(const uint8_t * buffer, size_t size, int64_t receive_time = 0);
   void handle_send(const boost::system::error_code & error, std::size_t bytes_transferred);
+  void handle_subscribe_reply(const uint8_t * buffer, size_t size);
+  void send_subscriptions();
+  void schedule_subscriptions();
+  void schedule_heartbeat();
+  void send_acknowledgement(UDPDataLink::ControlType type, const UDPDataLink::AckPayload & ack);
+  UDPDataLink::ControlHeader control_header(UDPDataLink::ControlType type, uint16_t topic = 0) const noexcept;
+  bool apply_socket_options();
+  // size of the reception buffers holding datagrams of size bytes, enough for any fragment once reassembling
+  size_t receive_buffer_size(size_t size) const noexcept;
+  void resize_buffers(size_t size);
+  void open_shared_memory();
+  void run_shared_memory();
+  void start_shared_memory();
+  void stop_shared_memory();
   boost::asio::io_service io_service_;
   std::thread run_thread_;
   boost::asio::ip::udp::socket socket_;
   boost::asio::ip::udp::endpoint remote_endpoint_, server_endpoint_;
   std::vector<uint8_t> buffer_in_;
   bool verbose_;
+  size_t max_packet_size_ = 1024;
+  bool fragmentation_ = false;
+  UDPDataLink::Reassembler reassembler_;
+  UDPDataLink::ReliableReceiver reliable_;
+  // Flags of the control messages, read by the reception thread
+  std::atomic<uint8_t> control_flags_{0};
+  std::shared_ptr<UDPDataLink::Recorder> recorder_;
+  std::unique_ptr<UDPDataLink::BatchReceiver> batch_receiver_;
+  std::unique_ptr<UDPDataLink::UringReceiver> uring_receiver_;
+  boost::asio::steady_timer heartbeat_timer_;
+  std::chrono::milliseconds heartbeat_period_{0};
+  // A heartbeat, or a rate request once set_max_rate() is called
+  std::array<uint8_t, UDPDataLink::ControlHeader::size + UDPDataLink::RatePayload::size> heartbeat_;
+  size_t heartbeat_size_ = UDPDataLink::ControlHeader::size;
+  // The heartbeats are sent by default, their timer and send operations are recycled
+  std::shared_ptr<UDPDataLink::HandlerMemory> heartbeat_memory_ = std::make_shared<UDPDataLink::HandlerMemory>();
+  double max_rate_ = 0;
+  size_t max_burst_ = 1;
+  struct Subscription
+  {
+    uint16_t topic;
+    UDPDataLink::SubscribeRequest request;
+    bool answered = false;
+    UDPDataLink::SubscribeReply reply;
+  };
+  mutable std::mutex subscriptions_mutex_;
+  std::vector<Subscription> subscriptions_;
+  boost::asio::steady_timer subscribe_timer_;
+  std::chrono::milliseconds subscribe_retry_{0};
+  // Largest datagram announced by the server, applied by start_receive() once the received datagrams are processed
+  size_t announced_packet_size_ = 0;
+  boost::asio::ip::address_v4 multicast_group_, multicast_interface_;
+  UDPDataLink::LowLatencyOptions low_latency_;
+  mutable std::mutex wakeup_mutex_;
+  UDPDataLink::LatencyHistogram wakeup_latency_;
+  bool shared_memory_enabled_ = true;
+  std::unique_ptr<UDPDataLink::SharedMemoryReader> shared_memory_;
+  std::vector<uint8_t> shared_memory_buffer_;
+  std::thread shared_memory_thread_;
+  std::atomic<bool> shared_memory_stop_{false};
+  // Generation of the ring read by the shared memory thread, 0 when it does not run. Sent in the subscriptions
+  std::atomic<uint32_t> shared_memory_generation_{0};
+  // Held around reception_callback while both threads receive
+  std::mutex callback_mutex_;
 };
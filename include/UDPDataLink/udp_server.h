@@ -30,10 +30,28 @@
  * @example example_udp_server.cpp
  */
 #pragma once
+#include "batched_io.h"
+#include "client_registry.h"
+#include "control.h"
+#include "fragmentation.h"
+#include "handler_memory.h"
+#include "io_uring.h"
+#include "low_latency.h"
+#include "multicast.h"
+#include "rate_limit.h"
+#include "reliability.h"
+#include "shared_buffer.h"
+#include "shared_memory.h"
+#include "subscription.h"
 #include <boost/asio.hpp>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
 #include <cstdlib>
 #include <iostream>
-#include <list>
+#include <memory>
+#include <mutex>
 #include <thread>
 #include <vector>
 /**
@@ -44,6 +62,60 @@
 class UDPServer
 {
 public:
+  /**
+   * @brief what to do with a message sent to a client while the previous one is still being sent
+   */
+  enum class ConflationPolicy
+  {
+    /** keep the newest message and send it once the current send completes, replacing any older one waiting */
+    LatestWins,
+    /** drop the newest message */
+    DropNewest
+  };
+
+  /**
+   * @brief counters of the messages sent to a client through the asio path
+   */
+  struct SubscriberStats
+  {
+    size_t sent = 0;
+    /** messages replaced by a newer one before they could be sent */
+    size_t conflated = 0;
+    /** messages dropped because a send was in flight, or because they are deltas of a keyframe that was dropped */
+    size_t dropped = 0;
+    /** messages dropped, or replaced by a newer one, to keep to the maximum rate of the client */
+    size_t decimated = 0;
+    /** reliable messages sent, retransmissions excluded, see send_reliable() */
+    size_t reliable_sent = 0;
+    size_t retransmitted = 0;
+    /** reliable messages given up after ReliabilityOptions::max_retries retransmissions */
+    size_t reliable_failed = 0;
+    /** reliable messages waiting for an acknowledgement */
+    size_t unacknowledged = 0;
+    /** smoothed round trip time measured with the acknowledgements of the reliable messages, 0 until one is received */
+    std::chrono::nanoseconds rtt{0};
+  };
+
+  /**
+   * @brief description of a client of the server
+   */
+  struct SubscriberInfo
+  {
+    size_t id;
+    boost::asio::ip::udp::endpoint endpoint;
+    std::chrono::steady_clock::time_point connected;
+    /** last time a datagram was received from the client */
+    std::chrono::steady_clock::time_point last_seen;
+    /** index of the shard serving the client, see set_shards() */
+    size_t shard;
+    ConflationPolicy policy;
+    /** maximum number of messages per second sent to the client, 0 for no limit, see set_rate_limit() */
+    double max_rate;
+    /** true if the client reads the messages from the shared memory ring, see set_shared_memory() */
+    bool shared_memory;
+    SubscriberStats stats;
+  };
+
   /**
    * @brief Construct a new UDPServer object
    *
@@ -70,11 +142,146 @@ public:
    * @param [in] max_packet_size maximum size for packets exchanged
    */
   void connect(uint16_t port, size_t max_packet_size = 1024);
+  /**
+   * @brief port the server is bound to, the one chosen by the system when connected to port 0
+   */
+  uint16_t port() const noexcept;
   /**
    * @brief make the server verbose
    * @param state if true the server will be verbose
    */
   void set_verbose(bool state);
+  /**
+   * @brief split the messages sent into chunks that each fit in one datagram
+   * @details clients must enable fragmentation too, see UDPClient::set_fragmentation()
+   * @param [in] state if true messages are fragmented
+   * @param [in] max_datagram_size maximum size of each datagram, fragment header included
+   */
+  void set_fragmentation(bool state, size_t max_datagram_size = UDPDataLink::ethernet_udp_payload);
+  /**
+   * @brief send each message once to a multicast group instead of once to each client
+   * @details clients receive the messages by joining the group, see UDPClient::join_multicast(). Messages from clients
+   * are still received on the port of the server.
+   * @param [in] group IPv4 multicast address, e.g. 239.255.0.1
+   * @param [in] port port the members of the group listen on
+   * @param [in] options TTL, loopback and interface used to send
+   * @throw std::invalid_argument if group is not an IPv4 multicast address
+   */
+  void set_multicast(const std::string & group, uint16_t port, const UDPDataLink::MulticastOptions & options = {});
+  /**
+   * @brief go back to sending messages to each client
+   */
+  void disable_multicast();
+  /**
+   * @brief use sendmmsg/recvmmsg to send an update to all clients and to read bursts of datagrams with one system
+   * call
+   * @details only available on Linux, the default asio path is kept elsewhere. Must be called before
+   * start_reception() or receive()
+   * @param [in] state if true batched I/O is used
+   * @param [in] batch_size maximum number of datagrams per system call
+   * @return true if batched I/O is enabled
+   */
+  bool set_batched_io(bool state, size_t batch_size = 64);
+  /**
+   * @brief use an io_uring instead of asio: a multishot receive into buffers registered with the kernel, and the sends
+   * of an update to all clients submitted with one system call
+   * @details only available on Linux 6.0 and later, see io_uring.h. Replaces the batched I/O path, which is its
+   * fallback when io_uring is not supported. Must be called before start_reception() or receive()
+   * @param [in] state if true the io_uring is used
+   * @param [in] batch_size maximum number of sends per submission, also the number of reception buffers
+   * @return true if the io_uring is used
+   */
+  bool set_io_uring(bool state, size_t batch_size = 64);
+  /**
+   * @brief number of system calls made by the batched I/O path or the io_uring since it was enabled
+   */
+  size_t batched_io_syscalls() const noexcept;
+  /**
+   * @brief spread the server over several sockets bound to the same port with SO_REUSEPORT, each with its own thread
+   * @details the kernel dispatches each client to one socket, which then keeps track of it and sends it the data. The
+   * work of receiving, registering clients and fanning out the data is thus shared by count threads. With more than
+   * one shard, send_data() hands the data over to the shard threads instead of sending it on the caller's thread and
+   * reception_callback may be called from several threads at once. Must be called before the reception starts and
+   * before any client registers. Called before connect(), the sockets are opened and bound by connect()
+   * @param [in] count number of sockets and threads, 1 to go back to a single socket
+   * @return false if SO_REUSEPORT is not supported, in which case a single socket is kept, or if clients are registered
+   * or the reception runs, in which case the shards are kept
+   */
+  bool set_shards(size_t count);
+  /**
+   * @brief trade CPU time for latency, see UDPDataLink::LowLatencyOptions
+   * @details the socket options are set immediately and on the sockets opened later, the thread options when
+   * start_reception() starts the shard threads. receive() leaves the calling thread untouched. The server does not use
+   * receive timestamps
+   * @return false if a socket option could not be set, the reason is printed on the error output
+   */
+  bool set_low_latency(const UDPDataLink::LowLatencyOptions & options);
+  /**
+   * @brief number of sockets and threads used by the server
+   */
+  size_t shards() const noexcept
+  {
+    return shards_.size();
+  }
+  /**
+   * @brief set the retransmit window and timeouts of the reliable messages sent to the clients connecting from now on
+   * @see send_reliable()
+   * @throw std::invalid_argument if the window is empty or larger than UDPDataLink::AckPayload::window
+   */
+  void set_reliability(const UDPDataLink::ReliabilityOptions & options);
+  /**
+   * @brief also write the messages to a shared memory ring read by the clients of the same host, see shared_memory.h
+   * @details enabled by default, the ring is created by connect() and messages are only copied to it while a client
+   * reads it. The clients reading it no longer receive over UDP the messages that fit in a slot, see
+   * UDPClient::set_shared_memory(). Not used in multicast mode. Must be called before the reception starts
+   * @param [in] state if false every client receives the messages over UDP
+   * @return false if the ring could not be created, the reason is printed on the error output
+   */
+  bool set_shared_memory(bool state, const UDPDataLink::SharedMemoryOptions & options = {});
+  /**
+   * @brief remove the clients from which nothing was received for more than timeout
+   * @details clients keep themselves registered by sending heartbeats, see UDPClient::set_heartbeat()
+   * @param [in] timeout maximum time between two datagrams of a client, zero to never remove clients
+   */
+  void set_client_timeout(std::chrono::milliseconds timeout);
+  /**
+   * @brief only register the clients whose subscription was accepted, see subscription.h
+   * @details by default any datagram registers its sender. Once required, the datagrams of unknown clients are
+   * dropped, their control messages are answered with a SubscribeStatus::NotSubscribed reply and subscriptions are
+   * checked by subscription_callback(). Publisher and TopicServer require them
+   * @param [in] state if true the clients have to subscribe
+   */
+  void set_subscription_required(bool state);
+  /**
+   * @brief set the conflation policy given to the clients connecting from now on
+   * @details defaults to ConflationPolicy::LatestWins
+   */
+  void set_conflation_policy(ConflationPolicy policy);
+  /**
+   * @brief change the conflation policy of a connected client
+   * @param [in] subscriber_id id of the client, see subscribers()
+   * @return false if no client has this id
+   */
+  bool set_conflation_policy(size_t subscriber_id, ConflationPolicy policy);
+  /**
+   * @brief limit the rate at which messages are sent to a client
+   * @details clients usually ask for it themselves, see UDPClient::set_max_rate(). When the client has no token left,
+   * the newest message of each conflation key waits for the next one with ConflationPolicy::LatestWins, and is dropped
+   * with ConflationPolicy::DropNewest or batched I/O. Multicast and reliable messages are not limited
+   * @param [in] subscriber_id id of the client, see subscribers()
+   * @param [in] rate maximum number of messages per second, 0 for no limit
+   * @param [in] burst number of messages that can be sent back to back, 1 to evenly pace them
+   * @return false if no client has this id
+   */
+  bool set_rate_limit(size_t subscriber_id, double rate, size_t burst = 1);
+  /**
+   * @brief list the clients currently registered
+   */
+  std::vector<SubscriberInfo> subscribers() const;
+  /**
+   * @brief number of clients currently registered
+   */
+  size_t subscriber_count() const;
   /**
    * @brief Set the remote endpoint for the client
    *
@@ -109,6 +316,36 @@ protected:
    * @param [in] size size of the message received
    */
   virtual void reception_callback(const uint8_t * buffer, size_t size);
+  /**
+   * @brief callback called when a client sends a control message the server does not handle itself
+   * @details heartbeats and unsubscriptions are handled by the server and not forwarded
+   *
+   * @param [in] header type and topic of the control message
+   * @param [in] subscriber_id id of the client that sent it, see subscribers()
+   */
+  virtual void control_callback(const UDPDataLink::ControlHeader & header, size_t subscriber_id)
+  {
+    (void)header;
+    (void)subscriber_id;
+  }
+  /**
+   * @brief callback called when a client subscribes, to accept or refuse it
+   * @details called from the reception threads, before the client is registered. reply is filled with the rate asked
+   * by the client and, when fragmentation is enabled, the size of the fragments. Accepts every subscription by default.
+   * The server then refuses the clients accepting smaller datagrams than reply.max_datagram_size
+   *
+   * @param [in] header topic of the subscription
+   * @param [in] request what the client asks for
+   * @param [in,out] reply answer sent to the client, see SubscribeReply::offer()
+   */
+  virtual void subscription_callback(const UDPDataLink::ControlHeader & header,
+                                     const UDPDataLink::SubscribeRequest & request,
+                                     UDPDataLink::SubscribeReply & reply)
+  {
+    (void)header;
+    (void)request;
+    (void)reply;
+  }
   /**
    * @brief send data to client
    *
@@ -116,25 +353,108 @@ protected:
    * @param [in] size size of the buffer in bytes
    */
   void send_data(const uint8_t * buffer, size_t size);
+  /**
+   * @brief send data to client without copying it
+   * @details every send refers to the same buffer, which is released once the last one completes
+   *
+   * @param [in] buffer data to send
+   * @param [in] conflation_key when a client falls behind, only the latest data of each key is kept, see
+   * ConflationPolicy::LatestWins. Independent streams sent by the same server must use different keys.
+   * @param [in] keyframe true if buffer is a keyframe of delta encoding, see Delta.h. It is never conflated into the
+   * deltas of the same key that follow it, and a client that misses it is not sent these deltas until the next keyframe
+   */
+  void send_data(UDPDataLink::SharedBuffer buffer, uint32_t conflation_key = 0, bool keyframe = false);
+  /**
+   * @brief send data to every client accepting it, and retransmit it until each of them acknowledges it
+   * @details for the messages that must arrive, such as mode changes or commands. Clients accept them with
+   * UDPClient::set_reliable_messages() and pass them to their reception_callback in order and once each, the others
+   * are not sent them. Reliable messages are sent right away, even in multicast mode, and never delay the best-effort
+   * ones. Acknowledgements are received and retransmissions sent by the reception
+   * threads, start_reception() or receive() must be running. See reliability.h for the protocol.
+   *
+   * @param [in] buffer the pointer to memory buffer containing data to send
+   * @param [in] size size of the buffer in bytes
+   * @return false if the retransmit window of a client was full, the message is not sent to that client
+   */
+  bool send_reliable(const uint8_t * buffer, size_t size);
+  /**
+   * @brief send data to every client, and retransmit it until each of them acknowledges it, without copying it
+   * @see send_reliable(const uint8_t *, size_t)
+   */
+  bool send_reliable(UDPDataLink::SharedBuffer buffer);
 
 private:
-  void start_receive();
-  void handle_receive(const boost::system::error_code & error, std::size_t bytes_transferred);
+  struct Shard;
+  struct ClientEndpoint;
+  void start_receive(Shard & shard);
+  void handle_receive(Shard & shard, const boost::system::error_code & error, std::size_t bytes_transferred);
+  void handle_batch_receive(Shard & shard, const boost::system::error_code & error);
+  void handle_uring_receive(Shard & shard, const boost::system::error_code & error);
+  void handle_datagram(Shard & shard,
+                       const boost::asio::ip::udp::endpoint & sender,
+                       const uint8_t * buffer,
+                       size_t size);
+  void handle_subscribe(Shard & shard,
+                        const boost::asio::ip::udp::endpoint & sender,
+                        const UDPDataLink::ControlHeader & control,
+                        const uint8_t * buffer,
+                        size_t size);
+  void send_subscribe_reply(Shard & shard,
+                            const boost::asio::ip::udp::endpoint & sender,
+                            uint16_t topic,
+                            const UDPDataLink::SubscribeReply & reply);
   void handle_send(const boost::system::error_code & error, std::size_t bytes_transferred);
-  boost::asio::io_service io_service_;
-  std::thread run_thread_;
-  boost::asio::ip::udp::socket socket_;
-  struct ClientEndpoint
+  void fanout(Shard & shard, const UDPDataLink::ConflatedQueue::Entry & message);
+  void fanout_pending(Shard & shard);
+  void send_batched(Shard & shard,
+                    const uint8_t * buffer,
+                    size_t size,
+                    const UDPDataLink::ConflatedQueue::Entry & message);
+  template<typename Sender>
+  void send_batched(Shard & shard,
+                    Sender & batch_sender,
+                    const uint8_t * buffer,
+                    size_t size,
+                    const UDPDataLink::ConflatedQueue::Entry & message);
+  void open_sockets(size_t count);
+  void create_batched_io(Shard & shard);
+  void apply_multicast_options();
+  bool apply_socket_options();
+  void start_thread(Shard & shard, size_t index);
+  void send_multicast(const uint8_t * buffer, size_t size);
+  void expire_clients(Shard & shard);
+  void retransmit(Shard & shard);
+  void write_shared_memory(const uint8_t * buffer, size_t size);
+  // false, with an error printed, if fragmentation is enabled and size needs more chunks than a FragmentHeader counts
+  bool fits_fragments(size_t size) const;
+  bool in_shared_memory(size_t size) const noexcept;
+  void add_shared_memory_reader(ClientEndpoint & client);
+  void remove_shared_memory_reader(const ClientEndpoint & client) noexcept;
+  struct ClientEndpoint : public std::enable_shared_from_this<ClientEndpoint>
   {
-    ClientEndpoint(const boost::asio::ip::udp::endpoint & ep,
+    ClientEndpoint(boost::asio::ip::udp::socket & socket,
+                   const boost::asio::ip::udp::endpoint & ep,
                    size_t clientId,
-                   size_t default_packet_size = 0,
+                   ConflationPolicy policy,
+                   const UDPDataLink::ReliabilityOptions & reliability,
+                   std::atomic<uint32_t> & message_ids,
                    bool verbose = false)
-    : endpoint_(ep), clientId_(clientId)
+    : socket_(socket),
+      reliable_(reliability, static_cast<uint32_t>(clientId)),
+      message_ids_(message_ids),
+      endpoint_(ep),
+      policy_(policy),
+      pacing_timer_(socket.get_executor()),
+      verbose_(verbose),
+      clientId_(clientId)
     {
-      buffer_out_.resize(default_packet_size);
+      pending_.reserve(pending_reserve);
+      missed_keyframes_.reserve(pending_reserve);
     }
 
+    // Conflation keys waiting at once that do not make the queue allocate, one per topic
+    static constexpr size_t pending_reserve = 16;
+
     size_t clientId() const noexcept
     {
       return clientId_;
@@ -145,37 +465,257 @@ private:
       return endpoint_;
     }
 
-    void send_data(boost::asio::ip::udp::socket & socket_, const uint8_t * buffer, size_t size)
+    void set_policy(ConflationPolicy policy)
     {
-      if(sending_)
+      std::lock_guard<std::mutex> lock(mutex_);
+      policy_ = policy;
+    }
+
+    SubscriberStats stats() const
+    {
+      SubscriberStats stats;
       {
-        if(verbose_)
+        std::lock_guard<std::mutex> lock(mutex_);
+        stats = stats_;
+      }
+      std::lock_guard<std::mutex> lock(reliable_mutex_);
+      stats.reliable_sent = reliable_.sent();
+      stats.retransmitted = reliable_.retransmitted();
+      stats.reliable_failed = reliable_.failed();
+      stats.unacknowledged = reliable_.unacknowledged();
+      stats.rtt = reliable_.rtt().smoothed();
+      return stats;
+    }
+
+    ConflationPolicy policy() const
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      return policy_;
+    }
+
+    void set_rate(double rate, size_t burst)
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      rate_.set_rate(rate, burst);
+      limited_ = rate_.limited();
+      if(!rate_.limited()) missed_keyframes_.clear();
+    }
+
+    double rate() const
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      return rate_.rate();
+    }
+
+    /** @return false if the client already read from shared memory */
+    bool set_shared_memory() noexcept
+    {
+      return !shared_memory_.exchange(true);
+    }
+
+    /** @brief true if the client accepts reliable messages, see ControlHeader::reliable_flag */
+    bool accepts_reliable() const noexcept
+    {
+      return accepts_reliable_.load(std::memory_order_relaxed);
+    }
+
+    void set_accepts_reliable(bool state) noexcept
+    {
+      accepts_reliable_.store(state, std::memory_order_relaxed);
+    }
+
+    /** @brief true if the client reads the messages that fit in the shared memory ring from it */
+    bool shared_memory() const noexcept
+    {
+      return shared_memory_.load(std::memory_order_relaxed);
+    }
+
+    /** @return false if the message must be dropped to keep to the rate of the client, for the batched I/O path */
+    bool admit(std::chrono::steady_clock::time_point now, const UDPDataLink::ConflatedQueue::Entry & message)
+    {
+      if(!limited_.load(std::memory_order_relaxed)) return true;
+      std::lock_guard<std::mutex> lock(mutex_);
+      // The deltas of a dropped keyframe do not take the tokens, so that the next keyframe finds one
+      if(!message.keyframe && keyframe_missed(message.key))
+      {
+        ++stats_.dropped;
+        return false;
+      }
+      if(rate_.take(now))
+      {
+        if(message.keyframe) keyframe_sent(message.key);
+        return true;
+      }
+      ++stats_.decimated;
+      if(message.keyframe) keyframe_dropped(message.key);
+      return false;
+    }
+
+    /**
+     * @brief send a message, or keep it for later if a previous one is still being sent
+     * @param [in] message a message waiting with the same key is replaced by this one, unless it is a keyframe
+     * @param [in] max_datagram_size size of the fragments, 0 to send the message in a single datagram
+     */
+    void send_data(const UDPDataLink::ConflatedQueue::Entry & message, size_t max_datagram_size)
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if(policy_ == ConflationPolicy::DropNewest && !message.keyframe && keyframe_missed(message.key))
+      {
+        ++stats_.dropped;
+        return;
+      }
+      if(in_flight_ || pacing_)
+      {
+        if(policy_ == ConflationPolicy::DropNewest)
+        {
+          ++stats_.dropped;
+          if(message.keyframe) keyframe_dropped(message.key);
+          if(verbose_)
+          {
+            std::cout << "Client " << clientId_ << ": a buffer is already being sent, skipping message" << std::endl;
+          }
+          return;
+        }
+        if(pending_.push(message.key, message.buffer, message.message_id, message.keyframe))
         {
-          std::cout << "Client " << clientId_ << ": a buffer is already being sent, skipping message" << std::endl;
+          if(in_flight_)
+            ++stats_.conflated;
+          else
+            ++stats_.decimated;
         }
+        pending_max_datagram_size_ = max_datagram_size;
         return;
       }
+      if(rate_.limited())
+      {
+        const auto now = std::chrono::steady_clock::now();
+        if(!rate_.take(now))
+        {
+          if(policy_ == ConflationPolicy::DropNewest)
+          {
+            ++stats_.decimated;
+            if(message.keyframe) keyframe_dropped(message.key);
+            return;
+          }
+          pending_.push(message.key, message.buffer, message.message_id, message.keyframe);
+          pending_max_datagram_size_ = max_datagram_size;
+          start_pacing(now);
+          return;
+        }
+      }
+      if(message.keyframe) keyframe_sent(message.key);
+      start_send(message.buffer, message.message_id, max_datagram_size);
+    }
 
-      // Resize sending buffer if it is smaller than the input data
-      if(size > buffer_out_.size())
+    /**
+     * @brief send a reliable message and keep it until the client acknowledges it
+     * @return false if the retransmit window is full
+     */
+    bool send_reliable(const UDPDataLink::SharedBuffer & payload,
+                       size_t max_datagram_size,
+                       std::chrono::steady_clock::time_point now)
+    {
+      std::lock_guard<std::mutex> lock(reliable_mutex_);
+      const auto * entry = reliable_.push(payload, now);
+      if(!entry) return false;
+      send_reliable_entry(*entry, max_datagram_size);
+      return true;
+    }
+
+    void acknowledge(const UDPDataLink::AckPayload & ack,
+                     bool nack,
+                     size_t max_datagram_size,
+                     std::chrono::steady_clock::time_point now)
+    {
+      std::lock_guard<std::mutex> lock(reliable_mutex_);
+      reliable_.acknowledge(ack, nack, now,
+                            [&](const auto & entry) { send_reliable_entry(entry, max_datagram_size); });
+    }
+
+    /** @return deadline of the next retransmission */
+    std::chrono::steady_clock::time_point retransmit_expired(size_t max_datagram_size,
+                                                             std::chrono::steady_clock::time_point now)
+    {
+      std::lock_guard<std::mutex> lock(reliable_mutex_);
+      return reliable_.retransmit_expired(now,
+                                          [&](const auto & entry) { send_reliable_entry(entry, max_datagram_size); });
+    }
+
+  protected:
+    // Reliable messages are rare, they are sent right away from the calling thread, next to the best-effort sends.
+    // Must be called with reliable_mutex_ locked
+    void send_reliable_entry(const UDPDataLink::RetransmitWindow::Entry & entry, size_t max_datagram_size)
+    {
+      boost::system::error_code error;
+      const auto & payload = *entry.payload;
+      if(max_datagram_size == 0)
       {
-        if(verbose_)
+        const std::array<boost::asio::const_buffer, 2> datagram = {boost::asio::buffer(entry.header),
+                                                                   boost::asio::buffer(payload)};
+        socket_.send_to(datagram, endpoint_, 0, error);
+      }
+      else
+      {
+        std::vector<uint8_t> message(entry.header.begin(), entry.header.end());
+        message.insert(message.end(), payload.begin(), payload.end());
+        const auto chunk_size = UDPDataLink::FragmentHeader::chunk_size(max_datagram_size);
+        UDPDataLink::make_fragment_headers(message_ids_++, message.size(), max_datagram_size, reliable_fragments_);
+        for(size_t i = 0; i < reliable_fragments_.size() && !error; ++i)
         {
-          std::cout << "Client " << clientId_ << ": send buffer is too small, resizing to " << size << std::endl;
+          const auto offset = i * chunk_size;
+          const std::array<boost::asio::const_buffer, 2> datagram = {
+              boost::asio::buffer(reliable_fragments_[i]),
+              boost::asio::buffer(message.data() + offset, std::min(chunk_size, message.size() - offset))};
+          socket_.send_to(datagram, endpoint_, 0, error);
         }
-        buffer_out_.resize(size);
       }
+      if(error)
+      {
+        std::cerr << "Client " << clientId_ << ": error while sending a reliable message: " << error.message()
+                  << std::endl;
+      }
+    }
 
-      // Copy data to the send buffer. it needs to be kept alive until async_send_to completes
-      buffer_out_.assign(buffer, buffer + size);
+    // Must be called with mutex_ locked and no send in flight
+    void start_send(const UDPDataLink::SharedBuffer & buffer, uint32_t message_id, size_t max_datagram_size)
+    {
+      // The shared buffer is kept alive until the last datagram is sent
+      in_flight_ = buffer;
+      const auto size = buffer->size();
+      if(max_datagram_size == 0)
+      {
+        if(verbose_)
+        {
+          std::cout << "Client " << clientId_ << ": sending data to " << endpoint_ << ", size: " << size << std::endl;
+        }
+        pending_datagrams_ = 1;
+        socket_.async_send_to(boost::asio::buffer(*buffer), endpoint_,
+                              UDPDataLink::bind_handler_memory(
+                                  handler_memory_, [self = shared_from_this()](auto error, auto bytes_transferred)
+                                  { self->handle_sent(error, bytes_transferred); }));
+        return;
+      }
 
+      const auto chunk_size = UDPDataLink::FragmentHeader::chunk_size(max_datagram_size);
+      UDPDataLink::make_fragment_headers(message_id, size, max_datagram_size, fragment_headers_);
+      const auto count = fragment_headers_.size();
       if(verbose_)
       {
-        std::cout << "Client " << clientId_ << ": sending data to " << endpoint_ << ", size: " << size << std::endl;
+        std::cout << "Client " << clientId_ << ": sending data to " << endpoint_ << ", size: " << size << " in "
+                  << count << " fragments" << std::endl;
+      }
+      pending_datagrams_ = count;
+      for(size_t i = 0; i < count; ++i)
+      {
+        const auto offset = i * chunk_size;
+        const std::array<boost::asio::const_buffer, 2> datagram = {
+            boost::asio::buffer(fragment_headers_[i]),
+            boost::asio::buffer(buffer->data() + offset, std::min(chunk_size, size - offset))};
+        socket_.async_send_to(datagram, endpoint_,
+                              UDPDataLink::bind_handler_memory(
+                                  handler_memory_, [self = shared_from_this()](auto error, auto bytes_transferred)
+                                  { self->handle_sent(error, bytes_transferred); }));
       }
-      sending_ = true;
-      socket_.async_send_to(boost::asio::buffer(buffer_out_, size), endpoint_,
-                            [this](auto error, auto bytes_transferred) { handle_sent(error, bytes_transferred); });
     }
 
     void handle_sent(const boost::system::error_code & error, std::size_t bytes_transferred)
@@ -191,19 +731,156 @@ private:
       {
         std::cerr << "Client " << clientId_ << ": error while sending the response" << std::endl;
       }
-      sending_ = false;
+      std::lock_guard<std::mutex> lock(mutex_);
+      if(--pending_datagrams_ > 0) return;
+      ++stats_.sent;
+      in_flight_.reset();
+      send_pending();
     }
 
-  protected:
-    std::vector<uint8_t> buffer_out_;
+    // Latest wins: send the newest message of each key received while one was in flight or no token was left.
+    // Must be called with mutex_ locked and no send in flight
+    void send_pending()
+    {
+      if(pending_.empty()) return;
+      if(rate_.limited())
+      {
+        const auto now = std::chrono::steady_clock::now();
+        if(!rate_.take(now))
+        {
+          start_pacing(now);
+          return;
+        }
+      }
+      UDPDataLink::ConflatedQueue::Entry next{};
+      if(pending_.pop(next)) start_send(next.buffer, next.message_id, pending_max_datagram_size_);
+    }
+
+    // The keys whose last keyframe was dropped, their deltas cannot be decoded. Must be called with mutex_ locked
+    bool keyframe_missed(uint32_t key) const noexcept
+    {
+      return std::find(missed_keyframes_.begin(), missed_keyframes_.end(), key) != missed_keyframes_.end();
+    }
+
+    void keyframe_dropped(uint32_t key)
+    {
+      if(!keyframe_missed(key)) missed_keyframes_.push_back(key);
+    }
+
+    void keyframe_sent(uint32_t key) noexcept
+    {
+      missed_keyframes_.erase(std::remove(missed_keyframes_.begin(), missed_keyframes_.end(), key),
+                              missed_keyframes_.end());
+    }
+
+    // Must be called with mutex_ locked
+    void start_pacing(std::chrono::steady_clock::time_point now)
+    {
+      pacing_ = true;
+      pacing_timer_.expires_at(rate_.next_token(now));
+      // A removed client cancels its timer, the handler must not keep it alive
+      pacing_timer_.async_wait(
+          [weak = weak_from_this()](const boost::system::error_code & error)
+          {
+            const auto self = weak.lock();
+            if(error || !self) return;
+            std::lock_guard<std::mutex> lock(self->mutex_);
+            self->pacing_ = false;
+            if(!self->in_flight_) self->send_pending();
+          });
+    }
+
+    mutable std::mutex mutex_;
+    boost::asio::ip::udp::socket & socket_;
+    UDPDataLink::SharedBuffer in_flight_;
+    UDPDataLink::ConflatedQueue pending_;
+    size_t pending_max_datagram_size_ = 0;
+    std::vector<uint32_t> missed_keyframes_;
+    std::vector<UDPDataLink::FragmentHeader::Bytes> fragment_headers_;
+    size_t pending_datagrams_ = 0;
+    // Sends are started from the thread calling send_data(), outside of the io_service, recycle their memory
+    std::shared_ptr<UDPDataLink::HandlerMemory> handler_memory_ = std::make_shared<UDPDataLink::HandlerMemory>();
+    // Separate from mutex_ so that best-effort sends never wait for the reliable ones
+    mutable std::mutex reliable_mutex_;
+    UDPDataLink::RetransmitWindow reliable_;
+    std::vector<UDPDataLink::FragmentHeader::Bytes> reliable_fragments_;
+    std::atomic<uint32_t> & message_ids_;
     boost::asio::ip::udp::endpoint endpoint_;
-    bool sending_ = false;
+    ConflationPolicy policy_;
+    UDPDataLink::TokenBucket rate_;
+    // Lets the batched I/O path skip the lock of the clients without a rate limit
+    std::atomic<bool> limited_{false};
+    std::atomic<bool> shared_memory_{false};
+    // Set from the flags of every control message of the client
+    std::atomic<bool> accepts_reliable_{false};
+    boost::asio::steady_timer pacing_timer_;
+    bool pacing_ = false;
+    SubscriberStats stats_;
     bool verbose_ = false;
     size_t clientId_ = 0;
   };
 
-  std::list<ClientEndpoint> remote_endpoints_;
-  boost::asio::ip::udp::endpoint new_client_endpoint_;
-  std::vector<uint8_t> buffer_in_;
+  /**
+   * @brief a socket with its own thread and clients
+   */
+  struct Shard
+  {
+    Shard() : socket_(io_service_), retransmit_timer_(io_service_)
+    {
+      pending_.reserve(ClientEndpoint::pending_reserve);
+      sending_.reserve(ClientEndpoint::pending_reserve);
+    }
+    boost::asio::io_service io_service_;
+    std::thread run_thread_;
+    boost::asio::ip::udp::socket socket_;
+    // Accessed by the shard thread and by the thread calling send_data() when there is a single shard
+    mutable std::mutex clients_mutex_;
+    UDPDataLink::ClientRegistry<ClientEndpoint> clients_;
+    std::chrono::steady_clock::time_point last_expiry_;
+    boost::asio::ip::udp::endpoint new_client_endpoint_;
+    std::vector<uint8_t> buffer_in_;
+    std::vector<UDPDataLink::FragmentHeader::Bytes> fragment_headers_;
+    std::unique_ptr<UDPDataLink::BatchSender> batch_sender_;
+    std::unique_ptr<UDPDataLink::BatchReceiver> batch_receiver_;
+    std::unique_ptr<UDPDataLink::UringSender> uring_sender_;
+    std::unique_ptr<UDPDataLink::UringReceiver> uring_receiver_;
+    // Latest data of each key handed over by send_data() and not sent yet, older data is dropped if the shard falls
+    // behind
+    std::mutex pending_mutex_;
+    UDPDataLink::ConflatedQueue pending_;
+    UDPDataLink::ConflatedQueue sending_;
+    bool fanout_scheduled_ = false;
+    // Armed for the earliest retransmission of the reliable messages of the clients, see retransmit()
+    boost::asio::steady_timer retransmit_timer_;
+    std::atomic<bool> retransmit_scheduled_{false};
+    std::vector<std::shared_ptr<ClientEndpoint>> retransmit_clients_;
+  };
+
+  std::vector<std::unique_ptr<Shard>> shards_;
+  uint16_t port_ = 0;
+  size_t max_packet_size_ = 1024;
   bool verbose_;
+  bool fragmentation_ = false;
+  size_t max_datagram_size_ = UDPDataLink::ethernet_udp_payload;
+  size_t batch_size_ = 0;
+  bool io_uring_ = false;
+  std::chrono::milliseconds client_timeout_{0};
+  bool subscription_required_ = false;
+  ConflationPolicy conflation_policy_ = ConflationPolicy::LatestWins;
+  bool multicast_ = false;
+  boost::asio::ip::udp::endpoint multicast_endpoint_;
+  UDPDataLink::MulticastOptions multicast_options_;
+  UDPDataLink::LowLatencyOptions low_latency_;
+  UDPDataLink::ReliabilityOptions reliability_;
+  bool shared_memory_enabled_ = true;
+  UDPDataLink::SharedMemoryOptions shared_memory_options_;
+  // Messages can be sent from several threads, the ring has a single writer
+  std::mutex shared_memory_mutex_;
+  std::unique_ptr<UDPDataLink::SharedMemoryWriter> shared_memory_;
+  size_t shared_memory_slot_size_ = 0;
+  uint32_t shared_memory_generation_ = 0;
+  // Registered clients reading the ring, nothing is written to it while there is none
+  std::atomic<size_t> shared_memory_readers_{0};
+  std::atomic<uint32_t> next_message_id_{0};
+  std::atomic<size_t> next_client_id_{0};
 };
@@ -0,0 +1,266 @@
+#include "batched_io.h"
+#include "low_latency.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#ifdef __linux__
+#  include <poll.h>
+#  include <sys/socket.h>
+#endif
+
+namespace UDPDataLink
+{
+
+#ifdef __linux__
+
+bool batched_io_supported() noexcept
+{
+  return true;
+}
+
+struct BatchSender::Impl
+{
+  struct Entry
+  {
+    sockaddr_storage address;
+    socklen_t address_size;
+    iovec iov[2];
+    size_t iov_count;
+  };
+  std::vector<Entry> entries;
+  std::vector<mmsghdr> headers;
+};
+
+BatchSender::BatchSender(size_t batch_size) : impl_(new Impl), batch_size_(std::max<size_t>(batch_size, 1))
+{
+  impl_->headers.resize(batch_size_);
+}
+
+BatchSender::~BatchSender() = default;
+
+void BatchSender::add(const boost::asio::ip::udp::endpoint & destination,
+                      boost::asio::const_buffer header,
+                      boost::asio::const_buffer payload)
+{
+  Impl::Entry entry;
+  std::memcpy(&entry.address, destination.data(), destination.size());
+  entry.address_size = static_cast<socklen_t>(destination.size());
+  entry.iov_count = 0;
+  for(const auto & buffer : {header, payload})
+  {
+    if(buffer.size() == 0) continue;
+    entry.iov[entry.iov_count].iov_base = const_cast<void *>(buffer.data());
+    entry.iov[entry.iov_count].iov_len = buffer.size();
+    ++entry.iov_count;
+  }
+  impl_->entries.push_back(entry);
+}
+
+size_t BatchSender::size() const noexcept
+{
+  return impl_->entries.size();
+}
+
+size_t BatchSender::flush(int fd)
+{
+  auto & entries = impl_->entries;
+  auto & headers = impl_->headers;
+  size_t sent = 0;
+  size_t next = 0;
+  while(next < entries.size())
+  {
+    const auto count = std::min(batch_size_, entries.size() - next);
+    for(size_t i = 0; i < count; ++i)
+    {
+      auto & entry = entries[next + i];
+      auto & header = headers[i].msg_hdr;
+      std::memset(&headers[i], 0, sizeof(mmsghdr));
+      header.msg_name = &entry.address;
+      header.msg_namelen = entry.address_size;
+      header.msg_iov = entry.iov;
+      header.msg_iovlen = entry.iov_count;
+    }
+    ++syscalls_;
+    const int result = ::sendmmsg(fd, headers.data(), static_cast<unsigned int>(count), 0);
+    if(result > 0)
+    {
+      sent += static_cast<size_t>(result);
+      next += static_cast<size_t>(result);
+      continue;
+    }
+    if(errno == EINTR) continue;
+    if(errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS)
+    {
+      // The socket send buffer is full, leave the kernel a moment to drain it before giving up on the others
+      pollfd pfd{fd, POLLOUT, 0};
+      if(::poll(&pfd, 1, 1) > 0) continue;
+      break;
+    }
+    // The first datagram of the batch failed (e.g. unreachable client), skip it and send the others
+    ++next;
+  }
+  entries.clear();
+  return sent;
+}
+
+struct BatchReceiver::Impl
+{
+  std::vector<uint8_t> buffers;
+  std::vector<iovec> iovs;
+  std::vector<sockaddr_storage> addresses;
+  std::vector<mmsghdr> headers;
+  std::vector<uint8_t> controls;
+};
+
+BatchReceiver::BatchReceiver(size_t batch_size, size_t buffer_size)
+: impl_(new Impl), batch_size_(std::max<size_t>(batch_size, 1)), buffer_size_(0)
+{
+  impl_->iovs.resize(batch_size_);
+  impl_->addresses.resize(batch_size_);
+  impl_->headers.resize(batch_size_);
+  impl_->controls.resize(batch_size_ * timestamp_control_size);
+  resize_buffers(buffer_size);
+}
+
+BatchReceiver::~BatchReceiver() = default;
+
+void BatchReceiver::resize_buffers(size_t buffer_size)
+{
+  buffer_size_ = buffer_size;
+  impl_->buffers.resize(batch_size_ * buffer_size_);
+  for(size_t i = 0; i < batch_size_; ++i)
+  {
+    impl_->iovs[i].iov_base = impl_->buffers.data() + i * buffer_size_;
+    impl_->iovs[i].iov_len = buffer_size_;
+  }
+}
+
+size_t BatchReceiver::receive(int fd)
+{
+  auto & headers = impl_->headers;
+  for(size_t i = 0; i < batch_size_; ++i)
+  {
+    std::memset(&headers[i], 0, sizeof(mmsghdr));
+    headers[i].msg_hdr.msg_name = &impl_->addresses[i];
+    headers[i].msg_hdr.msg_namelen = sizeof(sockaddr_storage);
+    headers[i].msg_hdr.msg_iov = &impl_->iovs[i];
+    headers[i].msg_hdr.msg_iovlen = 1;
+    headers[i].msg_hdr.msg_control = impl_->controls.data() + i * timestamp_control_size;
+    headers[i].msg_hdr.msg_controllen = timestamp_control_size;
+  }
+  int result = 0;
+  do
+  {
+    ++syscalls_;
+    result = ::recvmmsg(fd, headers.data(), static_cast<unsigned int>(batch_size_), MSG_DONTWAIT, nullptr);
+  } while(result < 0 && errno == EINTR);
+  return result > 0 ? static_cast<size_t>(result) : 0;
+}
+
+const uint8_t * BatchReceiver::data(size_t index) const noexcept
+{
+  return impl_->buffers.data() + index * buffer_size_;
+}
+
+size_t BatchReceiver::size(size_t index) const noexcept
+{
+  return std::min<size_t>(impl_->headers[index].msg_len, buffer_size_);
+}
+
+bool BatchReceiver::truncated(size_t index) const noexcept
+{
+  return (impl_->headers[index].msg_hdr.msg_flags & MSG_TRUNC) != 0;
+}
+
+boost::asio::ip::udp::endpoint BatchReceiver::sender(size_t index) const
+{
+  boost::asio::ip::udp::endpoint endpoint;
+  const auto size = std::min<size_t>(impl_->headers[index].msg_hdr.msg_namelen, endpoint.capacity());
+  std::memcpy(endpoint.data(), &impl_->addresses[index], size);
+  endpoint.resize(size);
+  return endpoint;
+}
+
+int64_t BatchReceiver::timestamp(size_t index) const noexcept
+{
+  const auto & header = impl_->headers[index].msg_hdr;
+  return receive_timestamp(header.msg_control, header.msg_controllen);
+}
+
+#else
+
+bool batched_io_supported() noexcept
+{
+  return false;
+}
+
+struct BatchSender::Impl
+{
+};
+
+BatchSender::BatchSender(size_t batch_size) : impl_(new Impl), batch_size_(batch_size) {}
+
+BatchSender::~BatchSender() = default;
+
+void BatchSender::add(const boost::asio::ip::udp::endpoint &, boost::asio::const_buffer, boost::asio::const_buffer) {}
+
+size_t BatchSender::size() const noexcept
+{
+  return 0;
+}
+
+size_t BatchSender::flush(int)
+{
+  return 0;
+}
+
+struct BatchReceiver::Impl
+{
+};
+
+BatchReceiver::BatchReceiver(size_t batch_size, size_t buffer_size)
+: impl_(new Impl), batch_size_(batch_size), buffer_size_(buffer_size)
+{
+}
+
+BatchReceiver::~BatchReceiver() = default;
+
+void BatchReceiver::resize_buffers(size_t buffer_size)
+{
+  buffer_size_ = buffer_size;
+}
+
+size_t BatchReceiver::receive(int)
+{
+  return 0;
+}
+
+const uint8_t * BatchReceiver::data(size_t) const noexcept
+{
+  return nullptr;
+}
+
+size_t BatchReceiver::size(size_t) const noexcept
+{
+  return 0;
+}
+
+bool BatchReceiver::truncated(size_t) const noexcept
+{
+  return false;
+}
+
+boost::asio::ip::udp::endpoint BatchReceiver::sender(size_t) const
+{
+  return {};
+}
+
+int64_t BatchReceiver::timestamp(size_t) const noexcept
+{
+  return 0;
+}
+
+#endif
+
+} // namespace UDPDataLink
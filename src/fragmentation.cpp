@@ -0,0 +1,186 @@
+#include "fragmentation.h"
+#include <algorithm>
+#include <cstring>
+
+namespace UDPDataLink
+{
+
+namespace
+{
+
+void write_u16(uint8_t * buffer, uint16_t value) noexcept
+{
+  buffer[0] = static_cast<uint8_t>(value);
+  buffer[1] = static_cast<uint8_t>(value >> 8);
+}
+
+void write_u32(uint8_t * buffer, uint32_t value) noexcept
+{
+  for(int i = 0; i < 4; ++i) buffer[i] = static_cast<uint8_t>(value >> (8 * i));
+}
+
+uint16_t read_u16(const uint8_t * buffer) noexcept
+{
+  return static_cast<uint16_t>(buffer[0] | (buffer[1] << 8));
+}
+
+uint32_t read_u32(const uint8_t * buffer) noexcept
+{
+  uint32_t value = 0;
+  for(int i = 0; i < 4; ++i) value |= static_cast<uint32_t>(buffer[i]) << (8 * i);
+  return value;
+}
+
+} // namespace
+
+void FragmentHeader::write(uint8_t * buffer) const noexcept
+{
+  write_u16(buffer, magic);
+  write_u32(buffer + 2, message_id);
+  write_u16(buffer + 6, index);
+  write_u16(buffer + 8, count);
+  write_u32(buffer + 10, total_size);
+}
+
+bool FragmentHeader::read(const uint8_t * buffer, size_t size, FragmentHeader & header) noexcept
+{
+  if(size < FragmentHeader::size || read_u16(buffer) != magic) return false;
+  header.message_id = read_u32(buffer + 2);
+  header.index = read_u16(buffer + 6);
+  header.count = read_u16(buffer + 8);
+  header.total_size = read_u32(buffer + 10);
+  return header.count > 0 && header.index < header.count;
+}
+
+void make_fragment_headers(uint32_t message_id,
+                           size_t size,
+                           size_t max_datagram_size,
+                           std::vector<FragmentHeader::Bytes> & headers)
+{
+  const auto count = FragmentHeader::chunk_count(size, max_datagram_size);
+  headers.resize(count);
+  FragmentHeader header;
+  header.message_id = message_id;
+  header.count = static_cast<uint16_t>(count);
+  header.total_size = static_cast<uint32_t>(size);
+  for(size_t i = 0; i < count; ++i)
+  {
+    header.index = static_cast<uint16_t>(i);
+    header.write(headers[i].data());
+  }
+}
+
+Reassembler::Reassembler(std::chrono::milliseconds timeout, size_t slots, size_t max_message_size)
+: timeout_(timeout), max_message_size_(max_message_size), slots_(std::max<size_t>(slots, 1))
+{
+}
+
+void Reassembler::evict_expired(clock::time_point now)
+{
+  for(auto & slot : slots_)
+  {
+    if(slot.in_use && now - slot.first_seen > timeout_)
+    {
+      slot.in_use = false;
+      ++evicted_;
+    }
+  }
+}
+
+Reassembler::Slot & Reassembler::acquire(const FragmentHeader & header, clock::time_point now)
+{
+  Slot * free_slot = nullptr;
+  Slot * oldest = &slots_.front();
+  for(auto & slot : slots_)
+  {
+    if(slot.in_use && slot.message_id == header.message_id) return slot;
+    if(!slot.in_use && !free_slot) free_slot = &slot;
+    if(slot.in_use && slot.first_seen < oldest->first_seen) oldest = &slot;
+  }
+  if(!free_slot)
+  {
+    free_slot = oldest;
+    ++evicted_;
+  }
+  auto & slot = *free_slot;
+  slot.in_use = true;
+  slot.message_id = header.message_id;
+  slot.count = header.count;
+  slot.received = 0;
+  slot.total_size = header.total_size;
+  slot.chunk_size = 0;
+  slot.first_seen = now;
+  // resize() and assign() keep the capacity: buffers are only allocated for the largest message seen so far
+  slot.data.resize(header.total_size);
+  slot.chunks.assign(header.count, false);
+  return slot;
+}
+
+bool Reassembler::push(const uint8_t * datagram, size_t size, const uint8_t *& message, size_t & message_size)
+{
+  FragmentHeader header;
+  if(!FragmentHeader::read(datagram, size, header) || header.total_size > max_message_size_)
+  {
+    ++invalid_;
+    return false;
+  }
+  const auto * payload = datagram + FragmentHeader::size;
+  const auto payload_size = size - FragmentHeader::size;
+  if(payload_size > header.total_size)
+  {
+    ++invalid_;
+    return false;
+  }
+
+  // Unfragmented messages are handed over without any copy
+  if(header.count == 1)
+  {
+    if(payload_size != header.total_size)
+    {
+      ++invalid_;
+      return false;
+    }
+    message = payload;
+    message_size = payload_size;
+    ++completed_;
+    return true;
+  }
+
+  const auto now = clock::now();
+  evict_expired(now);
+  auto & slot = acquire(header, now);
+
+  if(header.count != slot.count || header.total_size != slot.total_size)
+  {
+    ++invalid_;
+    return false;
+  }
+  // All chunks but the last one carry the same amount of data, the last one the remainder. The size of the first chunk
+  // seen places all the others, the chunks disagreeing with it are rejected
+  const bool last = header.index + 1 == header.count;
+  const size_t chunk = last ? (header.total_size - payload_size) / (header.count - 1) : payload_size;
+  const bool consistent = slot.chunk_size != 0
+                            ? chunk == slot.chunk_size
+                            : chunk != 0 && header.total_size > (header.count - 1) * chunk
+                                && header.total_size <= header.count * chunk;
+  if(!consistent || (last && (header.count - 1) * chunk + payload_size != header.total_size))
+  {
+    ++invalid_;
+    return false;
+  }
+  slot.chunk_size = chunk;
+  const size_t offset = header.index * chunk;
+  if(slot.chunks[header.index]) return false; // duplicate
+
+  std::memcpy(slot.data.data() + offset, payload, payload_size);
+  slot.chunks[header.index] = true;
+  if(++slot.received < slot.count) return false;
+
+  slot.in_use = false;
+  message = slot.data.data();
+  message_size = slot.total_size;
+  ++completed_;
+  return true;
+}
+
+} // namespace UDPDataLink
@@ -0,0 +1,625 @@
+#include "io_uring.h"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#  include <linux/io_uring.h>
+// Multishot recvmsg and provided buffer rings came with Linux 6.0
+#  ifdef IORING_RECV_MULTISHOT
+#    define UDPDATALINK_IO_URING
+#    include <boost/asio/posix/stream_descriptor.hpp>
+#    include <sys/mman.h>
+#    include <sys/socket.h>
+#    include <sys/syscall.h>
+#    include <unistd.h>
+#  endif
+#endif
+
+namespace UDPDataLink
+{
+
+#ifdef UDPDATALINK_IO_URING
+
+namespace
+{
+
+// user_data of the completions
+constexpr uint64_t nop_tag = 0;
+constexpr uint64_t receive_tag = 1;
+constexpr uint64_t cancel_tag = 2;
+constexpr uint16_t buffer_group = 0;
+
+std::runtime_error system_error(const std::string & what)
+{
+  return std::runtime_error(what + ": " + std::strerror(errno));
+}
+
+template<typename T>
+std::atomic<T> & atomic_at(void * base, uint32_t offset) noexcept
+{
+  return *reinterpret_cast<std::atomic<T> *>(static_cast<uint8_t *>(base) + offset);
+}
+
+unsigned next_power_of_two(size_t value) noexcept
+{
+  unsigned result = 1;
+  while(result < value && result < 32768) result <<= 1;
+  return result;
+}
+
+/** An io_uring without liburing: the submission and completion rings mapped from the kernel */
+class Ring
+{
+public:
+  Ring(unsigned entries, unsigned cq_entries)
+  {
+    io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+    if(cq_entries > 0)
+    {
+      params.flags |= IORING_SETUP_CQSIZE;
+      params.cq_entries = cq_entries;
+    }
+    fd_ = static_cast<int>(::syscall(__NR_io_uring_setup, entries, &params));
+    if(fd_ < 0) throw system_error("io_uring: cannot create a ring");
+    sq_off_ = params.sq_off;
+    cq_off_ = params.cq_off;
+    sq_entries_ = params.sq_entries;
+    sq_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_size_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    const bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if(single_mmap) sq_size_ = cq_size_ = std::max(sq_size_, cq_size_);
+    sq_ = map(sq_size_, IORING_OFF_SQ_RING);
+    cq_ = single_mmap ? sq_ : map(cq_size_, IORING_OFF_CQ_RING);
+    sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+    void * sqes = map(sqes_size_, IORING_OFF_SQES);
+    if(sq_ == MAP_FAILED || cq_ == MAP_FAILED || sqes == MAP_FAILED)
+    {
+      const auto error = system_error("io_uring: cannot map the ring");
+      if(sqes != MAP_FAILED) ::munmap(sqes, sqes_size_);
+      unmap();
+      ::close(fd_);
+      throw error;
+    }
+    sqes_ = static_cast<io_uring_sqe *>(sqes);
+    // Each submission entry is always at the same index of the array
+    auto * array = reinterpret_cast<unsigned *>(static_cast<uint8_t *>(sq_) + sq_off_.array);
+    for(unsigned i = 0; i < sq_entries_; ++i) array[i] = i;
+    sq_tail_ = atomic_at<unsigned>(sq_, sq_off_.tail).load(std::memory_order_relaxed);
+    cq_head_ = atomic_at<unsigned>(cq_, cq_off_.head).load(std::memory_order_relaxed);
+  }
+
+  ~Ring()
+  {
+    ::munmap(sqes_, sqes_size_);
+    unmap();
+    ::close(fd_);
+  }
+
+  Ring(const Ring &) = delete;
+  Ring & operator=(const Ring &) = delete;
+
+  int fd() const noexcept
+  {
+    return fd_;
+  }
+
+  unsigned sq_entries() const noexcept
+  {
+    return sq_entries_;
+  }
+
+  /** @brief a cleared submission entry, nullptr if the submission ring is full */
+  io_uring_sqe * get_sqe() noexcept
+  {
+    const auto head = atomic_at<unsigned>(sq_, sq_off_.head).load(std::memory_order_acquire);
+    if(sq_tail_ - head >= sq_entries_) return nullptr;
+    auto * sqe = &sqes_[sq_tail_ & (sq_entries_ - 1)];
+    std::memset(sqe, 0, sizeof(io_uring_sqe));
+    ++sq_tail_;
+    ++pending_;
+    return sqe;
+  }
+
+  /**
+   * @brief submit the entries got since the last call and wait for wait_for completions
+   * @return number of entries submitted, -1 on error with errno set
+   */
+  int submit(unsigned wait_for)
+  {
+    atomic_at<unsigned>(sq_, sq_off_.tail).store(sq_tail_, std::memory_order_release);
+    int result = 0;
+    do
+    {
+      result = static_cast<int>(::syscall(__NR_io_uring_enter, fd_, pending_, wait_for,
+                                          wait_for > 0 ? IORING_ENTER_GETEVENTS : 0, nullptr, 0));
+    } while(result < 0 && errno == EINTR);
+    if(result < 0 || static_cast<unsigned>(result) < pending_)
+    {
+      // Take back the entries the kernel did not consume, they would otherwise be submitted by the next call
+      sq_tail_ = atomic_at<unsigned>(sq_, sq_off_.head).load(std::memory_order_acquire);
+      atomic_at<unsigned>(sq_, sq_off_.tail).store(sq_tail_, std::memory_order_release);
+    }
+    pending_ = 0;
+    return result;
+  }
+
+  /** @brief the oldest completion not yet seen, nullptr if there is none */
+  const io_uring_cqe * peek() const noexcept
+  {
+    const auto tail = atomic_at<unsigned>(cq_, cq_off_.tail).load(std::memory_order_acquire);
+    if(cq_head_ == tail) return nullptr;
+    const auto mask = *reinterpret_cast<const unsigned *>(static_cast<uint8_t *>(cq_) + cq_off_.ring_mask);
+    auto * cqes = reinterpret_cast<const io_uring_cqe *>(static_cast<uint8_t *>(cq_) + cq_off_.cqes);
+    return &cqes[cq_head_ & mask];
+  }
+
+  /** @brief give the completion returned by peek() back to the kernel */
+  void seen() noexcept
+  {
+    atomic_at<unsigned>(cq_, cq_off_.head).store(++cq_head_, std::memory_order_release);
+  }
+
+private:
+  void * map(size_t size, off_t offset) noexcept
+  {
+    return ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, offset);
+  }
+
+  void unmap() noexcept
+  {
+    if(cq_ != sq_ && cq_ != MAP_FAILED) ::munmap(cq_, cq_size_);
+    if(sq_ != MAP_FAILED) ::munmap(sq_, sq_size_);
+  }
+
+  int fd_ = -1;
+  io_sqring_offsets sq_off_;
+  io_cqring_offsets cq_off_;
+  unsigned sq_entries_ = 0;
+  size_t sq_size_ = 0;
+  size_t cq_size_ = 0;
+  size_t sqes_size_ = 0;
+  void * sq_ = MAP_FAILED;
+  void * cq_ = MAP_FAILED;
+  io_uring_sqe * sqes_ = nullptr;
+  unsigned sq_tail_ = 0;
+  unsigned cq_head_ = 0;
+  unsigned pending_ = 0;
+};
+
+/** Ring of buffers the kernel picks from to complete a receive, registered once */
+class BufferRing
+{
+public:
+  BufferRing(int ring_fd, unsigned count) : count_(count), size_(count * sizeof(io_uring_buf))
+  {
+    // Must be page aligned
+    void * data = ::mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(data == MAP_FAILED) throw system_error("io_uring: cannot map the buffer ring");
+    bufs_ = static_cast<io_uring_buf *>(data);
+    io_uring_buf_reg registration;
+    std::memset(&registration, 0, sizeof(registration));
+    registration.ring_addr = reinterpret_cast<uintptr_t>(data);
+    registration.ring_entries = count_;
+    registration.bgid = buffer_group;
+    if(::syscall(__NR_io_uring_register, ring_fd, IORING_REGISTER_PBUF_RING, &registration, 1) < 0)
+    {
+      const auto error = system_error("io_uring: cannot register the buffer ring");
+      ::munmap(data, size_);
+      throw error;
+    }
+  }
+
+  ~BufferRing()
+  {
+    // Unregistered when the ring is closed
+    ::munmap(bufs_, size_);
+  }
+
+  BufferRing(const BufferRing &) = delete;
+  BufferRing & operator=(const BufferRing &) = delete;
+
+  /** @brief queue a buffer, it is given to the kernel by publish() */
+  void add(uint8_t * buffer, uint32_t size, uint16_t id) noexcept
+  {
+    auto & entry = bufs_[(tail_ + added_++) & (count_ - 1)];
+    entry.addr = reinterpret_cast<uintptr_t>(buffer);
+    entry.len = size;
+    entry.bid = id;
+  }
+
+  void publish() noexcept
+  {
+    tail_ = static_cast<uint16_t>(tail_ + added_);
+    added_ = 0;
+    // The tail overlays the reserved field of the first entry
+    reinterpret_cast<std::atomic<uint16_t> *>(&bufs_[0].resv)->store(tail_, std::memory_order_release);
+  }
+
+private:
+  io_uring_buf * bufs_ = nullptr;
+  unsigned count_;
+  size_t size_;
+  uint16_t tail_ = 0;
+  uint16_t added_ = 0;
+};
+
+// Each buffer holds the header of the completion, the address of the sender then the datagram
+constexpr size_t name_size = sizeof(sockaddr_storage);
+constexpr size_t prefix_size = sizeof(io_uring_recvmsg_out) + name_size;
+
+} // namespace
+
+bool io_uring_supported() noexcept
+{
+  static const bool supported = []()
+  {
+    try
+    {
+      Ring ring(2, 0);
+      BufferRing buffers(ring.fd(), 1);
+      return true;
+    }
+    catch(const std::exception &)
+    {
+      return false;
+    }
+  }();
+  return supported;
+}
+
+struct UringSender::Impl
+{
+  explicit Impl(size_t batch_size) : ring(next_power_of_two(batch_size), 0) {}
+
+  struct Entry
+  {
+    sockaddr_storage address;
+    socklen_t address_size;
+    iovec iov[2];
+    size_t iov_count;
+  };
+  Ring ring;
+  std::vector<Entry> entries;
+  std::vector<msghdr> headers;
+};
+
+UringSender::UringSender(size_t batch_size)
+: impl_(new Impl(std::max<size_t>(batch_size, 1))), batch_size_(impl_->ring.sq_entries())
+{
+  impl_->headers.resize(batch_size_);
+}
+
+UringSender::~UringSender() = default;
+
+void UringSender::add(const boost::asio::ip::udp::endpoint & destination,
+                      boost::asio::const_buffer header,
+                      boost::asio::const_buffer payload)
+{
+  Impl::Entry entry;
+  std::memcpy(&entry.address, destination.data(), destination.size());
+  entry.address_size = static_cast<socklen_t>(destination.size());
+  entry.iov_count = 0;
+  for(const auto & buffer : {header, payload})
+  {
+    if(buffer.size() == 0) continue;
+    entry.iov[entry.iov_count].iov_base = const_cast<void *>(buffer.data());
+    entry.iov[entry.iov_count].iov_len = buffer.size();
+    ++entry.iov_count;
+  }
+  impl_->entries.push_back(entry);
+}
+
+size_t UringSender::size() const noexcept
+{
+  return impl_->entries.size();
+}
+
+size_t UringSender::flush(int fd)
+{
+  auto & ring = impl_->ring;
+  auto & entries = impl_->entries;
+  auto & headers = impl_->headers;
+  size_t sent = 0;
+  for(size_t next = 0; next < entries.size();)
+  {
+    const auto count = std::min(batch_size_, entries.size() - next);
+    for(size_t i = 0; i < count; ++i)
+    {
+      auto & entry = entries[next + i];
+      auto & header = headers[i];
+      std::memset(&header, 0, sizeof(msghdr));
+      header.msg_name = &entry.address;
+      header.msg_namelen = entry.address_size;
+      header.msg_iov = entry.iov;
+      header.msg_iovlen = entry.iov_count;
+      auto * sqe = ring.get_sqe();
+      sqe->opcode = IORING_OP_SENDMSG;
+      sqe->fd = fd;
+      sqe->addr = reinterpret_cast<uintptr_t>(&header);
+      sqe->len = 1;
+      sqe->user_data = i;
+    }
+    // The headers are reused by the next chunk, wait for every send of this one
+    ++syscalls_;
+    // Like BatchSender, failures only show in the count returned, reported by the caller when verbose
+    const int submitted = ring.submit(static_cast<unsigned>(count));
+    if(submitted <= 0) break;
+    for(int done = 0; done < submitted;)
+    {
+      const auto * cqe = ring.peek();
+      if(!cqe)
+      {
+        ++syscalls_;
+        if(ring.submit(static_cast<unsigned>(submitted - done)) < 0) break;
+        continue;
+      }
+      if(cqe->res >= 0) ++sent;
+      ring.seen();
+      ++done;
+    }
+    next += count;
+  }
+  entries.clear();
+  return sent;
+}
+
+struct UringReceiver::Impl
+{
+  Impl(boost::asio::io_context & io_context, unsigned buffer_count, size_t buffer_size)
+  : buffer_count(buffer_count), slot_size(prefix_size + buffer_size), memory(buffer_count * slot_size),
+    ring(4, 2 * buffer_count), buffers(ring.fd(), buffer_count), descriptor(io_context, ::dup(ring.fd()))
+  {
+    for(unsigned i = 0; i < buffer_count; ++i) provide(static_cast<uint16_t>(i));
+    buffers.publish();
+    datagrams.reserve(buffer_count);
+  }
+
+  ~Impl()
+  {
+    disarm();
+  }
+
+  // The receive holds a reference to the socket until it completes, the kernel would otherwise only cancel it some
+  // time after the ring is closed, leaving the port bound
+  void disarm() noexcept
+  {
+    if(!armed) return;
+    auto * sqe = ring.get_sqe();
+    if(!sqe) return;
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->addr = receive_tag;
+    sqe->user_data = cancel_tag;
+    if(ring.submit(1) < 0) return;
+    while(armed)
+    {
+      const auto * cqe = ring.peek();
+      if(!cqe)
+      {
+        if(ring.submit(1) < 0) return;
+        continue;
+      }
+      if(cqe->user_data == receive_tag && !(cqe->flags & IORING_CQE_F_MORE)) armed = false;
+      ring.seen();
+    }
+  }
+
+  void provide(uint16_t id) noexcept
+  {
+    buffers.add(memory.data() + id * slot_size, static_cast<uint32_t>(slot_size), id);
+  }
+
+  struct Datagram
+  {
+    const uint8_t * data;
+    size_t size;
+    bool truncated;
+    const uint8_t * name;
+    size_t name_size;
+    uint16_t id;
+  };
+
+  unsigned buffer_count;
+  size_t slot_size;
+  // Destroyed last: the kernel writes to the buffers until both descriptors of the ring are closed
+  std::vector<uint8_t> memory;
+  Ring ring;
+  BufferRing buffers;
+  boost::asio::posix::stream_descriptor descriptor;
+  msghdr header;
+  int fd = -1;
+  bool armed = false;
+  std::vector<Datagram> datagrams;
+};
+
+UringReceiver::UringReceiver(boost::asio::io_context & io_context, size_t buffer_count, size_t buffer_size)
+: impl_(new Impl(io_context, next_power_of_two(buffer_count), buffer_size)), buffer_size_(buffer_size)
+{
+}
+
+UringReceiver::~UringReceiver() = default;
+
+void UringReceiver::resize_buffers(size_t buffer_size)
+{
+  // Closing the ring cancels the receive armed with the previous buffers
+  auto & io_context = static_cast<boost::asio::io_context &>(impl_->descriptor.get_executor().context());
+  impl_.reset(new Impl(io_context, impl_->buffer_count, buffer_size));
+  buffer_size_ = buffer_size;
+}
+
+void UringReceiver::async_wait(int fd, std::function<void(const boost::system::error_code &)> handler)
+{
+  auto & impl = *impl_;
+  if(!impl.armed || impl.fd != fd)
+  {
+    std::memset(&impl.header, 0, sizeof(msghdr));
+    impl.header.msg_namelen = name_size;
+    auto * sqe = impl.ring.get_sqe();
+    sqe->opcode = IORING_OP_RECVMSG;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<uintptr_t>(&impl.header);
+    sqe->len = 1;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = buffer_group;
+    sqe->user_data = receive_tag;
+    ++syscalls_;
+    if(impl.ring.submit(0) < 0)
+    {
+      std::cerr << "UringReceiver: cannot arm the receive: " << std::strerror(errno) << std::endl;
+    }
+    else
+    {
+      impl.fd = fd;
+      impl.armed = true;
+    }
+  }
+  impl.descriptor.async_wait(boost::asio::posix::stream_descriptor::wait_read, std::move(handler));
+  // asio polls the ring edge-triggered: completions posted before the wait was queued would not wake it up, a NOP
+  // completion does
+  if(impl.ring.peek())
+  {
+    auto * sqe = impl.ring.get_sqe();
+    sqe->opcode = IORING_OP_NOP;
+    sqe->user_data = nop_tag;
+    ++syscalls_;
+    impl.ring.submit(0);
+  }
+}
+
+size_t UringReceiver::receive()
+{
+  auto & impl = *impl_;
+  // The datagrams of the previous call have been handled
+  for(const auto & datagram : impl.datagrams) impl.provide(datagram.id);
+  impl.buffers.publish();
+  impl.datagrams.clear();
+  while(const auto * cqe = impl.ring.peek())
+  {
+    const auto user_data = cqe->user_data;
+    const auto result = cqe->res;
+    const auto flags = cqe->flags;
+    impl.ring.seen();
+    if(user_data != receive_tag) continue;
+    // Without more to come the receive stopped, e.g. because every buffer was in use
+    if(!(flags & IORING_CQE_F_MORE)) impl.armed = false;
+    if(result < 0 || !(flags & IORING_CQE_F_BUFFER)) continue;
+    const auto id = static_cast<uint16_t>(flags >> IORING_CQE_BUFFER_SHIFT);
+    const auto * buffer = impl.memory.data() + id * impl.slot_size;
+    io_uring_recvmsg_out out;
+    std::memcpy(&out, buffer, sizeof(out));
+    const auto * data = buffer + prefix_size;
+    const auto size = std::min<size_t>(out.payloadlen, buffer_size_);
+    const bool truncated = (out.flags & MSG_TRUNC) != 0 || out.payloadlen > buffer_size_;
+    impl.datagrams.push_back({data, size, truncated, buffer + sizeof(out), std::min<size_t>(out.namelen, name_size), id});
+  }
+  return impl.datagrams.size();
+}
+
+const uint8_t * UringReceiver::data(size_t index) const noexcept
+{
+  return impl_->datagrams[index].data;
+}
+
+size_t UringReceiver::size(size_t index) const noexcept
+{
+  return impl_->datagrams[index].size;
+}
+
+bool UringReceiver::truncated(size_t index) const noexcept
+{
+  return impl_->datagrams[index].truncated;
+}
+
+boost::asio::ip::udp::endpoint UringReceiver::sender(size_t index) const
+{
+  const auto & datagram = impl_->datagrams[index];
+  boost::asio::ip::udp::endpoint endpoint;
+  const auto size = std::min<size_t>(datagram.name_size, endpoint.capacity());
+  std::memcpy(endpoint.data(), datagram.name, size);
+  endpoint.resize(size);
+  return endpoint;
+}
+
+#else
+
+bool io_uring_supported() noexcept
+{
+  return false;
+}
+
+struct UringSender::Impl
+{
+};
+
+UringSender::UringSender(size_t batch_size) : batch_size_(batch_size)
+{
+  throw std::runtime_error("UringSender: io_uring is only supported on Linux 6.0 and later");
+}
+
+UringSender::~UringSender() = default;
+
+void UringSender::add(const boost::asio::ip::udp::endpoint &, boost::asio::const_buffer, boost::asio::const_buffer) {}
+
+size_t UringSender::size() const noexcept
+{
+  return 0;
+}
+
+size_t UringSender::flush(int)
+{
+  return 0;
+}
+
+struct UringReceiver::Impl
+{
+};
+
+UringReceiver::UringReceiver(boost::asio::io_context &, size_t, size_t buffer_size) : buffer_size_(buffer_size)
+{
+  throw std::runtime_error("UringReceiver: io_uring is only supported on Linux 6.0 and later");
+}
+
+UringReceiver::~UringReceiver() = default;
+
+void UringReceiver::resize_buffers(size_t buffer_size)
+{
+  buffer_size_ = buffer_size;
+}
+
+void UringReceiver::async_wait(int, std::function<void(const boost::system::error_code &)>) {}
+
+size_t UringReceiver::receive()
+{
+  return 0;
+}
+
+const uint8_t * UringReceiver::data(size_t) const noexcept
+{
+  return nullptr;
+}
+
+size_t UringReceiver::size(size_t) const noexcept
+{
+  return 0;
+}
+
+bool UringReceiver::truncated(size_t) const noexcept
+{
+  return false;
+}
+
+boost::asio::ip::udp::endpoint UringReceiver::sender(size_t) const
+{
+  return {};
+}
+
+#endif
+
+} // namespace UDPDataLink
@@ -0,0 +1,151 @@
+#include "low_latency.h"
+#include <cerrno>
+#include <cstring>
+
+#ifdef __linux__
+#  include <linux/errqueue.h>
+#  include <linux/net_tstamp.h>
+#  include <pthread.h>
+#  include <sched.h>
+#  include <sys/socket.h>
+#endif
+
+namespace UDPDataLink
+{
+
+#ifdef __linux__
+
+namespace
+{
+
+bool set_option(int fd, int level, int name, int value, const char * description, std::string & error)
+{
+  if(::setsockopt(fd, level, name, &value, sizeof(value)) == 0) return true;
+  if(error.empty()) error = std::string(description) + ": " + std::strerror(errno);
+  return false;
+}
+
+} // namespace
+
+bool apply_socket_options(int fd, const LowLatencyOptions & options, std::string & error)
+{
+  bool ok = true;
+  if(options.busy_poll_us > 0)
+  {
+    ok &= set_option(fd, SOL_SOCKET, SO_BUSY_POLL, options.busy_poll_us, "SO_BUSY_POLL", error);
+  }
+  if(options.receive_buffer > 0)
+  {
+    ok &= set_option(fd, SOL_SOCKET, SO_RCVBUF, options.receive_buffer, "SO_RCVBUF", error);
+  }
+  if(options.send_buffer > 0) ok &= set_option(fd, SOL_SOCKET, SO_SNDBUF, options.send_buffer, "SO_SNDBUF", error);
+  switch(options.timestamps)
+  {
+    case ReceiveTimestamps::None:
+      break;
+    case ReceiveTimestamps::Software:
+      ok &= set_option(fd, SOL_SOCKET, SO_TIMESTAMPNS, 1, "SO_TIMESTAMPNS", error);
+      break;
+    case ReceiveTimestamps::Hardware:
+      ok &= set_option(fd, SOL_SOCKET, SO_TIMESTAMPING,
+                       SOF_TIMESTAMPING_RX_HARDWARE | SOF_TIMESTAMPING_RAW_HARDWARE | SOF_TIMESTAMPING_RX_SOFTWARE
+                           | SOF_TIMESTAMPING_SOFTWARE,
+                       "SO_TIMESTAMPING", error);
+      break;
+  }
+  return ok;
+}
+
+bool apply_thread_options(std::thread & thread, const LowLatencyOptions & options, size_t index, std::string & error)
+{
+  bool ok = true;
+  if(!options.cpus.empty())
+  {
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(options.cpus[index % options.cpus.size()], &cpus);
+    if(const int result = ::pthread_setaffinity_np(thread.native_handle(), sizeof(cpus), &cpus))
+    {
+      error = std::string("CPU affinity: ") + std::strerror(result);
+      ok = false;
+    }
+  }
+  if(options.fifo_priority > 0)
+  {
+    sched_param parameters{};
+    parameters.sched_priority = options.fifo_priority;
+    if(const int result = ::pthread_setschedparam(thread.native_handle(), SCHED_FIFO, &parameters))
+    {
+      if(ok) error = std::string("SCHED_FIFO: ") + std::strerror(result);
+      ok = false;
+    }
+  }
+  return ok;
+}
+
+int64_t receive_timestamp(const void * control, size_t size) noexcept
+{
+  msghdr message{};
+  message.msg_control = const_cast<void *>(control);
+  message.msg_controllen = size;
+  int64_t timestamp = 0;
+  for(auto * header = CMSG_FIRSTHDR(&message); header != nullptr; header = CMSG_NXTHDR(&message, header))
+  {
+    if(header->cmsg_level != SOL_SOCKET) continue;
+    if(header->cmsg_type == SCM_TIMESTAMPNS)
+    {
+      timespec time;
+      std::memcpy(&time, CMSG_DATA(header), sizeof(time));
+      timestamp = int64_t{time.tv_sec} * 1000000000 + time.tv_nsec;
+    }
+    else if(header->cmsg_type == SCM_TIMESTAMPING)
+    {
+      // ts[0] is the software timestamp, ts[2] the raw hardware one
+      scm_timestamping times;
+      std::memcpy(&times, CMSG_DATA(header), sizeof(times));
+      const auto & time = times.ts[2].tv_sec || times.ts[2].tv_nsec ? times.ts[2] : times.ts[0];
+      timestamp = int64_t{time.tv_sec} * 1000000000 + time.tv_nsec;
+    }
+  }
+  return timestamp;
+}
+
+#else
+
+bool apply_socket_options(int, const LowLatencyOptions & options, std::string & error)
+{
+  if(options.busy_poll_us <= 0 && options.receive_buffer <= 0 && options.send_buffer <= 0
+     && options.timestamps == ReceiveTimestamps::None)
+  {
+    return true;
+  }
+  error = "low latency socket options are only supported on Linux";
+  return false;
+}
+
+bool apply_thread_options(std::thread &, const LowLatencyOptions & options, size_t, std::string & error)
+{
+  if(options.cpus.empty() && options.fifo_priority <= 0) return true;
+  error = "thread affinity and priority are only supported on Linux";
+  return false;
+}
+
+int64_t receive_timestamp(const void *, size_t) noexcept
+{
+  return 0;
+}
+
+#endif
+
+void run_io_service(boost::asio::io_service & io_service, bool spin)
+{
+  if(!spin)
+  {
+    io_service.run();
+    return;
+  }
+  // poll() never sleeps, the loop ends once stop() is called or there is no pending operation left
+  while(!io_service.stopped()) io_service.poll();
+}
+
+} // namespace UDPDataLink
@@ -0,0 +1,233 @@
+#include "recording.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+#if defined(__unix__) || defined(__APPLE__)
+#  include <fcntl.h>
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <unistd.h>
+#endif
+
+namespace UDPDataLink
+{
+
+namespace
+{
+
+constexpr uint8_t magic[4] = {'U', 'D', 'L', 'R'};
+constexpr uint32_t version = 1;
+constexpr size_t file_header_size = 32;
+constexpr size_t record_header_size = 16;
+
+void write_u32(uint8_t * buffer, uint32_t value) noexcept
+{
+  for(int i = 0; i < 4; ++i) buffer[i] = static_cast<uint8_t>(value >> (8 * i));
+}
+
+void write_u64(uint8_t * buffer, uint64_t value) noexcept
+{
+  for(int i = 0; i < 8; ++i) buffer[i] = static_cast<uint8_t>(value >> (8 * i));
+}
+
+uint32_t read_u32(const uint8_t * buffer) noexcept
+{
+  uint32_t value = 0;
+  for(int i = 0; i < 4; ++i) value |= static_cast<uint32_t>(buffer[i]) << (8 * i);
+  return value;
+}
+
+uint64_t read_u64(const uint8_t * buffer) noexcept
+{
+  uint64_t value = 0;
+  for(int i = 0; i < 8; ++i) value |= static_cast<uint64_t>(buffer[i]) << (8 * i);
+  return value;
+}
+
+constexpr size_t padded(size_t size) noexcept
+{
+  return (size + 7) & ~size_t{7};
+}
+
+std::runtime_error system_error(const std::string & what, const std::string & path)
+{
+  return std::runtime_error(what + " " + path + ": " + std::strerror(errno));
+}
+
+} // namespace
+
+#if defined(__unix__) || defined(__APPLE__)
+
+Recorder::Recorder(const std::string & path, size_t chunk_size)
+: chunk_size_(padded(std::max(chunk_size, file_header_size + record_header_size)))
+{
+  fd_ = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if(fd_ < 0) throw system_error("Recorder: cannot create", path);
+  if(!map(chunk_size_))
+  {
+    const auto error = system_error("Recorder: cannot map", path);
+    ::close(fd_);
+    throw error;
+  }
+  std::memcpy(data_, magic, sizeof(magic));
+  write_u32(data_ + 4, version);
+  end_ = file_header_size;
+  write_u64(data_ + 8, end_);
+  write_u64(data_ + 16, count_);
+}
+
+Recorder::~Recorder()
+{
+  close();
+}
+
+bool Recorder::map(size_t capacity)
+{
+  if(data_) ::munmap(data_, capacity_);
+  data_ = nullptr;
+  if(::ftruncate(fd_, static_cast<off_t>(capacity)) != 0) return false;
+  void * data = ::mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+  if(data == MAP_FAILED) return false;
+  data_ = static_cast<uint8_t *>(data);
+  capacity_ = capacity;
+  return true;
+}
+
+bool Recorder::record(const uint8_t * datagram, size_t size, int64_t receive_time)
+{
+  if(!data_ || failed_) return false;
+  const auto record_size = record_header_size + padded(size);
+  if(end_ + record_size > capacity_)
+  {
+    // Growing remaps the file, rare with large chunks
+    const auto capacity = capacity_ + std::max(chunk_size_, padded(record_size));
+    if(!map(capacity))
+    {
+      if(!failed_) std::cerr << "Recorder: cannot grow the recording: " << std::strerror(errno) << std::endl;
+      failed_ = true;
+      // Keep what was recorded so far, and stop recording
+      map(capacity_);
+      return false;
+    }
+  }
+  auto * record = data_ + end_;
+  write_u32(record, static_cast<uint32_t>(size));
+  write_u32(record + 4, 0);
+  write_u64(record + 8, static_cast<uint64_t>(receive_time));
+  std::memcpy(record + record_header_size, datagram, size);
+  end_ += record_size;
+  ++count_;
+  write_u64(data_ + 8, end_);
+  write_u64(data_ + 16, count_);
+  return true;
+}
+
+void Recorder::flush()
+{
+  if(data_) ::msync(data_, end_, MS_ASYNC);
+}
+
+void Recorder::close()
+{
+  if(fd_ < 0) return;
+  if(data_) ::munmap(data_, capacity_);
+  data_ = nullptr;
+  if(::ftruncate(fd_, static_cast<off_t>(end_)) != 0)
+  {
+    std::cerr << "Recorder: cannot truncate the recording: " << std::strerror(errno) << std::endl;
+  }
+  ::close(fd_);
+  fd_ = -1;
+}
+
+Replayer::Replayer(const std::string & path)
+{
+  fd_ = ::open(path.c_str(), O_RDONLY);
+  if(fd_ < 0) throw system_error("Replayer: cannot open", path);
+  struct stat status;
+  if(::fstat(fd_, &status) != 0 || static_cast<size_t>(status.st_size) < file_header_size)
+  {
+    ::close(fd_);
+    throw std::runtime_error("Replayer: " + path + " is not a recording");
+  }
+  size_ = static_cast<size_t>(status.st_size);
+  void * data = ::mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd_, 0);
+  if(data == MAP_FAILED)
+  {
+    const auto error = system_error("Replayer: cannot map", path);
+    ::close(fd_);
+    throw error;
+  }
+  data_ = static_cast<const uint8_t *>(data);
+  if(std::memcmp(data_, magic, sizeof(magic)) != 0 || read_u32(data_ + 4) != version)
+  {
+    ::munmap(const_cast<uint8_t *>(data_), size_);
+    ::close(fd_);
+    throw std::runtime_error("Replayer: " + path + " is not a recording, or one of another version");
+  }
+  end_ = std::min<size_t>(read_u64(data_ + 8), size_);
+  count_ = read_u64(data_ + 16);
+  rewind();
+}
+
+Replayer::~Replayer()
+{
+  ::munmap(const_cast<uint8_t *>(data_), size_);
+  ::close(fd_);
+}
+
+#else
+
+Recorder::Recorder(const std::string &, size_t chunk_size) : chunk_size_(chunk_size)
+{
+  throw std::runtime_error("Recorder: recordings are only supported on POSIX systems");
+}
+
+Recorder::~Recorder() = default;
+
+bool Recorder::map(size_t)
+{
+  return false;
+}
+
+bool Recorder::record(const uint8_t *, size_t, int64_t)
+{
+  return false;
+}
+
+void Recorder::flush() {}
+
+void Recorder::close() {}
+
+Replayer::Replayer(const std::string &)
+{
+  throw std::runtime_error("Replayer: recordings are only supported on POSIX systems");
+}
+
+Replayer::~Replayer() = default;
+
+#endif
+
+bool Replayer::next(Record & record) noexcept
+{
+  if(position_ + record_header_size > end_) return false;
+  const auto * header = data_ + position_;
+  const size_t size = read_u32(header);
+  const auto record_size = record_header_size + padded(size);
+  if(position_ + record_size > end_) return false;
+  record.data = header + record_header_size;
+  record.size = size;
+  record.receive_time = static_cast<int64_t>(read_u64(header + 8));
+  position_ += record_size;
+  return true;
+}
+
+void Replayer::rewind() noexcept
+{
+  position_ = file_header_size;
+}
+
+} // namespace UDPDataLink
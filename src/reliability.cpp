@@ -0,0 +1,184 @@
+#include "reliability.h"
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+namespace UDPDataLink
+{
+
+namespace
+{
+
+void write_u32(uint8_t * buffer, uint32_t value) noexcept
+{
+  for(int i = 0; i < 4; ++i) buffer[i] = static_cast<uint8_t>(value >> (8 * i));
+}
+
+void write_u64(uint8_t * buffer, uint64_t value) noexcept
+{
+  for(int i = 0; i < 8; ++i) buffer[i] = static_cast<uint8_t>(value >> (8 * i));
+}
+
+uint32_t read_u32(const uint8_t * buffer) noexcept
+{
+  uint32_t value = 0;
+  for(int i = 0; i < 4; ++i) value |= static_cast<uint32_t>(buffer[i]) << (8 * i);
+  return value;
+}
+
+uint64_t read_u64(const uint8_t * buffer) noexcept
+{
+  uint64_t value = 0;
+  for(int i = 0; i < 8; ++i) value |= static_cast<uint64_t>(buffer[i]) << (8 * i);
+  return value;
+}
+
+} // namespace
+
+void ReliableHeader::write(uint8_t * buffer) const noexcept
+{
+  buffer[0] = static_cast<uint8_t>(magic);
+  buffer[1] = static_cast<uint8_t>(magic >> 8);
+  buffer[2] = 0;
+  buffer[3] = 0;
+  write_u32(buffer + 4, session);
+  write_u32(buffer + 8, sequence);
+  write_u32(buffer + 12, oldest);
+}
+
+bool ReliableHeader::read(const uint8_t * buffer, size_t size, ReliableHeader & header) noexcept
+{
+  if(size < ReliableHeader::size || buffer[0] != static_cast<uint8_t>(magic)
+     || buffer[1] != static_cast<uint8_t>(magic >> 8))
+  {
+    return false;
+  }
+  header.session = read_u32(buffer + 4);
+  header.sequence = read_u32(buffer + 8);
+  header.oldest = read_u32(buffer + 12);
+  return true;
+}
+
+void AckPayload::write(uint8_t * buffer) const noexcept
+{
+  write_u32(buffer, session);
+  write_u32(buffer + 4, next_expected);
+  write_u64(buffer + 8, received);
+}
+
+bool AckPayload::read(const uint8_t * buffer, size_t size, AckPayload & payload) noexcept
+{
+  if(size < AckPayload::size) return false;
+  payload.session = read_u32(buffer);
+  payload.next_expected = read_u32(buffer + 4);
+  payload.received = read_u64(buffer + 8);
+  return true;
+}
+
+RttEstimator::RttEstimator(const ReliabilityOptions & options)
+: min_timeout_(options.min_timeout), max_timeout_(options.max_timeout), timeout_(options.initial_timeout)
+{
+}
+
+void RttEstimator::add(std::chrono::nanoseconds sample) noexcept
+{
+  if(smoothed_.count() == 0)
+  {
+    smoothed_ = sample;
+    variation_ = sample / 2;
+  }
+  else
+  {
+    // alpha = 1/8, beta = 1/4
+    const auto error = sample > smoothed_ ? sample - smoothed_ : smoothed_ - sample;
+    variation_ = (3 * variation_ + error) / 4;
+    smoothed_ = (7 * smoothed_ + sample) / 8;
+  }
+  timeout_ = std::clamp<std::chrono::nanoseconds>(smoothed_ + 4 * variation_, min_timeout_, max_timeout_);
+}
+
+RetransmitWindow::RetransmitWindow(const ReliabilityOptions & options, uint32_t session)
+: slots_(options.window), session_(session), max_retries_(options.max_retries), rtt_(options)
+{
+  if(options.window == 0 || options.window > AckPayload::window)
+  {
+    throw std::invalid_argument("RetransmitWindow: the window must hold between 1 and "
+                                + std::to_string(AckPayload::window) + " messages");
+  }
+}
+
+const RetransmitWindow::Entry * RetransmitWindow::push(const SharedBuffer & payload, clock::time_point now)
+{
+  if(next_ - oldest_ == slots_.size()) return nullptr;
+  auto & entry = slot(next_);
+  ReliableHeader{session_, next_, oldest_}.write(entry.header.data());
+  entry.payload = payload;
+  entry.sent = now;
+  entry.deadline = now + rtt_.timeout();
+  entry.retries = 0;
+  entry.pending = true;
+  ++next_;
+  ++unacknowledged_;
+  ++sent_;
+  return &entry;
+}
+
+uint32_t RetransmitWindow::highest_received(const AckPayload & ack) noexcept
+{
+  uint32_t highest = ack.next_expected;
+  for(uint32_t i = 0; i < AckPayload::window; ++i)
+  {
+    if(ack.received & (uint64_t{1} << i)) highest = ack.next_expected + 1 + i;
+  }
+  return highest;
+}
+
+bool RetransmitWindow::acknowledge(const AckPayload & ack, clock::time_point now)
+{
+  // Acknowledgements of messages never sent come from another session or are corrupted
+  if(ack.session != session_ || before(next_, ack.next_expected)) return false;
+  for(uint32_t sequence = oldest_; sequence != next_; ++sequence)
+  {
+    auto & entry = slot(sequence);
+    const auto distance = sequence - ack.next_expected;
+    if(before(sequence, ack.next_expected)
+       || (distance > 0 && distance <= AckPayload::window && ack.received & (uint64_t{1} << (distance - 1))))
+    {
+      release(entry, now);
+    }
+  }
+  advance();
+  return true;
+}
+
+void RetransmitWindow::release(Entry & entry, clock::time_point now)
+{
+  if(!entry.pending) return;
+  // Karn's algorithm: the acknowledgement of a retransmitted message could be the one of any of its copies
+  if(entry.retries == 0) rtt_.add(now - entry.sent);
+  entry.pending = false;
+  entry.payload.reset();
+  --unacknowledged_;
+}
+
+void RetransmitWindow::retransmit(Entry & entry, clock::time_point now)
+{
+  ++entry.retries;
+  ++retransmitted_;
+  entry.sent = now;
+  // Exponential backoff, reset for the next messages once a round trip time is measured
+  auto timeout = rtt_.timeout();
+  for(size_t i = 0; i < entry.retries && timeout < rtt_.max_timeout(); ++i) timeout *= 2;
+  entry.deadline = now + std::min(timeout, rtt_.max_timeout());
+  ReliableHeader header;
+  ReliableHeader::read(entry.header.data(), entry.header.size(), header);
+  header.oldest = oldest_;
+  header.write(entry.header.data());
+}
+
+void RetransmitWindow::advance() noexcept
+{
+  while(oldest_ != next_ && !slot(oldest_).pending) ++oldest_;
+}
+
+} // namespace UDPDataLink
@@ -0,0 +1,327 @@
+#include "shared_memory.h"
+#include <boost/asio.hpp>
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <new>
+#include <random>
+#include <stdexcept>
+#include <thread>
+
+#if defined(__unix__) || defined(__APPLE__)
+#  include <fcntl.h>
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <unistd.h>
+#endif
+#ifdef __linux__
+#  include <linux/futex.h>
+#  include <sys/syscall.h>
+#endif
+
+namespace UDPDataLink
+{
+
+namespace
+{
+
+// Segment: a 128 bytes header (the magic "UDLS", a version, the number of slots and their size, the generation, then on
+// its own cache line the number of messages written, a futex word bumped by each write and the number of waiting
+// readers) followed by the slots. Each slot is a 64 bytes header (its sequence and the size of its message) followed by
+// the message.
+constexpr uint8_t magic[4] = {'U', 'D', 'L', 'S'};
+constexpr uint32_t version = 2;
+constexpr size_t header_size = 128;
+constexpr size_t head_offset = 64;
+constexpr size_t notify_offset = 72;
+constexpr size_t waiters_offset = 76;
+constexpr size_t slot_header_size = 64;
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free && std::atomic<uint32_t>::is_always_lock_free,
+              "the ring needs address free atomics to be shared between processes");
+
+constexpr size_t slot_stride(size_t slot_size) noexcept
+{
+  return slot_header_size + ((slot_size + 63) & ~size_t{63});
+}
+
+std::atomic<uint64_t> & atomic_u64(uint8_t * address) noexcept
+{
+  return *reinterpret_cast<std::atomic<uint64_t> *>(address);
+}
+
+std::atomic<uint32_t> & atomic_u32(uint8_t * address) noexcept
+{
+  return *reinterpret_cast<std::atomic<uint32_t> *>(address);
+}
+
+uint32_t read_u32(const uint8_t * buffer) noexcept
+{
+  uint32_t value;
+  std::memcpy(&value, buffer, sizeof(value));
+  return value;
+}
+
+void write_u32(uint8_t * buffer, uint32_t value) noexcept
+{
+  std::memcpy(buffer, &value, sizeof(value));
+}
+
+std::runtime_error system_error(const std::string & what, const std::string & name)
+{
+  return std::runtime_error(what + " " + name + ": " + std::strerror(errno));
+}
+
+#ifdef __linux__
+void futex_wake(std::atomic<uint32_t> & word) noexcept
+{
+  ::syscall(SYS_futex, reinterpret_cast<uint32_t *>(&word), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+}
+
+void futex_wait(std::atomic<uint32_t> & word, uint32_t value, std::chrono::nanoseconds timeout) noexcept
+{
+  const auto seconds = std::chrono::duration_cast<std::chrono::seconds>(timeout);
+  timespec time{static_cast<time_t>(seconds.count()), static_cast<long>((timeout - seconds).count())};
+  ::syscall(SYS_futex, reinterpret_cast<uint32_t *>(&word), FUTEX_WAIT, value, &time, nullptr, 0);
+}
+#endif
+
+} // namespace
+
+std::string shared_memory_name(const boost::asio::ip::address & address, uint16_t port)
+{
+  return "/udpdatalink_" + address.to_string() + "_" + std::to_string(port);
+}
+
+bool is_local_address(const boost::asio::ip::address & address)
+{
+  if(address.is_loopback()) return true;
+  if(address.is_unspecified() || address.is_multicast()) return false;
+  // Binding only succeeds on the addresses of this host
+  boost::asio::io_context io_context;
+  boost::asio::ip::udp::socket socket(io_context);
+  boost::system::error_code error;
+  socket.open(address.is_v4() ? boost::asio::ip::udp::v4() : boost::asio::ip::udp::v6(), error);
+  if(!error) socket.bind(boost::asio::ip::udp::endpoint(address, 0), error);
+  return !error;
+}
+
+#if defined(__unix__) || defined(__APPLE__)
+
+SharedMemoryWriter::SharedMemoryWriter(const std::string & name, const SharedMemoryOptions & options)
+: name_(name), slots_(options.slots), slot_size_(options.slot_size)
+{
+  if(slots_ == 0 || slot_size_ == 0 || slot_size_ > UINT32_MAX)
+  {
+    throw std::invalid_argument("SharedMemoryWriter: the ring needs at least one slot of at least one byte");
+  }
+  size_ = header_size + slots_ * slot_stride(slot_size_);
+  // The clients of a previous server keep reading the segment they mapped, they see no new message
+  ::shm_unlink(name_.c_str());
+  const int fd = ::shm_open(name_.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+  if(fd < 0) throw system_error("SharedMemoryWriter: cannot create", name_);
+  void * data = MAP_FAILED;
+  if(::ftruncate(fd, static_cast<off_t>(size_)) == 0)
+  {
+    data = ::mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  }
+  if(data == MAP_FAILED)
+  {
+    const auto error = system_error("SharedMemoryWriter: cannot map", name_);
+    ::close(fd);
+    ::shm_unlink(name_.c_str());
+    throw error;
+  }
+  ::close(fd);
+  data_ = static_cast<uint8_t *>(data);
+  std::random_device random;
+  do
+  {
+    generation_ = random();
+  } while(generation_ == 0);
+  new(data_ + head_offset) std::atomic<uint64_t>(0);
+  new(data_ + notify_offset) std::atomic<uint32_t>(0);
+  new(data_ + waiters_offset) std::atomic<uint32_t>(0);
+  for(size_t i = 0; i < slots_; ++i)
+  {
+    auto * slot = data_ + header_size + i * slot_stride(slot_size_);
+    new(slot) std::atomic<uint64_t>(0);
+    new(slot + 8) std::atomic<uint32_t>(0);
+  }
+  write_u32(data_ + 4, version);
+  write_u32(data_ + 8, static_cast<uint32_t>(slots_));
+  write_u32(data_ + 12, static_cast<uint32_t>(slot_size_));
+  write_u32(data_ + 16, generation_);
+  // The magic comes last, a client opening the segment before it is written falls back to UDP
+  std::atomic_thread_fence(std::memory_order_release);
+  std::memcpy(data_, magic, sizeof(magic));
+}
+
+SharedMemoryWriter::~SharedMemoryWriter()
+{
+  ::munmap(data_, size_);
+  ::shm_unlink(name_.c_str());
+}
+
+bool SharedMemoryWriter::write(const uint8_t * message, size_t size) noexcept
+{
+  if(size == 0 || size > slot_size_) return false;
+  auto & head = atomic_u64(data_ + head_offset);
+  const auto index = head.load(std::memory_order_relaxed);
+  auto * slot = data_ + header_size + (index % slots_) * slot_stride(slot_size_);
+  auto & sequence = atomic_u64(slot);
+  sequence.store(2 * index + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  atomic_u32(slot + 8).store(static_cast<uint32_t>(size), std::memory_order_relaxed);
+  std::memcpy(slot + slot_header_size, message, size);
+  sequence.store(2 * index + 2, std::memory_order_release);
+  head.store(index + 1, std::memory_order_release);
+  // Bumped before reading the number of waiters, a reader going to sleep meanwhile sees the new value and does not
+  auto & notify = atomic_u32(data_ + notify_offset);
+  notify.fetch_add(1, std::memory_order_seq_cst);
+#ifdef __linux__
+  if(atomic_u32(data_ + waiters_offset).load(std::memory_order_seq_cst) != 0) futex_wake(notify);
+#endif
+  return true;
+}
+
+SharedMemoryReader::SharedMemoryReader(const std::string & name)
+{
+  const int fd = ::shm_open(name.c_str(), O_RDWR, 0);
+  if(fd < 0) throw system_error("SharedMemoryReader: cannot open", name);
+  struct stat status;
+  if(::fstat(fd, &status) != 0 || static_cast<size_t>(status.st_size) < header_size)
+  {
+    ::close(fd);
+    throw std::runtime_error("SharedMemoryReader: " + name + " is not a ring");
+  }
+  size_ = static_cast<size_t>(status.st_size);
+  void * data = ::mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if(data == MAP_FAILED) throw system_error("SharedMemoryReader: cannot map", name);
+  data_ = static_cast<uint8_t *>(data);
+  std::atomic_thread_fence(std::memory_order_acquire);
+  slots_ = read_u32(data_ + 8);
+  slot_size_ = read_u32(data_ + 12);
+  generation_ = read_u32(data_ + 16);
+  if(std::memcmp(data_, magic, sizeof(magic)) != 0 || read_u32(data_ + 4) != version || slots_ == 0
+     || header_size + slots_ * slot_stride(slot_size_) > size_)
+  {
+    ::munmap(data_, size_);
+    throw std::runtime_error("SharedMemoryReader: " + name + " is not a ring, or one of another version");
+  }
+  const auto head = atomic_u64(data_ + head_offset).load(std::memory_order_acquire);
+  next_ = head > 0 ? head - 1 : 0;
+}
+
+SharedMemoryReader::~SharedMemoryReader()
+{
+  ::munmap(data_, size_);
+}
+
+size_t SharedMemoryReader::read(uint8_t * buffer) noexcept
+{
+  for(;;)
+  {
+    auto * slot = data_ + header_size + (next_ % slots_) * slot_stride(slot_size_);
+    auto & sequence = atomic_u64(slot);
+    const auto expected = 2 * next_ + 2;
+    const auto before = sequence.load(std::memory_order_acquire);
+    // Not written yet, or being written
+    if(before < expected) return 0;
+    if(before == expected)
+    {
+      const auto size = std::min<size_t>(atomic_u32(slot + 8).load(std::memory_order_relaxed), slot_size_);
+      std::memcpy(buffer, slot + slot_header_size, size);
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if(sequence.load(std::memory_order_relaxed) == expected)
+      {
+        ++next_;
+        return size;
+      }
+    }
+    // Overwritten by a newer message: skip to the oldest one the writer cannot be overwriting
+    const auto head = atomic_u64(data_ + head_offset).load(std::memory_order_acquire);
+    const auto oldest = std::max(next_ + 1, head >= slots_ ? head - slots_ + 1 : 0);
+    skipped_ += oldest - next_;
+    next_ = oldest;
+  }
+}
+
+bool SharedMemoryReader::available() const noexcept
+{
+  return atomic_u64(data_ + head_offset).load(std::memory_order_seq_cst) > next_;
+}
+
+void SharedMemoryReader::wait(std::chrono::nanoseconds timeout) noexcept
+{
+#ifdef __linux__
+  auto & notify = atomic_u32(data_ + notify_offset);
+  auto & waiters = atomic_u32(data_ + waiters_offset);
+  const auto seen = notify.load(std::memory_order_seq_cst);
+  waiters.fetch_add(1, std::memory_order_seq_cst);
+  if(!available() && !interrupted_.load(std::memory_order_relaxed)) futex_wait(notify, seen, timeout);
+  waiters.fetch_sub(1, std::memory_order_seq_cst);
+#else
+  if(!available() && !interrupted_.load(std::memory_order_relaxed))
+  {
+    std::this_thread::sleep_for(std::min<std::chrono::nanoseconds>(timeout, std::chrono::microseconds(100)));
+  }
+#endif
+}
+
+void SharedMemoryReader::interrupt() noexcept
+{
+  interrupted_ = true;
+#ifdef __linux__
+  auto & notify = atomic_u32(data_ + notify_offset);
+  notify.fetch_add(1, std::memory_order_seq_cst);
+  futex_wake(notify);
+#endif
+}
+
+#else
+
+SharedMemoryWriter::SharedMemoryWriter(const std::string &, const SharedMemoryOptions &)
+{
+  throw std::runtime_error("SharedMemoryWriter: shared memory is only supported on POSIX systems");
+}
+
+SharedMemoryWriter::~SharedMemoryWriter() = default;
+
+bool SharedMemoryWriter::write(const uint8_t *, size_t) noexcept
+{
+  return false;
+}
+
+SharedMemoryReader::SharedMemoryReader(const std::string &)
+{
+  throw std::runtime_error("SharedMemoryReader: shared memory is only supported on POSIX systems");
+}
+
+SharedMemoryReader::~SharedMemoryReader() = default;
+
+size_t SharedMemoryReader::read(uint8_t *) noexcept
+{
+  return 0;
+}
+
+bool SharedMemoryReader::available() const noexcept
+{
+  return false;
+}
+
+void SharedMemoryReader::wait(std::chrono::nanoseconds timeout) noexcept
+{
+  std::this_thread::sleep_for(timeout);
+}
+
+void SharedMemoryReader::interrupt() noexcept
+{
+  interrupted_ = true;
+}
+
+#endif
+
+} // namespace UDPDataLink
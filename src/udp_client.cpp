@@ -18,11 +18,23 @@
  * website of the CeCILL licenses family (http://www.cecill.info/index.en.html).
  */
 #include "udp_client.h"
+#include <algorithm>
 #include <cstdlib>
 #include <iostream>
+#include <stdexcept>
 using namespace boost;
 using boost::asio::ip::udp;
-UDPClient::UDPClient() : socket_(io_service_), verbose_(false) {}
+namespace
+{
+// Subscriptions are repeated after this period, doubled each time up to max_subscribe_retry
+constexpr std::chrono::milliseconds first_subscribe_retry{50};
+constexpr std::chrono::milliseconds max_subscribe_retry{1000};
+} // namespace
+UDPClient::UDPClient()
+: socket_(io_service_), verbose_(false), heartbeat_timer_(io_service_), subscribe_timer_(io_service_)
+{
+  UDPDataLink::ControlHeader{UDPDataLink::ControlType::Heartbeat}.write(heartbeat_.data());
+}
 UDPClient::UDPClient(const std::string & server_ip,
                      const std::string & server_port,
                      const std::string & local_port,
@@ -40,8 +52,9 @@ void UDPClient::connect(const std::string & server_ip,
                         const std::string & local_port,
                         size_t max_packet_size)
 {
-  buffer_in_.resize(max_packet_size);
+  set_max_packet_size(max_packet_size);
   socket_ = udp::socket(io_service_, udp::endpoint(udp::v4(), static_cast<uint16_t>(std::atoi(local_port.c_str()))));
+  apply_socket_options();
   udp::resolver resolver(io_service_);
   udp::resolver::query query(udp::v4(), server_ip, server_port);
   server_endpoint_ = *resolver.resolve(query);
@@ -51,37 +64,534 @@ void UDPClient::connect(const std::string & server_ip,
                         uint16_t local_port,
                         size_t max_packet_size)
 {
-  buffer_in_.resize(max_packet_size);
+  set_max_packet_size(max_packet_size);
   socket_ = udp::socket(io_service_, udp::endpoint(udp::v4(), local_port));
+  apply_socket_options();
   udp::resolver resolver(io_service_);
   udp::resolver::query query(udp::v4(), server_ip, std::to_string(server_port));
   server_endpoint_ = *resolver.resolve(query);
 }
 
+void UDPClient::set_max_packet_size(size_t max_packet_size)
+{
+  max_packet_size_ = max_packet_size;
+  resize_buffers(max_packet_size);
+}
+size_t UDPClient::receive_buffer_size(size_t size) const noexcept
+{
+  // Fragments are never larger than a datagram, receiving them in a buffer of that size means none is truncated
+  return fragmentation_ ? std::max(size, UDPDataLink::max_udp_payload + 1) : size;
+}
+void UDPClient::resize_buffers(size_t size)
+{
+  size = receive_buffer_size(size);
+  buffer_in_.resize(size);
+  if(batch_receiver_ && batch_receiver_->buffer_size() != size) batch_receiver_->resize_buffers(size);
+  if(uring_receiver_ && uring_receiver_->buffer_size() != size) uring_receiver_->resize_buffers(size);
+}
+size_t UDPClient::max_packet_size() const noexcept
+{
+  return buffer_in_.size();
+}
 void UDPClient::set_verbose(bool state)
 {
   verbose_ = state;
 }
+void UDPClient::set_fragmentation(bool state, std::chrono::milliseconds timeout, size_t max_message_size)
+{
+  fragmentation_ = state;
+  reassembler_.set_timeout(timeout);
+  reassembler_.set_max_message_size(max_message_size);
+  if(fragmentation_) resize_buffers(buffer_in_.size());
+}
+bool UDPClient::set_batched_io(bool state, size_t batch_size)
+{
+  if(!state || !UDPDataLink::batched_io_supported())
+  {
+    // Receive timestamps are read with recvmmsg, keep a batch of one
+    batch_receiver_.reset(low_latency_.timestamps != UDPDataLink::ReceiveTimestamps::None
+                                  && UDPDataLink::batched_io_supported()
+                              ? new UDPDataLink::BatchReceiver(1, buffer_in_.size())
+                              : nullptr);
+    return false;
+  }
+  uring_receiver_.reset();
+  // buffer_in_ has the size of the reception buffers, see receive_buffer_size()
+  batch_receiver_ = std::make_unique<UDPDataLink::BatchReceiver>(batch_size, buffer_in_.size());
+  return true;
+}
+bool UDPClient::set_io_uring(bool state, size_t buffer_count)
+{
+  if(state && low_latency_.timestamps != UDPDataLink::ReceiveTimestamps::None)
+  {
+    // The batched I/O path reads the timestamps, keep it
+    std::cerr << "The io_uring does not read receive timestamps, it is not used while they are enabled" << std::endl;
+    return false;
+  }
+  uring_receiver_.reset();
+  if(!state || !UDPDataLink::io_uring_supported()) return false;
+  try
+  {
+    uring_receiver_ = std::make_unique<UDPDataLink::UringReceiver>(io_service_, buffer_count, buffer_in_.size());
+  }
+  catch(const std::runtime_error & error)
+  {
+    std::cerr << "Error while creating the io_uring: " << error.what() << std::endl;
+    return false;
+  }
+  batch_receiver_.reset();
+  return true;
+}
+size_t UDPClient::batched_io_syscalls() const noexcept
+{
+  return (batch_receiver_ ? batch_receiver_->syscalls() : 0) + (uring_receiver_ ? uring_receiver_->syscalls() : 0);
+}
+bool UDPClient::set_low_latency(const UDPDataLink::LowLatencyOptions & options)
+{
+  low_latency_ = options;
+  if(options.timestamps != UDPDataLink::ReceiveTimestamps::None && uring_receiver_)
+  {
+    std::cerr << "The io_uring does not read receive timestamps, receiving with the batched I/O path instead"
+              << std::endl;
+    uring_receiver_.reset();
+  }
+  if(options.timestamps != UDPDataLink::ReceiveTimestamps::None && !batch_receiver_)
+  {
+    set_batched_io(false);
+  }
+  return apply_socket_options();
+}
+bool UDPClient::apply_socket_options()
+{
+  std::string error;
+  if(UDPDataLink::apply_socket_options(socket_.native_handle(), low_latency_, error)) return true;
+  std::cerr << "Error while setting the low latency options of the socket: " << error << std::endl;
+  return false;
+}
+UDPDataLink::LatencyHistogram UDPClient::wakeup_latency() const
+{
+  std::lock_guard<std::mutex> lock(wakeup_mutex_);
+  return wakeup_latency_;
+}
+void UDPClient::set_recorder(std::shared_ptr<UDPDataLink::Recorder> recorder)
+{
+  recorder_ = std::move(recorder);
+}
+void UDPClient::replay_datagram(const uint8_t * buffer, size_t size, int64_t receive_time)
+{
+  handle_datagram(buffer, size, receive_time);
+}
+void UDPClient::set_heartbeat(std::chrono::milliseconds period)
+{
+  heartbeat_period_ = period;
+}
+void UDPClient::set_max_rate(double rate, size_t burst)
+{
+  {
+    // Also read by the reception thread when it repeats the subscriptions
+    std::lock_guard<std::mutex> lock(subscriptions_mutex_);
+    max_rate_ = rate;
+    max_burst_ = burst;
+  }
+  std::array<uint8_t, UDPDataLink::ControlHeader::size + UDPDataLink::RatePayload::size> message;
+  control_header(UDPDataLink::ControlType::RateRequest).write(message.data());
+  UDPDataLink::RatePayload{rate, static_cast<uint32_t>(burst)}.write(message.data() + UDPDataLink::ControlHeader::size);
+  boost::system::error_code error;
+  socket_.send_to(boost::asio::buffer(message), server_endpoint_, 0, error);
+  if(verbose_ && error) std::cerr << "Error while sending a rate request: " << error.message() << std::endl;
+  // The heartbeats are sent by the reception thread
+  boost::asio::post(io_service_,
+                    [this, message]
+                    {
+                      heartbeat_ = message;
+                      heartbeat_size_ = message.size();
+                    });
+}
+void UDPClient::set_reliable_messages(bool state)
+{
+  control_flags_ = state ? UDPDataLink::ControlHeader::reliable_flag : 0;
+  send_control(UDPDataLink::ControlType::Heartbeat);
+  // Repeated with the heartbeats, or the rate requests sent instead of them, in case the server restarts
+  boost::asio::post(io_service_,
+                    [this]
+                    {
+                      UDPDataLink::ControlHeader header;
+                      UDPDataLink::ControlHeader::read(heartbeat_.data(), heartbeat_size_, header);
+                      control_header(header.type).write(heartbeat_.data());
+                    });
+}
+UDPDataLink::ControlHeader UDPClient::control_header(UDPDataLink::ControlType type, uint16_t topic) const noexcept
+{
+  return UDPDataLink::ControlHeader{type, topic, control_flags_.load(std::memory_order_relaxed)};
+}
+void UDPClient::schedule_heartbeat()
+{
+  if(heartbeat_period_.count() == 0) return;
+  heartbeat_timer_.expires_after(heartbeat_period_);
+  heartbeat_timer_.async_wait(UDPDataLink::bind_handler_memory(
+      heartbeat_memory_,
+      [this](const boost::system::error_code & error)
+      {
+        if(error) return;
+        socket_.async_send_to(boost::asio::buffer(heartbeat_.data(), heartbeat_size_), server_endpoint_,
+                              UDPDataLink::bind_handler_memory(heartbeat_memory_,
+                                                               [this](auto error, auto bytes_transferred)
+                                                               { handle_send(error, bytes_transferred); }));
+        schedule_heartbeat();
+      }));
+}
+void UDPClient::set_shared_memory(bool state)
+{
+  shared_memory_enabled_ = state;
+}
+bool UDPClient::using_shared_memory() const noexcept
+{
+  return shared_memory_generation_.load(std::memory_order_relaxed) != 0;
+}
+void UDPClient::open_shared_memory()
+{
+  shared_memory_.reset();
+  // The server paces the sends to the clients asking for a maximum rate, they keep receiving over UDP
+  if(!shared_memory_enabled_ || max_rate_ > 0 || server_endpoint_.port() == 0
+     || !UDPDataLink::is_local_address(server_endpoint_.address()))
+  {
+    return;
+  }
+  // The server is bound to the address the client sends to, or to every interface
+  const boost::asio::ip::address addresses[] = {server_endpoint_.address(), boost::asio::ip::address_v4::any()};
+  for(const auto & address : addresses)
+  {
+    try
+    {
+      shared_memory_ = std::make_unique<UDPDataLink::SharedMemoryReader>(
+          UDPDataLink::shared_memory_name(address, server_endpoint_.port()));
+      break;
+    }
+    catch(const std::runtime_error & error)
+    {
+      // No ring, e.g. the server disabled it or is not started yet
+      if(verbose_ && address.is_unspecified()) std::cout << "Receiving over UDP: " << error.what() << std::endl;
+    }
+  }
+  if(!shared_memory_) return;
+  shared_memory_buffer_.resize(shared_memory_->slot_size());
+  std::array<uint8_t, UDPDataLink::ControlHeader::size + UDPDataLink::SharedMemoryPayload::size> message;
+  control_header(UDPDataLink::ControlType::SharedMemory).write(message.data());
+  const UDPDataLink::SharedMemoryPayload payload{shared_memory_->generation()};
+  payload.write(message.data() + UDPDataLink::ControlHeader::size);
+  boost::system::error_code error;
+  socket_.send_to(boost::asio::buffer(message), server_endpoint_, 0, error);
+  if(verbose_ && error) std::cerr << "Error while sending a control message: " << error.message() << std::endl;
+}
+void UDPClient::start_shared_memory()
+{
+  open_shared_memory();
+  if(!shared_memory_) return;
+  shared_memory_stop_ = false;
+  shared_memory_thread_ = std::thread([this] { run_shared_memory(); });
+  shared_memory_generation_ = shared_memory_->generation();
+  std::string error;
+  if(!UDPDataLink::apply_thread_options(shared_memory_thread_, low_latency_, 1, error))
+  {
+    std::cerr << "Error while setting the low latency options of the shared memory thread: " << error << std::endl;
+  }
+}
+void UDPClient::stop_shared_memory()
+{
+  shared_memory_generation_ = 0;
+  if(!shared_memory_thread_.joinable()) return;
+  shared_memory_stop_ = true;
+  shared_memory_->interrupt();
+  shared_memory_thread_.join();
+}
+void UDPClient::run_shared_memory()
+{
+  while(!shared_memory_stop_.load(std::memory_order_relaxed))
+  {
+    const auto size = shared_memory_->read(shared_memory_buffer_.data());
+    if(size == 0)
+    {
+      if(!low_latency_.spin) shared_memory_->wait(std::chrono::milliseconds(100));
+      continue;
+    }
+    std::lock_guard<std::mutex> lock(callback_mutex_);
+    if(recorder_ && !fragmentation_)
+    {
+      recorder_->record(shared_memory_buffer_.data(), size,
+                        std::chrono::duration_cast<std::chrono::nanoseconds>(
+                            std::chrono::system_clock::now().time_since_epoch())
+                            .count());
+    }
+    reception_callback(shared_memory_buffer_.data(), size, 0);
+  }
+}
+void UDPClient::subscribe(uint16_t topic, const std::vector<uint32_t> & codecs, size_t max_datagram_size)
+{
+  Subscription subscription{};
+  subscription.topic = topic;
+  subscription.request.max_datagram_size = static_cast<uint32_t>(max_datagram_size);
+  for(const auto codec : codecs)
+  {
+    if(!subscription.request.add_codec(codec))
+    {
+      throw std::invalid_argument("UDPClient::subscribe: at most "
+                                  + std::to_string(UDPDataLink::SubscribeRequest::max_codecs) + " codecs per topic");
+    }
+  }
+  {
+    std::lock_guard<std::mutex> lock(subscriptions_mutex_);
+    const auto it = std::find_if(subscriptions_.begin(), subscriptions_.end(),
+                                 [topic](const Subscription & subscription) { return subscription.topic == topic; });
+    if(it == subscriptions_.end())
+      subscriptions_.push_back(subscription);
+    else
+      *it = subscription;
+  }
+  send_subscriptions();
+  // The retries are scheduled by the reception thread, once it runs
+  boost::asio::post(io_service_,
+                    [this]
+                    {
+                      subscribe_retry_ = first_subscribe_retry;
+                      schedule_subscriptions();
+                    });
+}
+bool UDPClient::subscription(uint16_t topic, UDPDataLink::SubscribeReply & reply) const
+{
+  std::lock_guard<std::mutex> lock(subscriptions_mutex_);
+  for(const auto & subscription : subscriptions_)
+  {
+    if(subscription.topic != topic || !subscription.answered) continue;
+    reply = subscription.reply;
+    return true;
+  }
+  return false;
+}
+void UDPClient::send_subscriptions()
+{
+  if(server_endpoint_.port() == 0) return;
+  std::array<uint8_t, UDPDataLink::ControlHeader::size + UDPDataLink::SubscribeRequest::min_size
+                          + 4 * UDPDataLink::SubscribeRequest::max_codecs>
+      message;
+  std::lock_guard<std::mutex> lock(subscriptions_mutex_);
+  for(const auto & subscription : subscriptions_)
+  {
+    if(subscription.answered) continue;
+    auto request = subscription.request;
+    request.rate = {max_rate_, static_cast<uint32_t>(max_burst_)};
+    // Only once the ring is mapped, the server checks it is the one it writes
+    request.shared_memory_generation = shared_memory_generation_.load(std::memory_order_relaxed);
+    if(request.shared_memory_generation != 0) request.flags |= UDPDataLink::SubscribeRequest::shared_memory_flag;
+    control_header(UDPDataLink::ControlType::Subscribe, subscription.topic).write(message.data());
+    request.write(message.data() + UDPDataLink::ControlHeader::size);
+    boost::system::error_code error;
+    socket_.send_to(boost::asio::buffer(message.data(), UDPDataLink::ControlHeader::size + request.size()),
+                    server_endpoint_, 0, error);
+    if(verbose_ && error) std::cerr << "Error while sending a subscription: " << error.message() << std::endl;
+  }
+}
+void UDPClient::schedule_subscriptions()
+{
+  {
+    std::lock_guard<std::mutex> lock(subscriptions_mutex_);
+    if(std::all_of(subscriptions_.begin(), subscriptions_.end(),
+                   [](const Subscription & subscription) { return subscription.answered; }))
+    {
+      return;
+    }
+  }
+  subscribe_timer_.expires_after(subscribe_retry_);
+  subscribe_timer_.async_wait(
+      [this](const boost::system::error_code & error)
+      {
+        if(error) return;
+        send_subscriptions();
+        subscribe_retry_ = std::min(subscribe_retry_ * 2, max_subscribe_retry);
+        schedule_subscriptions();
+      });
+}
+void UDPClient::handle_subscribe_reply(const uint8_t * buffer, size_t size)
+{
+  UDPDataLink::ControlHeader header;
+  UDPDataLink::SubscribeReply reply;
+  UDPDataLink::ControlHeader::read(buffer, size, header);
+  if(!UDPDataLink::SubscribeReply::read(buffer + UDPDataLink::ControlHeader::size,
+                                        size - UDPDataLink::ControlHeader::size, reply))
+  {
+    return;
+  }
+  std::unique_lock<std::mutex> lock(subscriptions_mutex_);
+  if(reply.status == UDPDataLink::SubscribeStatus::NotSubscribed)
+  {
+    // The server forgot this client, the subscriptions it accepted are sent again
+    bool resubscribe = false;
+    for(auto & subscription : subscriptions_)
+    {
+      if(subscription.answered && subscription.reply.status == UDPDataLink::SubscribeStatus::Accepted)
+      {
+        subscription.answered = false;
+        resubscribe = true;
+      }
+    }
+    lock.unlock();
+    if(!resubscribe) return;
+    // Posted since the shared memory thread may wait for the callback mutex held by this one
+    boost::asio::post(io_service_,
+                      [this]
+                      {
+                        // A restarted server removed the ring this client reads, the new one is mapped first
+                        if(shared_memory_thread_.joinable())
+                        {
+                          stop_shared_memory();
+                          start_shared_memory();
+                        }
+                        send_subscriptions();
+                        subscribe_retry_ = first_subscribe_retry;
+                        schedule_subscriptions();
+                      });
+    return;
+  }
+  const auto it = std::find_if(subscriptions_.begin(), subscriptions_.end(),
+                               [&header](const Subscription & subscription)
+                               { return subscription.topic == header.topic; });
+  if(it == subscriptions_.end()) return;
+  const bool first_answer = !it->answered;
+  it->answered = true;
+  it->reply = reply;
+  if(reply.status != UDPDataLink::SubscribeStatus::Accepted)
+  {
+    if(first_answer)
+    {
+      std::cerr << "Subscription to topic " << header.topic << " refused by the server: "
+                << UDPDataLink::to_string(reply.status) << std::endl;
+    }
+    return;
+  }
+  // One byte more than the largest datagram of any topic, a datagram filling the buffers is taken as truncated. Never
+  // below the size set by the user, and left alone while a topic is unbounded: its datagrams grow the buffers as needed
+  size_t packet_size = max_packet_size_;
+  for(const auto & subscription : subscriptions_)
+  {
+    if(!subscription.answered || subscription.reply.status != UDPDataLink::SubscribeStatus::Accepted) continue;
+    if(subscription.reply.max_datagram_size == 0) return;
+    packet_size = std::max<size_t>(packet_size, subscription.reply.max_datagram_size + 1);
+  }
+  announced_packet_size_ = packet_size;
+}
+void UDPClient::unsubscribe()
+{
+  {
+    // Not subscribed again when the server answers NotSubscribed
+    std::lock_guard<std::mutex> lock(subscriptions_mutex_);
+    subscriptions_.clear();
+  }
+  send_control(UDPDataLink::ControlType::Unsubscribe);
+}
+void UDPClient::send_control(UDPDataLink::ControlType type, uint16_t topic)
+{
+  std::array<uint8_t, UDPDataLink::ControlHeader::size> message;
+  control_header(type, topic).write(message.data());
+  boost::system::error_code error;
+  socket_.send_to(boost::asio::buffer(message), server_endpoint_, 0, error);
+  if(verbose_ && error) std::cerr << "Error while sending a control message: " << error.message() << std::endl;
+}
+void UDPClient::send_acknowledgement(UDPDataLink::ControlType type, const UDPDataLink::AckPayload & ack)
+{
+  std::array<uint8_t, UDPDataLink::ControlHeader::size + UDPDataLink::AckPayload::size> message;
+  control_header(type).write(message.data());
+  ack.write(message.data() + UDPDataLink::ControlHeader::size);
+  boost::system::error_code error;
+  socket_.send_to(boost::asio::buffer(message), server_endpoint_, 0, error);
+  if(verbose_ && error) std::cerr << "Error while sending an acknowledgement: " << error.message() << std::endl;
+}
+void UDPClient::join_multicast(const std::string & group, uint16_t port, const std::string & interface_address)
+{
+  boost::system::error_code error;
+  const auto address = asio::ip::make_address(group, error);
+  if(error || !address.is_v4() || !address.is_multicast())
+  {
+    throw std::invalid_argument("UDPClient::join_multicast: " + group + " is not an IPv4 multicast address");
+  }
+  multicast_group_ = address.to_v4();
+  multicast_interface_ = UDPDataLink::multicast_interface(interface_address);
+  socket_ = udp::socket(io_service_);
+  socket_.open(udp::v4());
+  // Every receiver of the host binds the port of the group
+  socket_.set_option(udp::socket::reuse_address(true));
+  socket_.bind(udp::endpoint(udp::v4(), port));
+  socket_.set_option(asio::ip::multicast::join_group(multicast_group_, multicast_interface_));
+  apply_socket_options();
+}
+void UDPClient::leave_multicast()
+{
+  if(multicast_group_.is_unspecified()) return;
+  boost::system::error_code error;
+  socket_.set_option(asio::ip::multicast::leave_group(multicast_group_, multicast_interface_), error);
+  if(verbose_ && error) std::cerr << "Error while leaving the multicast group: " << error.message() << std::endl;
+  multicast_group_ = asio::ip::address_v4();
+}
 void UDPClient::receive()
 {
   io_service_.reset();
+  send_subscriptions();
+  subscribe_retry_ = first_subscribe_retry;
+  schedule_subscriptions();
   start_receive();
-  io_service_.run();
+  schedule_heartbeat();
+  UDPDataLink::run_io_service(io_service_, low_latency_.spin);
 }
 void UDPClient::start_reception()
 {
+  start_shared_memory();
   io_service_.reset();
+  send_subscriptions();
+  subscribe_retry_ = first_subscribe_retry;
+  schedule_subscriptions();
   start_receive();
-  run_thread_ = std::thread([this] { io_service_.run(); });
+  schedule_heartbeat();
+  run_thread_ = std::thread([this] { UDPDataLink::run_io_service(io_service_, low_latency_.spin); });
+  std::string error;
+  if(!UDPDataLink::apply_thread_options(run_thread_, low_latency_, 0, error))
+  {
+    std::cerr << "Error while setting the low latency options of the reception thread: " << error << std::endl;
+  }
 }
 void UDPClient::stop_reception()
 {
+  // The reception thread stops first, it may replace the shared memory thread
   io_service_.stop();
   run_thread_.join();
+  stop_shared_memory();
+  // The subscriptions are kept, start_reception() sends them again
+  bool subscribed = false;
+  {
+    std::lock_guard<std::mutex> lock(subscriptions_mutex_);
+    subscribed = !subscriptions_.empty();
+  }
+  if(subscribed) send_control(UDPDataLink::ControlType::Unsubscribe);
 }
 void UDPClient::start_receive()
 {
+  if(announced_packet_size_ != 0)
+  {
+    if(verbose_)
+    {
+      std::cout << "Reception buffers sized by the server to " << announced_packet_size_ << " bytes" << std::endl;
+    }
+    resize_buffers(announced_packet_size_);
+    announced_packet_size_ = 0;
+  }
   if(verbose_) std::cout << "Start listening on " << remote_endpoint_ << std::endl;
+  if(batch_receiver_)
+  {
+    socket_.async_wait(udp::socket::wait_read, [this](auto error) { handle_batch_receive(error); });
+    return;
+  }
+  if(uring_receiver_)
+  {
+    uring_receiver_->async_wait(socket_.native_handle(), [this](auto error) { handle_uring_receive(error); });
+    return;
+  }
   socket_.async_receive_from(boost::asio::buffer(buffer_in_, buffer_in_.size()), remote_endpoint_,
                              [this](auto error, auto bytes_transferred) { handle_receive(error, bytes_transferred); });
 }
@@ -89,7 +599,7 @@ void UDPClient::handle_receive(const boost::system::error_code & error, std::siz
 {
   if(!error)
   {
-    if(bytes_transferred == buffer_in_.size())
+    if(!fragmentation_ && bytes_transferred == buffer_in_.size())
     {
       auto newSize = buffer_in_.size() * 2;
       if(verbose_)
@@ -101,9 +611,41 @@ void UDPClient::handle_receive(const boost::system::error_code & error, std::siz
     }
     else
     {
+      handle_datagram(buffer_in_.data(), bytes_transferred);
+    }
+  }
+  else
+  {
+    if(verbose_) std::cerr << "Error while receiving a message : " << error << std::endl;
+  }
+  start_receive();
+}
+void UDPClient::handle_batch_receive(const boost::system::error_code & error)
+{
+  if(!error)
+  {
+    const auto count = batch_receiver_->receive(socket_.native_handle());
+    bool truncated = false;
+    for(size_t i = 0; i < count; ++i)
+    {
+      if(batch_receiver_->truncated(i))
+      {
+        truncated = true;
+        continue;
+      }
+      remote_endpoint_ = batch_receiver_->sender(i);
+      handle_datagram(batch_receiver_->data(i), batch_receiver_->size(i), batch_receiver_->timestamp(i));
+    }
+    if(truncated)
+    {
+      // Only resize once all the datagrams of the batch were processed, they live in the reception buffers
+      auto newSize = batch_receiver_->buffer_size() * 2;
       if(verbose_)
-        std::cout << "Message received (" << bytes_transferred << " bytes) from " << remote_endpoint_ << std::endl;
-      reception_callback(static_cast<const uint8_t *>(buffer_in_.data()), bytes_transferred);
+      {
+        std::cout << "Warning: receive buffer was too small to handle message, doubling size from "
+                  << batch_receiver_->buffer_size() << " bytes to " << newSize << std::endl;
+      }
+      batch_receiver_->resize_buffers(newSize);
     }
   }
   else
@@ -112,6 +654,93 @@ void UDPClient::handle_receive(const boost::system::error_code & error, std::siz
   }
   start_receive();
 }
+void UDPClient::handle_uring_receive(const boost::system::error_code & error)
+{
+  if(!error)
+  {
+    const auto count = uring_receiver_->receive();
+    bool truncated = false;
+    for(size_t i = 0; i < count; ++i)
+    {
+      if(uring_receiver_->truncated(i))
+      {
+        truncated = true;
+        continue;
+      }
+      remote_endpoint_ = uring_receiver_->sender(i);
+      handle_datagram(uring_receiver_->data(i), uring_receiver_->size(i));
+    }
+    if(truncated)
+    {
+      // Replaces the ring, only once all the datagrams of the batch were processed
+      auto newSize = uring_receiver_->buffer_size() * 2;
+      if(verbose_)
+      {
+        std::cout << "Warning: receive buffer was too small to handle message, doubling size from "
+                  << uring_receiver_->buffer_size() << " bytes to " << newSize << std::endl;
+      }
+      uring_receiver_->resize_buffers(newSize);
+    }
+  }
+  else
+  {
+    if(verbose_) std::cerr << "Error while receiving a message : " << error << std::endl;
+  }
+  start_receive();
+}
+void UDPClient::handle_datagram(const uint8_t * buffer, size_t size, int64_t receive_time)
+{
+  // The shared memory thread calls reception_callback too
+  std::unique_lock<std::mutex> lock(callback_mutex_, std::defer_lock);
+  if(shared_memory_) lock.lock();
+  if(recorder_)
+  {
+    recorder_->record(buffer, size,
+                      receive_time != 0 ? receive_time
+                                        : std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                              std::chrono::system_clock::now().time_since_epoch())
+                                              .count());
+  }
+  if(receive_time != 0)
+  {
+    const auto now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                         std::chrono::system_clock::now().time_since_epoch())
+                         .count();
+    std::lock_guard<std::mutex> lock(wakeup_mutex_);
+    wakeup_latency_.add(now - receive_time);
+  }
+  UDPDataLink::ControlHeader control;
+  if(size == UDPDataLink::ControlHeader::size + UDPDataLink::SubscribeReply::size
+     && UDPDataLink::ControlHeader::read(buffer, size, control)
+     && control.type == UDPDataLink::ControlType::SubscribeReply)
+  {
+    // Compared by port only, a server bound to every address may answer from another one than the client talks to
+    if(remote_endpoint_.port() == server_endpoint_.port()) handle_subscribe_reply(buffer, size);
+    return;
+  }
+  if(fragmentation_)
+  {
+    const uint8_t * message = nullptr;
+    size_t message_size = 0;
+    if(!reassembler_.push(buffer, size, message, message_size)) return;
+    buffer = message;
+    size = message_size;
+  }
+  if(verbose_) std::cout << "Message received (" << size << " bytes) from " << remote_endpoint_ << std::endl;
+  UDPDataLink::ReliableHeader reliable;
+  if((control_flags_.load(std::memory_order_relaxed) & UDPDataLink::ControlHeader::reliable_flag)
+     && UDPDataLink::ReliableHeader::read(buffer, size, reliable))
+  {
+    UDPDataLink::AckPayload ack;
+    const bool missing = reliable_.push(reliable, buffer + UDPDataLink::ReliableHeader::size,
+                                        size - UDPDataLink::ReliableHeader::size, ack,
+                                        [this, receive_time](const uint8_t * message, size_t message_size)
+                                        { reception_callback(message, message_size, receive_time); });
+    send_acknowledgement(missing ? UDPDataLink::ControlType::Nack : UDPDataLink::ControlType::Ack, ack);
+    return;
+  }
+  reception_callback(buffer, size, receive_time);
+}
 void UDPClient::handle_send(const boost::system::error_code & error, std::size_t bytes_transferred)
 {
   if(verbose_)
@@ -129,6 +758,11 @@ void UDPClient::reception_callback(const uint8_t * buffer, size_t size)
   (void)buffer;
   (void)size;
 }
+void UDPClient::reception_callback(const uint8_t * buffer, size_t size, int64_t receive_time)
+{
+  (void)receive_time;
+  reception_callback(buffer, size);
+}
 void UDPClient::send_data(const uint8_t * buffer, size_t size)
 {
   if(verbose_) std::cout << "Sending data to " << server_endpoint_ << std::endl;
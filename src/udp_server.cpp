@@ -18,80 +18,872 @@
  * website of the CeCILL licenses family (http://www.cecill.info/index.en.html).
  */
 #include "udp_server.h"
+#include <algorithm>
 #include <iostream>
+#include <limits>
+#include <stdexcept>
 using namespace boost;
 using boost::asio::ip::udp;
-UDPServer::UDPServer() : socket_(io_service_), verbose_(false) {}
+UDPServer::UDPServer() : verbose_(false)
+{
+  shards_.emplace_back(new Shard);
+}
 UDPServer::UDPServer(uint16_t port, size_t max_packet_size) : UDPServer()
 {
   connect(port, max_packet_size);
 }
 void UDPServer::connect(uint16_t port, size_t max_packet_size)
 {
-  buffer_in_.resize(max_packet_size);
-  socket_ = udp::socket(io_service_, udp::endpoint(udp::v4(), port));
+  port_ = port;
+  max_packet_size_ = max_packet_size;
+  open_sockets(shards_.size());
+  if(shared_memory_enabled_) set_shared_memory(true, shared_memory_options_);
+}
+uint16_t UDPServer::port() const noexcept
+{
+  return port_;
+}
+void UDPServer::open_sockets(size_t count)
+{
+  shards_.resize(count);
+  for(auto & shard : shards_)
+  {
+    if(!shard) shard.reset(new Shard);
+    shard->buffer_in_.resize(max_packet_size_);
+    shard->socket_ = udp::socket(shard->io_service_);
+    shard->socket_.open(udp::v4());
+#ifdef SO_REUSEPORT
+    if(count > 1)
+    {
+      shard->socket_.set_option(asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT>(true));
+    }
+#endif
+    shard->socket_.bind(udp::endpoint(udp::v4(), port_));
+    // When an ephemeral port is requested, bind the other shards on the one given to the first
+    port_ = shard->socket_.local_endpoint().port();
+    create_batched_io(*shard);
+  }
+  if(multicast_) apply_multicast_options();
+  apply_socket_options();
 }
 void UDPServer::set_verbose(bool state)
 {
   verbose_ = state;
 }
+void UDPServer::set_fragmentation(bool state, size_t max_datagram_size)
+{
+  if(max_datagram_size <= UDPDataLink::FragmentHeader::size || max_datagram_size > UDPDataLink::max_udp_payload)
+  {
+    throw std::invalid_argument("UDPServer::set_fragmentation: invalid maximum datagram size "
+                                + std::to_string(max_datagram_size));
+  }
+  fragmentation_ = state;
+  max_datagram_size_ = max_datagram_size;
+}
+void UDPServer::set_multicast(const std::string & group, uint16_t port, const UDPDataLink::MulticastOptions & options)
+{
+  boost::system::error_code error;
+  const auto address = asio::ip::make_address(group, error);
+  if(error || !address.is_v4() || !address.is_multicast())
+  {
+    throw std::invalid_argument("UDPServer::set_multicast: " + group + " is not an IPv4 multicast address");
+  }
+  multicast_options_ = options;
+  multicast_endpoint_ = udp::endpoint(address, port);
+  multicast_ = true;
+  apply_multicast_options();
+}
+void UDPServer::disable_multicast()
+{
+  multicast_ = false;
+}
+void UDPServer::apply_multicast_options()
+{
+  auto & socket = shards_.front()->socket_;
+  socket.set_option(asio::ip::multicast::hops(multicast_options_.ttl));
+  socket.set_option(asio::ip::multicast::enable_loopback(multicast_options_.loopback));
+  socket.set_option(
+      asio::ip::multicast::outbound_interface(UDPDataLink::multicast_interface(multicast_options_.interface_address)));
+}
+bool UDPServer::set_low_latency(const UDPDataLink::LowLatencyOptions & options)
+{
+  low_latency_ = options;
+  return apply_socket_options();
+}
+bool UDPServer::apply_socket_options()
+{
+  bool ok = true;
+  for(auto & shard : shards_)
+  {
+    std::string error;
+    if(!shard->socket_.is_open()
+       || UDPDataLink::apply_socket_options(shard->socket_.native_handle(), low_latency_, error))
+    {
+      continue;
+    }
+    std::cerr << "Error while setting the low latency options of the socket: " << error << std::endl;
+    ok = false;
+  }
+  return ok;
+}
+void UDPServer::start_thread(Shard & shard, size_t index)
+{
+  shard.run_thread_ =
+      std::thread([this, &shard] { UDPDataLink::run_io_service(shard.io_service_, low_latency_.spin); });
+  std::string error;
+  if(!UDPDataLink::apply_thread_options(shard.run_thread_, low_latency_, index, error))
+  {
+    std::cerr << "Error while setting the low latency options of the reception thread: " << error << std::endl;
+  }
+}
+void UDPServer::create_batched_io(Shard & shard)
+{
+  const bool batched = batch_size_ > 0 && !io_uring_;
+  const bool uring = batch_size_ > 0 && io_uring_;
+  shard.batch_sender_.reset(batched ? new UDPDataLink::BatchSender(batch_size_) : nullptr);
+  shard.batch_receiver_.reset(batched ? new UDPDataLink::BatchReceiver(batch_size_, max_packet_size_) : nullptr);
+  shard.uring_sender_.reset(uring ? new UDPDataLink::UringSender(batch_size_) : nullptr);
+  shard.uring_receiver_.reset(uring ? new UDPDataLink::UringReceiver(shard.io_service_, batch_size_, max_packet_size_)
+                                    : nullptr);
+}
+bool UDPServer::set_batched_io(bool state, size_t batch_size)
+{
+  io_uring_ = false;
+  batch_size_ = state && UDPDataLink::batched_io_supported() ? std::max<size_t>(batch_size, 1) : 0;
+  for(auto & shard : shards_) create_batched_io(*shard);
+  return batch_size_ > 0;
+}
+bool UDPServer::set_io_uring(bool state, size_t batch_size)
+{
+  if(!state || !UDPDataLink::io_uring_supported())
+  {
+    set_batched_io(state, batch_size);
+    return false;
+  }
+  io_uring_ = true;
+  batch_size_ = std::max<size_t>(batch_size, 1);
+  try
+  {
+    for(auto & shard : shards_) create_batched_io(*shard);
+  }
+  catch(const std::runtime_error & error)
+  {
+    std::cerr << "Error while creating the io_uring, falling back to batched I/O: " << error.what() << std::endl;
+    set_batched_io(true, batch_size);
+    return false;
+  }
+  return true;
+}
+size_t UDPServer::batched_io_syscalls() const noexcept
+{
+  size_t syscalls = 0;
+  for(const auto & shard : shards_)
+  {
+    syscalls += (shard->batch_sender_ ? shard->batch_sender_->syscalls() : 0)
+                + (shard->batch_receiver_ ? shard->batch_receiver_->syscalls() : 0)
+                + (shard->uring_sender_ ? shard->uring_sender_->syscalls() : 0)
+                + (shard->uring_receiver_ ? shard->uring_receiver_->syscalls() : 0);
+  }
+  return syscalls;
+}
+bool UDPServer::set_shards(size_t count)
+{
+  count = std::max<size_t>(count, 1);
+#ifndef SO_REUSEPORT
+  if(count > 1) return false;
+#endif
+  if(count == shards_.size()) return true;
+  // Clients keep a reference to the socket of their shard, the shard threads to their shard
+  for(const auto & shard : shards_)
+  {
+    std::lock_guard<std::mutex> lock(shard->clients_mutex_);
+    if(!shard->clients_.empty() || shard->run_thread_.joinable())
+    {
+      std::cerr << "UDPServer::set_shards: clients are registered or the reception is running, keeping "
+                << shards_.size() << " shards" << std::endl;
+      return false;
+    }
+  }
+  // Before connect() the sockets are left to it, so that they are all bound to the port it is given
+  const bool connected = shards_.front()->socket_.is_open();
+  shards_.clear();
+  if(connected)
+  {
+    open_sockets(count);
+  }
+  else
+  {
+    for(size_t i = 0; i < count; ++i) shards_.emplace_back(new Shard);
+  }
+  return true;
+}
 void UDPServer::receive()
 {
-  io_service_.reset();
-  start_receive();
-  io_service_.run();
+  for(size_t i = 1; i < shards_.size(); ++i)
+  {
+    auto & shard = *shards_[i];
+    shard.io_service_.reset();
+    start_receive(shard);
+    start_thread(shard, i);
+  }
+  auto & shard = *shards_.front();
+  shard.io_service_.reset();
+  start_receive(shard);
+  UDPDataLink::run_io_service(shard.io_service_, low_latency_.spin);
 }
 void UDPServer::start_reception()
 {
-  io_service_.reset();
-  start_receive();
-  run_thread_ = std::thread([this] { io_service_.run(); });
+  for(size_t i = 0; i < shards_.size(); ++i)
+  {
+    auto & shard = *shards_[i];
+    shard.io_service_.reset();
+    start_receive(shard);
+    start_thread(shard, i);
+  }
 }
 void UDPServer::stop_reception()
 {
-  io_service_.stop();
-  run_thread_.join();
+  for(auto & shard : shards_)
+  {
+    shard->io_service_.stop();
+    if(shard->run_thread_.joinable()) shard->run_thread_.join();
+  }
+}
+void UDPServer::start_receive(Shard & shard)
+{
+  if(verbose_) std::cout << "Start listening on " << shard.new_client_endpoint_ << std::endl;
+  if(shard.batch_receiver_)
+  {
+    shard.socket_.async_wait(udp::socket::wait_read, [this, &shard](auto error) { handle_batch_receive(shard, error); });
+    return;
+  }
+  if(shard.uring_receiver_)
+  {
+    shard.uring_receiver_->async_wait(shard.socket_.native_handle(),
+                                      [this, &shard](auto error) { handle_uring_receive(shard, error); });
+    return;
+  }
+  shard.socket_.async_receive_from(
+      boost::asio::buffer(shard.buffer_in_, shard.buffer_in_.size()), shard.new_client_endpoint_,
+      [this, &shard](auto error, auto bytes_transferred) { handle_receive(shard, error, bytes_transferred); });
+}
+void UDPServer::handle_receive(Shard & shard, const boost::system::error_code & error, std::size_t bytes_transferred)
+{
+  if(!error)
+  {
+    handle_datagram(shard, shard.new_client_endpoint_, shard.buffer_in_.data(), bytes_transferred);
+  }
+  else
+  {
+    if(verbose_) std::cerr << "Error while receiving a message : " << error << std::endl;
+  }
+  start_receive(shard);
 }
-void UDPServer::start_receive()
+void UDPServer::handle_batch_receive(Shard & shard, const boost::system::error_code & error)
 {
-  if(verbose_) std::cout << "Start listening on " << new_client_endpoint_ << std::endl;
-  socket_.async_receive_from(boost::asio::buffer(buffer_in_, buffer_in_.size()), new_client_endpoint_,
-                             [this](auto error, auto bytes_transferred) { handle_receive(error, bytes_transferred); });
+  if(!error)
+  {
+    const auto count = shard.batch_receiver_->receive(shard.socket_.native_handle());
+    for(size_t i = 0; i < count; ++i)
+    {
+      handle_datagram(shard, shard.batch_receiver_->sender(i), shard.batch_receiver_->data(i),
+                      shard.batch_receiver_->size(i));
+    }
+  }
+  else
+  {
+    if(verbose_) std::cerr << "Error while receiving a message : " << error << std::endl;
+  }
+  start_receive(shard);
 }
-void UDPServer::handle_receive(const boost::system::error_code & error, std::size_t bytes_transferred)
+void UDPServer::handle_uring_receive(Shard & shard, const boost::system::error_code & error)
 {
   if(!error)
   {
-    if(std::find_if(remote_endpoints_.begin(), remote_endpoints_.end(),
-                    [this](const auto & clientEndpoint) { return clientEndpoint.endpoint() == new_client_endpoint_; })
-       == remote_endpoints_.end())
+    auto & receiver = *shard.uring_receiver_;
+    const auto count = receiver.receive();
+    for(size_t i = 0; i < count; ++i)
     {
-      auto clientId = remote_endpoints_.size() ? remote_endpoints_.front().clientId() + 1 : 0;
-      remote_endpoints_.emplace_front(new_client_endpoint_, clientId, buffer_in_.size(), verbose_);
-      if(verbose_)
-      {
-        std::cout << "New client connected: " << clientId << "(ip: " << new_client_endpoint_.address().to_string()
-                  << ", " << new_client_endpoint_.port() << ") - message received (" << bytes_transferred
-                  << " bytes) from " << new_client_endpoint_ << std::endl;
-      }
-      reception_callback(static_cast<const uint8_t *>(buffer_in_.data()), bytes_transferred);
+      handle_datagram(shard, receiver.sender(i), receiver.data(i), receiver.size(i));
     }
   }
   else
   {
     if(verbose_) std::cerr << "Error while receiving a message : " << error << std::endl;
   }
-  start_receive();
+  start_receive(shard);
+}
+void UDPServer::handle_datagram(Shard & shard, const udp::endpoint & sender, const uint8_t * buffer, size_t size)
+{
+  UDPDataLink::ControlHeader control;
+  const bool is_control = UDPDataLink::ControlHeader::read(buffer, size, control);
+  if(is_control && control.type == UDPDataLink::ControlType::Subscribe)
+  {
+    handle_subscribe(shard, sender, control, buffer, size);
+    return;
+  }
+  const auto now = std::chrono::steady_clock::now();
+  size_t clientId = 0;
+  bool known = false;
+  std::shared_ptr<ClientEndpoint> client;
+  {
+    std::lock_guard<std::mutex> lock(shard.clients_mutex_);
+    if(is_control && control.type == UDPDataLink::ControlType::Unsubscribe)
+    {
+      if(const auto * entry = shard.clients_.find(sender)) remove_shared_memory_reader(*entry->client);
+      if(shard.clients_.erase(sender) && verbose_) std::cout << "Client " << sender << " unsubscribed" << std::endl;
+      return;
+    }
+    if(auto * entry = shard.clients_.find(sender))
+    {
+      entry->last_seen = now;
+      clientId = entry->client->clientId();
+      client = entry->client;
+      known = true;
+    }
+    else if(subscription_required_)
+    {
+      // Timed out or talking to a restarted server, the client subscribes again when told so
+      if(is_control)
+      {
+        UDPDataLink::SubscribeReply reply{};
+        reply.status = UDPDataLink::SubscribeStatus::NotSubscribed;
+        send_subscribe_reply(shard, sender, 0, reply);
+      }
+      return;
+    }
+    else
+    {
+      clientId = next_client_id_++;
+      client = shard.clients_
+                   .insert(sender,
+                           std::make_shared<ClientEndpoint>(shard.socket_, sender, clientId, conflation_policy_,
+                                                            reliability_, next_message_id_, verbose_),
+                           now)
+                   .client;
+    }
+  }
+  if(!known && verbose_)
+  {
+    std::cout << "New client connected: " << clientId << "(ip: " << sender.address().to_string() << ", "
+              << sender.port() << ") - message received (" << size << " bytes) from " << sender << std::endl;
+  }
+  if(!is_control)
+  {
+    if(!known) reception_callback(buffer, size);
+    return;
+  }
+  client->set_accepts_reliable(control.flags & UDPDataLink::ControlHeader::reliable_flag);
+  if(control.type == UDPDataLink::ControlType::Ack || control.type == UDPDataLink::ControlType::Nack)
+  {
+    UDPDataLink::AckPayload ack;
+    if(known
+       && UDPDataLink::AckPayload::read(buffer + UDPDataLink::ControlHeader::size,
+                                        size - UDPDataLink::ControlHeader::size, ack))
+    {
+      client->acknowledge(ack, control.type == UDPDataLink::ControlType::Nack, fragmentation_ ? max_datagram_size_ : 0,
+                          now);
+    }
+  }
+  else if(control.type == UDPDataLink::ControlType::RateRequest)
+  {
+    UDPDataLink::RatePayload rate;
+    if(UDPDataLink::RatePayload::read(buffer + UDPDataLink::ControlHeader::size,
+                                      size - UDPDataLink::ControlHeader::size, rate)
+       && (rate.rate != client->rate() || !known))
+    {
+      // Requests are repeated with the heartbeats, only a change resets the bucket
+      client->set_rate(rate.rate, rate.burst);
+      if(verbose_) std::cout << "Client " << clientId << " asked for at most " << rate.rate << " Hz" << std::endl;
+    }
+  }
+  else if(control.type == UDPDataLink::ControlType::SharedMemory)
+  {
+    UDPDataLink::SharedMemoryPayload payload;
+    std::lock_guard<std::mutex> lock(shard.clients_mutex_);
+    // Not counted if it expired meanwhile or mapped the ring of a previous server. Only a process of this host can map
+    // the ring
+    if(in_shared_memory(1) && !client->shared_memory()
+       && UDPDataLink::SharedMemoryPayload::read(buffer + UDPDataLink::ControlHeader::size,
+                                                 size - UDPDataLink::ControlHeader::size, payload)
+       && payload.generation == shared_memory_generation_ && shard.clients_.find(sender)
+       && UDPDataLink::is_local_address(sender.address()))
+    {
+      add_shared_memory_reader(*client);
+      if(verbose_) std::cout << "Client " << clientId << " reads from shared memory" << std::endl;
+    }
+  }
+  else if(control.type != UDPDataLink::ControlType::Heartbeat)
+  {
+    control_callback(control, clientId);
+  }
+}
+void UDPServer::handle_subscribe(Shard & shard,
+                                 const udp::endpoint & sender,
+                                 const UDPDataLink::ControlHeader & control,
+                                 const uint8_t * buffer,
+                                 size_t size)
+{
+  UDPDataLink::SubscribeRequest request;
+  if(!UDPDataLink::SubscribeRequest::read(buffer + UDPDataLink::ControlHeader::size,
+                                          size - UDPDataLink::ControlHeader::size, request))
+  {
+    return;
+  }
+  UDPDataLink::SubscribeReply reply;
+  reply.rate = request.rate;
+  reply.max_datagram_size = fragmentation_ ? static_cast<uint32_t>(max_datagram_size_) : 0;
+  subscription_callback(control, request, reply);
+  if(reply.status == UDPDataLink::SubscribeStatus::Accepted && request.max_datagram_size != 0
+     && reply.max_datagram_size > request.max_datagram_size)
+  {
+    reply.status = UDPDataLink::SubscribeStatus::DatagramTooLarge;
+  }
+  const auto now = std::chrono::steady_clock::now();
+  std::lock_guard<std::mutex> lock(shard.clients_mutex_);
+  if(reply.status != UDPDataLink::SubscribeStatus::Accepted)
+  {
+    // A client already registered keeps receiving, e.g. the topics it subscribed to before
+    if(verbose_)
+    {
+      std::cout << "Subscription of " << sender << " to topic " << control.topic
+                << " refused: " << UDPDataLink::to_string(reply.status) << std::endl;
+    }
+    send_subscribe_reply(shard, sender, control.topic, reply);
+    return;
+  }
+  auto * entry = shard.clients_.find(sender);
+  const bool known = entry != nullptr;
+  if(!entry)
+  {
+    const auto clientId = next_client_id_++;
+    entry = &shard.clients_.insert(sender,
+                                   std::make_shared<ClientEndpoint>(shard.socket_, sender, clientId,
+                                                                    conflation_policy_, reliability_,
+                                                                    next_message_id_, verbose_),
+                                   now);
+    if(verbose_) std::cout << "Client " << clientId << " subscribed from " << sender << std::endl;
+  }
+  entry->last_seen = now;
+  auto & client = *entry->client;
+  client.set_accepts_reliable(control.flags & UDPDataLink::ControlHeader::reliable_flag);
+  // Requests are repeated until answered, only a change resets the bucket
+  if(!known || request.rate.rate != client.rate()) client.set_rate(request.rate.rate, request.rate.burst);
+  if((request.flags & UDPDataLink::SubscribeRequest::shared_memory_flag) && in_shared_memory(1)
+     && request.shared_memory_generation == shared_memory_generation_ && !client.shared_memory()
+     && UDPDataLink::is_local_address(sender.address()))
+  {
+    add_shared_memory_reader(client);
+  }
+  send_subscribe_reply(shard, sender, control.topic, reply);
+}
+void UDPServer::send_subscribe_reply(Shard & shard,
+                                     const udp::endpoint & sender,
+                                     uint16_t topic,
+                                     const UDPDataLink::SubscribeReply & reply)
+{
+  std::array<uint8_t, UDPDataLink::ControlHeader::size + UDPDataLink::SubscribeReply::size> message;
+  UDPDataLink::ControlHeader{UDPDataLink::ControlType::SubscribeReply, topic}.write(message.data());
+  reply.write(message.data() + UDPDataLink::ControlHeader::size);
+  boost::system::error_code error;
+  shard.socket_.send_to(boost::asio::buffer(message), sender, 0, error);
+  if(verbose_ && error) std::cerr << "Error while answering a subscription: " << error.message() << std::endl;
+}
+void UDPServer::expire_clients(Shard & shard)
+{
+  if(client_timeout_.count() == 0) return;
+  const auto now = std::chrono::steady_clock::now();
+  // Sweeping every quarter of the timeout bounds how late a client is removed without scanning on every update
+  if(now - shard.last_expiry_ < client_timeout_ / 4) return;
+  shard.last_expiry_ = now;
+  shard.clients_.expire(now, client_timeout_,
+                        [this](const auto & entry)
+                        {
+                          remove_shared_memory_reader(*entry.client);
+                          if(verbose_) std::cout << "Client " << entry.endpoint << " timed out" << std::endl;
+                        });
+}
+void UDPServer::set_reliability(const UDPDataLink::ReliabilityOptions & options)
+{
+  if(options.window == 0 || options.window > UDPDataLink::AckPayload::window)
+  {
+    throw std::invalid_argument("UDPServer::set_reliability: the window must hold between 1 and "
+                                + std::to_string(UDPDataLink::AckPayload::window) + " messages");
+  }
+  reliability_ = options;
+}
+bool UDPServer::set_shared_memory(bool state, const UDPDataLink::SharedMemoryOptions & options)
+{
+  shared_memory_enabled_ = state;
+  shared_memory_options_ = options;
+  std::lock_guard<std::mutex> lock(shared_memory_mutex_);
+  shared_memory_.reset();
+  shared_memory_slot_size_ = 0;
+  shared_memory_generation_ = 0;
+  // Created once the port is known
+  if(!state || !shards_.front()->socket_.is_open()) return true;
+  try
+  {
+    const auto address = shards_.front()->socket_.local_endpoint().address();
+    shared_memory_ =
+        std::make_unique<UDPDataLink::SharedMemoryWriter>(UDPDataLink::shared_memory_name(address, port_), options);
+  }
+  catch(const std::exception & error)
+  {
+    std::cerr << "Error while creating the shared memory ring, the clients of this host use UDP: " << error.what()
+              << std::endl;
+    return false;
+  }
+  shared_memory_slot_size_ = shared_memory_->slot_size();
+  shared_memory_generation_ = shared_memory_->generation();
+  return true;
+}
+void UDPServer::write_shared_memory(const uint8_t * buffer, size_t size)
+{
+  if(!in_shared_memory(size) || shared_memory_readers_.load(std::memory_order_acquire) == 0) return;
+  std::lock_guard<std::mutex> lock(shared_memory_mutex_);
+  shared_memory_->write(buffer, size);
+}
+bool UDPServer::in_shared_memory(size_t size) const noexcept
+{
+  return size > 0 && size <= shared_memory_slot_size_;
+}
+void UDPServer::add_shared_memory_reader(ClientEndpoint & client)
+{
+  // Counted before the client stops receiving over UDP. A message being sent meanwhile may skip both the ring and the
+  // client, which then starts from the next one
+  if(client.shared_memory()) return;
+  shared_memory_readers_.fetch_add(1, std::memory_order_acq_rel);
+  client.set_shared_memory();
+}
+void UDPServer::remove_shared_memory_reader(const ClientEndpoint & client) noexcept
+{
+  if(client.shared_memory()) shared_memory_readers_.fetch_sub(1, std::memory_order_acq_rel);
+}
+void UDPServer::set_client_timeout(std::chrono::milliseconds timeout)
+{
+  client_timeout_ = timeout;
+}
+void UDPServer::set_subscription_required(bool state)
+{
+  subscription_required_ = state;
+}
+std::vector<UDPServer::SubscriberInfo> UDPServer::subscribers() const
+{
+  std::vector<SubscriberInfo> subscribers;
+  for(size_t i = 0; i < shards_.size(); ++i)
+  {
+    std::lock_guard<std::mutex> lock(shards_[i]->clients_mutex_);
+    for(const auto & entry : shards_[i]->clients_)
+    {
+      subscribers.push_back({entry.client->clientId(), entry.endpoint, entry.connected, entry.last_seen, i,
+                             entry.client->policy(), entry.client->rate(), entry.client->shared_memory(),
+                             entry.client->stats()});
+    }
+  }
+  return subscribers;
+}
+void UDPServer::set_conflation_policy(ConflationPolicy policy)
+{
+  conflation_policy_ = policy;
+}
+bool UDPServer::set_conflation_policy(size_t subscriber_id, ConflationPolicy policy)
+{
+  for(const auto & shard : shards_)
+  {
+    std::lock_guard<std::mutex> lock(shard->clients_mutex_);
+    for(const auto & entry : shard->clients_)
+    {
+      if(entry.client->clientId() == subscriber_id)
+      {
+        entry.client->set_policy(policy);
+        return true;
+      }
+    }
+  }
+  return false;
+}
+bool UDPServer::set_rate_limit(size_t subscriber_id, double rate, size_t burst)
+{
+  for(const auto & shard : shards_)
+  {
+    std::lock_guard<std::mutex> lock(shard->clients_mutex_);
+    for(const auto & entry : shard->clients_)
+    {
+      if(entry.client->clientId() == subscriber_id)
+      {
+        entry.client->set_rate(rate, burst);
+        return true;
+      }
+    }
+  }
+  return false;
+}
+size_t UDPServer::subscriber_count() const
+{
+  size_t count = 0;
+  for(const auto & shard : shards_)
+  {
+    std::lock_guard<std::mutex> lock(shard->clients_mutex_);
+    count += shard->clients_.size();
+  }
+  return count;
 }
 void UDPServer::reception_callback(const uint8_t * buffer, size_t size)
 {
   send_data(buffer, size);
 }
 
+template<typename Sender>
+void UDPServer::send_batched(Shard & shard,
+                             Sender & batch_sender,
+                             const uint8_t * buffer,
+                             size_t size,
+                             const UDPDataLink::ConflatedQueue::Entry & message)
+{
+  // sendmmsg does not keep messages for later, clients without a token skip this one
+  const auto now = std::chrono::steady_clock::now();
+  const bool shared = in_shared_memory(size);
+  if(fragmentation_)
+  {
+    const auto chunk_size = UDPDataLink::FragmentHeader::chunk_size(max_datagram_size_);
+    UDPDataLink::make_fragment_headers(message.message_id, size, max_datagram_size_, shard.fragment_headers_);
+    for(const auto & entry : shard.clients_)
+    {
+      if((shared && entry.client->shared_memory()) || !entry.client->admit(now, message)) continue;
+      for(size_t i = 0; i < shard.fragment_headers_.size(); ++i)
+      {
+        const auto offset = i * chunk_size;
+        batch_sender.add(entry.endpoint, boost::asio::buffer(shard.fragment_headers_[i]),
+                         boost::asio::buffer(buffer + offset, std::min(chunk_size, size - offset)));
+      }
+    }
+  }
+  else
+  {
+    for(const auto & entry : shard.clients_)
+    {
+      if((shared && entry.client->shared_memory()) || !entry.client->admit(now, message)) continue;
+      batch_sender.add(entry.endpoint, boost::asio::const_buffer(), boost::asio::buffer(buffer, size));
+    }
+  }
+  const auto expected = batch_sender.size();
+  const auto sent = batch_sender.flush(shard.socket_.native_handle());
+  if(verbose_ && sent != expected)
+  {
+    std::cerr << "Error while sending: only " << sent << " out of " << expected << " datagrams were sent" << std::endl;
+  }
+}
+
+void UDPServer::send_batched(Shard & shard,
+                             const uint8_t * buffer,
+                             size_t size,
+                             const UDPDataLink::ConflatedQueue::Entry & message)
+{
+  if(shard.uring_sender_)
+    send_batched(shard, *shard.uring_sender_, buffer, size, message);
+  else
+    send_batched(shard, *shard.batch_sender_, buffer, size, message);
+}
+
+void UDPServer::fanout(Shard & shard, const UDPDataLink::ConflatedQueue::Entry & message)
+{
+  std::lock_guard<std::mutex> lock(shard.clients_mutex_);
+  expire_clients(shard);
+  const auto & buffer = message.buffer;
+  if(shard.batch_sender_ || shard.uring_sender_)
+  {
+    send_batched(shard, buffer->data(), buffer->size(), message);
+    return;
+  }
+  const auto max_datagram_size = fragmentation_ ? max_datagram_size_ : 0;
+  const bool shared = in_shared_memory(buffer->size());
+  for(auto & entry : shard.clients_)
+  {
+    if(shared && entry.client->shared_memory()) continue;
+    entry.client->send_data(message, max_datagram_size);
+  }
+}
+
+void UDPServer::send_multicast(const uint8_t * buffer, size_t size)
+{
+  // A single send whatever the number of clients, done right away from the calling thread
+  auto & shard = *shards_.front();
+  std::lock_guard<std::mutex> lock(shard.clients_mutex_);
+  boost::system::error_code error;
+  if(!fragmentation_)
+  {
+    shard.socket_.send_to(boost::asio::buffer(buffer, size), multicast_endpoint_, 0, error);
+  }
+  else
+  {
+    const auto chunk_size = UDPDataLink::FragmentHeader::chunk_size(max_datagram_size_);
+    UDPDataLink::make_fragment_headers(next_message_id_++, size, max_datagram_size_, shard.fragment_headers_);
+    for(size_t i = 0; i < shard.fragment_headers_.size() && !error; ++i)
+    {
+      const auto offset = i * chunk_size;
+      const std::array<boost::asio::const_buffer, 2> datagram = {
+          boost::asio::buffer(shard.fragment_headers_[i]),
+          boost::asio::buffer(buffer + offset, std::min(chunk_size, size - offset))};
+      shard.socket_.send_to(datagram, multicast_endpoint_, 0, error);
+    }
+  }
+  if(verbose_ && error) std::cerr << "Error while sending to the multicast group: " << error.message() << std::endl;
+}
+
+bool UDPServer::fits_fragments(size_t size) const
+{
+  if(!fragmentation_
+     || UDPDataLink::FragmentHeader::chunk_count(size, max_datagram_size_) <= std::numeric_limits<uint16_t>::max())
+  {
+    return true;
+  }
+  std::cerr << "Message of " << size << " bytes is too large to be fragmented, dropping it" << std::endl;
+  return false;
+}
+
 void UDPServer::send_data(const uint8_t * buffer, size_t size)
 {
-  for(auto & clientEndPoint : remote_endpoints_)
+  // Checked once for every path, the fragment headers count the chunks on 16 bits
+  if(!fits_fragments(size)) return;
+  if(multicast_)
+  {
+    send_multicast(buffer, size);
+    return;
+  }
+  if(shards_.size() == 1 && (shards_.front()->batch_sender_ || shards_.front()->uring_sender_))
+  {
+    write_shared_memory(buffer, size);
+    // sendmmsg and the io_uring sends complete before returning, the data does not need to outlive this call
+    auto & shard = *shards_.front();
+    UDPDataLink::ConflatedQueue::Entry message{};
+    message.message_id = next_message_id_++;
+    std::lock_guard<std::mutex> lock(shard.clients_mutex_);
+    expire_clients(shard);
+    send_batched(shard, buffer, size, message);
+    return;
+  }
+  send_data(UDPDataLink::make_shared_buffer(buffer, size));
+}
+
+void UDPServer::send_data(UDPDataLink::SharedBuffer buffer, uint32_t conflation_key, bool keyframe)
+{
+  if(multicast_)
+  {
+    send_data(buffer->data(), buffer->size());
+    return;
+  }
+  if(!fits_fragments(buffer->size())) return;
+  write_shared_memory(buffer->data(), buffer->size());
+  const UDPDataLink::ConflatedQueue::Entry message{conflation_key, std::move(buffer), next_message_id_++, keyframe};
+  if(shards_.size() == 1)
+  {
+    fanout(*shards_.front(), message);
+    return;
+  }
+  // Each shard sends to its own clients from its own thread
+  for(auto & shard_ptr : shards_)
+  {
+    auto & shard = *shard_ptr;
+    std::lock_guard<std::mutex> lock(shard.pending_mutex_);
+    shard.pending_.push(message.key, message.buffer, message.message_id, message.keyframe);
+    if(!shard.fanout_scheduled_)
+    {
+      shard.fanout_scheduled_ = true;
+      boost::asio::post(shard.io_service_, [this, &shard] { fanout_pending(shard); });
+    }
+  }
+}
+
+void UDPServer::fanout_pending(Shard & shard)
+{
   {
-    clientEndPoint.send_data(socket_, buffer, size);
+    std::lock_guard<std::mutex> lock(shard.pending_mutex_);
+    shard.sending_.swap(shard.pending_);
+    shard.fanout_scheduled_ = false;
   }
+  // Only the shard thread uses sending_, it keeps its capacity between calls
+  UDPDataLink::ConflatedQueue::Entry entry{};
+  while(shard.sending_.pop(entry)) fanout(shard, entry);
+}
+
+bool UDPServer::send_reliable(const uint8_t * buffer, size_t size)
+{
+  return send_reliable(UDPDataLink::make_shared_buffer(buffer, size));
+}
+
+bool UDPServer::send_reliable(UDPDataLink::SharedBuffer buffer)
+{
+  if(!fits_fragments(UDPDataLink::ReliableHeader::size + buffer->size())) return false;
+  const auto max_datagram_size = fragmentation_ ? max_datagram_size_ : 0;
+  const auto now = std::chrono::steady_clock::now();
+  bool queued = true;
+  std::vector<std::shared_ptr<ClientEndpoint>> clients;
+  for(auto & shard_ptr : shards_)
+  {
+    auto & shard = *shard_ptr;
+    clients.clear();
+    {
+      // Sent after releasing the lock, so that the best-effort fan-out never waits behind the reliable sends
+      std::lock_guard<std::mutex> lock(shard.clients_mutex_);
+      for(auto & entry : shard.clients_)
+      {
+        // The other clients would take the reliable message for a best-effort one
+        if(entry.client->accepts_reliable()) clients.push_back(entry.client);
+      }
+    }
+    for(const auto & client : clients)
+    {
+      if(!client->send_reliable(buffer, max_datagram_size, now))
+      {
+        queued = false;
+        if(verbose_)
+        {
+          std::cout << "Client " << client->clientId() << ": retransmit window full, dropping reliable message"
+                    << std::endl;
+        }
+      }
+    }
+    // The shard thread arms its timer for the first retransmission
+    if(!shard.retransmit_scheduled_.exchange(true))
+    {
+      boost::asio::post(shard.io_service_, [this, &shard] { retransmit(shard); });
+    }
+  }
+  return queued;
+}
+
+void UDPServer::retransmit(Shard & shard)
+{
+  shard.retransmit_scheduled_ = false;
+  const auto max_datagram_size = fragmentation_ ? max_datagram_size_ : 0;
+  const auto now = std::chrono::steady_clock::now();
+  auto next_deadline = std::chrono::steady_clock::time_point::max();
+  // Only the shard thread retransmits, it keeps the capacity of retransmit_clients_ between calls
+  shard.retransmit_clients_.clear();
+  {
+    std::lock_guard<std::mutex> lock(shard.clients_mutex_);
+    for(auto & entry : shard.clients_) shard.retransmit_clients_.push_back(entry.client);
+  }
+  for(const auto & client : shard.retransmit_clients_)
+  {
+    next_deadline = std::min(next_deadline, client->retransmit_expired(max_datagram_size, now));
+  }
+  shard.retransmit_clients_.clear();
+  // Only armed while messages wait for an acknowledgement, and by a single thread at a time
+  if(next_deadline == std::chrono::steady_clock::time_point::max() || shard.retransmit_scheduled_.exchange(true))
+  {
+    return;
+  }
+  shard.retransmit_timer_.expires_at(next_deadline);
+  shard.retransmit_timer_.async_wait(
+      [this, &shard](const boost::system::error_code & error)
+      {
+        if(error)
+        {
+          shard.retransmit_scheduled_ = false;
+          return;
+        }
+        retransmit(shard);
+      });
 }